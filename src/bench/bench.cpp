@@ -10,11 +10,36 @@
 
 #include <algorithm>
 #include <assert.h>
+#include <cstdlib>
 #include <iomanip>
 #include <iostream>
+#include <new>
 #include <numeric>
 #include <regex>
 
+// Counts the heap allocations per thread, for the benchmarks which report them (see HeapAllocations).
+// The array, nothrow and sized forms of the default operators call these ones.
+static thread_local uint64_t g_heap_allocations = 0;
+
+void* operator new(std::size_t size)
+{
+    ++g_heap_allocations;
+    if (void* ptr = std::malloc(size ? size : 1)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+uint64_t benchmark::HeapAllocations()
+{
+    return g_heap_allocations;
+}
+
 void benchmark::ConsolePrinter::header()
 {
     std::cout << "# Benchmark, evals, iterations, total, min, max, median" << std::endl;
@@ -44,6 +69,9 @@ void benchmark::ConsolePrinter::result(const State& state)
 
     std::cout << std::setprecision(6);
     std::cout << state.m_name << ", " << state.m_num_evals << ", " << state.m_num_iters << ", " << total << ", " << front << ", " << back << ", " << median << std::endl;
+    for (const auto& counter : state.m_counters) {
+        std::cout << "# " << state.m_name << ", " << counter.first << ", " << counter.second << std::endl;
+    }
 }
 
 void benchmark::ConsolePrinter::footer() {}
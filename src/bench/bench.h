@@ -9,6 +9,7 @@
 #include <limits>
 #include <map>
 #include <string>
+#include <utility>
 #include <vector>
 #include <chrono>
 
@@ -60,9 +61,16 @@ public:
     const uint64_t m_num_evals;
     std::vector<double> m_elapsed_results;
     time_point m_start_time;
+    // extra figures reported along with the timings (e.g. heap allocations per iteration)
+    std::vector<std::pair<std::string, double>> m_counters;
 
     bool UpdateTimer(time_point finish_time);
 
+    void SetCounter(const std::string& name, double value)
+    {
+        m_counters.emplace_back(name, value);
+    }
+
     State(std::string name, uint64_t num_evals, double num_iters, Printer& printer) : m_name(name), m_num_iters_left(0), m_num_iters(num_iters), m_num_evals(num_evals)
     {
     }
@@ -82,6 +90,9 @@ public:
 
 typedef std::function<void(State&)> BenchFunction;
 
+//! Number of the heap allocations (operator new) done by the calling thread so far
+uint64_t HeapAllocations();
+
 class BenchRunner
 {
     struct Bench {
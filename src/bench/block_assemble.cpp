@@ -5,11 +5,14 @@
 #include <bench/bench.h>
 #include <consensus/validation.h>
 #include <crypto/sha256.h>
+#include <masternodes/balances.h>
+#include <masternodes/mn_checks.h>
+#include <miner.h>
+#include <streams.h>
 #include <test/util.h>
 #include <txmempool.h>
 #include <validation.h>
 
-
 #include <list>
 #include <vector>
 
@@ -50,4 +53,63 @@ static void AssembleBlock(benchmark::State& state)
     }
 }
 
+// Token-heavy mempool: each UtxosToAccount credits the account, then the AccountToAccount (paying more fee) moves
+// it out. The transfers are selected first, but can't apply until their credits are in the block, so they are
+// skipped by the custom state check of the assembler instead of being included and skipped by ConnectBlock.
+static void AssembleBlockCustomTxs(benchmark::State& state)
+{
+    const std::vector<unsigned char> op_true{OP_TRUE};
+    CScriptWitness witness;
+    witness.stack.push_back(op_true);
+
+    uint256 witness_program;
+    CSHA256().Write(&op_true[0], op_true.size()).Finalize(witness_program.begin());
+
+    const CScript SCRIPT_PUB{CScript(OP_0) << std::vector<unsigned char>{witness_program.begin(), witness_program.end()}};
+    const CScript RECIPIENT{CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 1) << OP_EQUALVERIFY << OP_CHECKSIG};
+    const CAmount AMOUNT{COIN};
+
+    constexpr size_t NUM_BLOCKS{200};
+    std::vector<CTxIn> coinbases;
+    for (size_t b{0}; b < NUM_BLOCKS; ++b) {
+        coinbases.push_back(MineBlock(SCRIPT_PUB));
+    }
+    {
+        LOCK(::cs_main); // Required for ::AcceptToMemoryPool.
+
+        auto accept = [&](CMutableTransaction& tx) {
+            CValidationState state;
+            bool ret{::AcceptToMemoryPool(::mempool, state, MakeTransactionRef(tx), nullptr /* pfMissingInputs */, nullptr /* plTxnReplaced */, false /* bypass_limits */, /* nAbsurdFee */ 0)};
+            assert(ret);
+        };
+        for (size_t b{0}; b + 1 < NUM_BLOCKS - COINBASE_MATURITY; b += 2) {
+            CDataStream credit(DfTxMarker, SER_NETWORK, PROTOCOL_VERSION);
+            credit << static_cast<unsigned char>(CustomTxType::UtxosToAccount)
+                   << CUtxosToAccountMessage{{{SCRIPT_PUB, CBalances{{{DCT_ID{0}, AMOUNT}}}}}};
+            CMutableTransaction utxosToAccount;
+            utxosToAccount.vin.push_back(coinbases[b]);
+            utxosToAccount.vin.back().scriptWitness = witness;
+            CAmount const value = ::ChainstateActive().CoinsTip().AccessCoin(coinbases[b].prevout).out.nValue;
+            utxosToAccount.vout.emplace_back(AMOUNT, CScript() << OP_RETURN << ToByteVector(credit));
+            utxosToAccount.vout.emplace_back(value - AMOUNT - 1000, SCRIPT_PUB);
+            accept(utxosToAccount);
+
+            CDataStream transfer(DfTxMarker, SER_NETWORK, PROTOCOL_VERSION);
+            transfer << static_cast<unsigned char>(CustomTxType::AccountToAccount)
+                     << CAccountToAccountMessage{SCRIPT_PUB, {{RECIPIENT, CBalances{{{DCT_ID{0}, AMOUNT}}}}}};
+            CMutableTransaction accountToAccount;
+            accountToAccount.vin.push_back(coinbases[b + 1]);
+            accountToAccount.vin.back().scriptWitness = witness;
+            accountToAccount.vout.emplace_back(0, CScript() << OP_RETURN << ToByteVector(transfer));
+            accountToAccount.vout.emplace_back(::ChainstateActive().CoinsTip().AccessCoin(coinbases[b + 1].prevout).out.nValue - 100000, SCRIPT_PUB);
+            accept(accountToAccount);
+        }
+    }
+
+    while (state.KeepRunning()) {
+        PrepareBlock(SCRIPT_PUB);
+    }
+}
+
 BENCHMARK(AssembleBlock, 700);
+BENCHMARK(AssembleBlockCustomTxs, 700);
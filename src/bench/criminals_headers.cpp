@@ -0,0 +1,82 @@
+// Copyright (c) 2020 The DeFi Blockchain Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <fs.h>
+#include <masternodes/criminals.h>
+#include <validation.h>
+
+// Header acceptance as in AcceptBlockHeader: fetch the minted headers of the same masternode and 'mintedBlocks',
+// then store the new one. The previous criminals db synced every header to the disk and kept them forever,
+// now headers are buffered until the state flush, which also prunes them below the proof interval and compacts
+// the pruned range from time to time (seeks over the tombstones get slower and slower otherwise).
+
+static const int MASTERNODES_COUNT = 100;
+static const int HEADERS_PER_FLUSH = 100;
+
+class CDirectMintedHeaders : public CMintedHeadersView {
+public:
+    explicit CDirectMintedHeaders(const fs::path& dbName)
+        : CStorageView(new CStorageLevelDB(dbName, 8 << 20, false, true, true)) // direct, synced writes
+    {}
+};
+
+static void AcceptHeader(CMintedHeadersView & view, uint32_t n)
+{
+    uint256 masternodeID;
+    uint32_t const mn = n % MASTERNODES_COUNT;
+    memcpy(masternodeID.begin(), &mn, sizeof(mn));
+    CBlockHeader header;
+    header.height = n;
+    header.mintedBlocks = n / MASTERNODES_COUNT + 1;
+
+    std::map<uint256, CBlockHeader> blockHeaders;
+    view.FetchMintedHeaders(masternodeID, header.mintedBlocks, blockHeaders, false);
+    view.WriteMintedBlockHeader(masternodeID, header.mintedBlocks, header.GetHash(), header, false);
+}
+
+static void MintedHeadersDirect(benchmark::State& state)
+{
+    fs::path const path = fs::temp_directory_path() / fs::unique_path();
+    {
+        CDirectMintedHeaders view(path);
+        uint32_t n = 0;
+        while (state.KeepRunning()) {
+            for (int i = 0; i < HEADERS_PER_FLUSH; ++i) {
+                AcceptHeader(view, ++n);
+            }
+        }
+    }
+    fs::remove_all(path);
+}
+
+static void MintedHeadersBuffered(benchmark::State& state)
+{
+    fs::path const path = fs::temp_directory_path() / fs::unique_path();
+    {
+        CStorageLevelDB db(path, 8 << 20, false, true);
+        CCriminalsView view(db);
+        uint32_t n = 0;
+        size_t pruned = 0;
+        while (state.KeepRunning()) {
+            for (int i = 0; i < HEADERS_PER_FLUSH; ++i) {
+                AcceptHeader(view, ++n);
+            }
+            if (n > DOUBLE_SIGN_MINIMUM_PROOF_INTERVAL) {
+                pruned += view.PruneMintedHeaders(n - DOUBLE_SIGN_MINIMUM_PROOF_INTERVAL, MINTED_HEADERS_PRUNE_BATCH);
+            }
+            view.Flush();
+            db.Flush();
+            if (pruned >= MINTED_HEADERS_COMPACT_THRESHOLD) {
+                db.Compact(TBytes{CMintedHeadersView::MintedHeaders::prefix},
+                           TBytes{static_cast<unsigned char>(CMintedHeadersView::MintedHeadersByHeight::prefix + 1)});
+                pruned = 0;
+            }
+        }
+    }
+    fs::remove_all(path);
+}
+
+BENCHMARK(MintedHeadersDirect, 5);
+BENCHMARK(MintedHeadersBuffered, 50);
@@ -0,0 +1,92 @@
+// Copyright (c) 2020 The DeFi Blockchain Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <masternodes/mn_checks.h>
+#include <primitives/transaction.h>
+#include <streams.h>
+
+// A flood of AccountToUtxos and AccountToAccount txs: every tx is looked at several times on its way
+// (mempool acceptance, block template, ConnectBlock, reorg resurrection), each time asking for the type
+// and the non-minted outputs. Before, every look guessed the type and deserialized the metadata again;
+// now the first look parses it once and keeps it in the tx.
+
+static const int TXS_IN_FLOOD = 2000;
+static const int LOOKS_PER_TX = 4;
+
+static CScript MakeOwner(int n)
+{
+    CScript script;
+    script << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, static_cast<unsigned char>(n)) << OP_EQUALVERIFY << OP_CHECKSIG;
+    return script;
+}
+
+template <typename Msg>
+static CTransactionRef MakeCustomTx(CustomTxType type, Msg const & msg, int mintedOutputs)
+{
+    CDataStream metadata(DfTxMarker, SER_NETWORK, PROTOCOL_VERSION);
+    metadata << static_cast<unsigned char>(type) << msg;
+
+    CMutableTransaction mtx;
+    mtx.vin.resize(1);
+    mtx.vin[0].prevout = COutPoint(uint256S("01"), 0);
+    mtx.vout.emplace_back(0, CScript() << OP_RETURN << ToByteVector(metadata));
+    for (int i = 0; i < mintedOutputs; ++i) {
+        mtx.vout.emplace_back(COIN, MakeOwner(i + 1));
+    }
+    return MakeTransactionRef(std::move(mtx));
+}
+
+static std::vector<CTransactionRef> MakeFloodTxs()
+{
+    std::vector<CTransactionRef> txs;
+    for (int i = 0; i < TXS_IN_FLOOD; ++i) {
+        if (i % 2) {
+            CAccountToUtxosMessage msg{MakeOwner(i), CBalances{{{DCT_ID{0}, 2 * COIN}}}, 1};
+            txs.push_back(MakeCustomTx(CustomTxType::AccountToUtxos, msg, 2));
+        } else {
+            std::map<CScript, CBalances> to{{MakeOwner(i + 1), CBalances{{{DCT_ID{0}, COIN}}}}};
+            txs.push_back(MakeCustomTx(CustomTxType::AccountToAccount, CAccountToAccountMessage{MakeOwner(i), to}, 0));
+        }
+    }
+    return txs;
+}
+
+// the previous way (still used by the wallet, which doesn't link the node)
+static void CustomTxLookUncached(benchmark::State& state)
+{
+    auto const txs = MakeFloodTxs();
+    while (state.KeepRunning()) {
+        for (auto const & tx : txs) {
+            for (int i = 0; i < LOOKS_PER_TX; ++i) {
+                std::vector<unsigned char> dummy;
+                auto const type = GuessCustomTxType(*tx, dummy);
+                uint32_t mintingOutputsStart = std::numeric_limits<uint32_t>::max();
+                auto const accountToUtxos = GetAccountToUtxosMsg(*tx);
+                if (accountToUtxos) {
+                    mintingOutputsStart = accountToUtxos->mintingOutputsStart;
+                }
+                auto const values = tx->GetValuesOut(mintingOutputsStart);
+                assert(type != CustomTxType::None && !values.empty());
+            }
+        }
+    }
+}
+
+static void CustomTxLookCached(benchmark::State& state)
+{
+    auto const txs = MakeFloodTxs();
+    while (state.KeepRunning()) {
+        for (auto const & tx : txs) {
+            for (int i = 0; i < LOOKS_PER_TX; ++i) {
+                auto const type = GetCustomTx(*tx).type;
+                auto const values = GetNonMintedValuesOut(*tx);
+                assert(type != CustomTxType::None && !values.empty());
+            }
+        }
+    }
+}
+
+BENCHMARK(CustomTxLookUncached, 20);
+BENCHMARK(CustomTxLookCached, 20);
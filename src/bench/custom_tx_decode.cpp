@@ -0,0 +1,97 @@
+// Copyright (c) 2020 The DeFi Blockchain Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <checkqueue.h>
+#include <masternodes/mn_checks.h>
+#include <primitives/transaction.h>
+#include <streams.h>
+#include <util/system.h>
+
+#include <boost/thread/thread.hpp>
+
+// Stateless part of ConnectBlock's custom txs processing (DecodeCustomTx) for a block full of
+// UtxosToAccount and AccountToAccount txs: serially (as it was done inside of ApplyCustomTx)
+// and ahead on the CCheckQueue workers (as ConnectBlock does it now).
+
+static const int MIN_CORES = 2;
+static const int TXS_PER_BLOCK = 2000;
+static const int RECIPIENTS_PER_TX = 8;
+static const unsigned int QUEUE_BATCH_SIZE = 128;
+
+static CScript MakeOwner(int n)
+{
+    CScript script;
+    script << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, static_cast<unsigned char>(n)) << OP_EQUALVERIFY << OP_CHECKSIG;
+    return script;
+}
+
+template <typename Msg>
+static CTransactionRef MakeCustomTx(CustomTxType type, Msg const & msg, CAmount burnt)
+{
+    CDataStream metadata(DfTxMarker, SER_NETWORK, PROTOCOL_VERSION);
+    metadata << static_cast<unsigned char>(type) << msg;
+
+    CMutableTransaction mtx;
+    mtx.vin.resize(1);
+    mtx.vin[0].prevout = COutPoint(uint256S("01"), 0);
+    mtx.vout.emplace_back(burnt, CScript() << OP_RETURN << ToByteVector(metadata));
+    mtx.vout.emplace_back(COIN, MakeOwner(0));
+    return MakeTransactionRef(std::move(mtx));
+}
+
+static std::vector<CTransactionRef> MakeBlockTxs()
+{
+    std::vector<CTransactionRef> txs;
+    for (int i = 0; i < TXS_PER_BLOCK; ++i) {
+        std::map<CScript, CBalances> to;
+        for (int j = 0; j < RECIPIENTS_PER_TX; ++j) {
+            to[MakeOwner(i + j + 1)] = CBalances{{{DCT_ID{0}, COIN}}};
+        }
+        if (i % 2) {
+            txs.push_back(MakeCustomTx(CustomTxType::UtxosToAccount, CUtxosToAccountMessage{to}, RECIPIENTS_PER_TX * COIN));
+        } else {
+            txs.push_back(MakeCustomTx(CustomTxType::AccountToAccount, CAccountToAccountMessage{MakeOwner(i), to}, 0));
+        }
+    }
+    return txs;
+}
+
+static void CustomTxDecodeSerial(benchmark::State& state)
+{
+    auto const txs = MakeBlockTxs();
+    std::vector<CDecodedCustomTx> decoded(txs.size());
+    while (state.KeepRunning()) {
+        for (size_t i = 0; i < txs.size(); ++i) {
+            decoded[i] = DecodeCustomTx(*txs[i], 1000);
+            assert(decoded[i].res.ok);
+        }
+    }
+}
+
+static void CustomTxDecodeParallel(benchmark::State& state)
+{
+    auto const txs = MakeBlockTxs();
+    std::vector<CDecodedCustomTx> decoded(txs.size());
+    CCheckQueue<CCustomTxDecodeCheck> queue{QUEUE_BATCH_SIZE};
+    boost::thread_group tg;
+    for (auto x = 0; x < std::max(MIN_CORES, GetNumCores()) - 1; ++x) {
+        tg.create_thread([&]{queue.Thread();});
+    }
+    while (state.KeepRunning()) {
+        CCheckQueueControl<CCustomTxDecodeCheck> control(&queue);
+        std::vector<CCustomTxDecodeCheck> vChecks;
+        vChecks.reserve(txs.size());
+        for (size_t i = 0; i < txs.size(); ++i) {
+            vChecks.emplace_back(*txs[i], 1000, decoded[i]);
+        }
+        control.Add(vChecks);
+        control.Wait();
+    }
+    tg.interrupt_all();
+    tg.join_all();
+}
+
+BENCHMARK(CustomTxDecodeSerial, 20);
+BENCHMARK(CustomTxDecodeParallel, 20);
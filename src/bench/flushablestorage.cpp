@@ -0,0 +1,157 @@
+// Copyright (c) 2020 The DeFi Blockchain Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <flushablestorage.h>
+
+#include <map>
+#include <stdint.h>
+
+// Simulates ConnectBlock applying a block full of AccountToAccount txs to the write buffer of
+// one CCustomCSView layer: 'read balance - write balance' for sender and receiver, then flush.
+// Balance keys look like the real ones ('a' + p2pkh script + token id), values are CAmounts.
+
+static const int BALANCE_OWNERS = 500;
+static const int TRANSFERS_PER_BLOCK = 1000;
+
+static std::vector<TBytes> MakeBalanceKeys()
+{
+    std::vector<TBytes> keys;
+    for (int i = 0; i < BALANCE_OWNERS; ++i) {
+        TBytes key(1 + 1 + 25 + 1, 0);
+        key[0] = 'a';
+        key[1] = 25;
+        for (size_t j = 2; j < key.size(); ++j) {
+            key[j] = static_cast<unsigned char>(i * 31 + j);
+        }
+        keys.push_back(std::move(key));
+    }
+    return keys;
+}
+
+// The previous write buffer: std::map<TBytes, boost::optional<TBytes>>.
+// Costs a tree node + key vector + value vector per new key and one more allocation per overwrite.
+class CLegacyWriteBuffer {
+public:
+    void Write(TBytes const & key, TBytes const & value) { changed[key] = {value}; }
+    bool Read(TBytes const & key, TBytes & value) const {
+        auto it = changed.find(key);
+        if (it == changed.end() || !it->second) {
+            return false;
+        }
+        value = *it->second;
+        return true;
+    }
+    void Clear() { changed.clear(); }
+private:
+    std::map<TBytes, boost::optional<TBytes>> changed;
+};
+
+// CKVWriteBuffer: nodes and bytes come from the arena, same-size overwrites are done in place.
+// After the first block the arena chunk is reused, so steady state does no heap allocations.
+class CArenaWriteBuffer {
+public:
+    void Write(TBytes const & key, TBytes const & value) { changed.Write(ToSlice(key), ToSlice(value)); }
+    bool Read(TBytes const & key, TBytes & value) const {
+        auto val = changed.Find(ToSlice(key));
+        if (!val || val->IsErased()) {
+            return false;
+        }
+        value.assign(val->Bytes().begin(), val->Bytes().end());
+        return true;
+    }
+    void Clear() { changed.Clear(); }
+private:
+    CKVWriteBuffer changed;
+};
+
+// heap allocations per block (per iteration), which is what the arena cuts down
+class CAllocationsPerBlock {
+public:
+    void Start() { start = benchmark::HeapAllocations(); }
+    void Stop() { allocations += benchmark::HeapAllocations() - start; ++blocks; }
+    void Report(benchmark::State& state) const {
+        state.SetCounter("allocs/block", blocks ? double(allocations) / blocks : 0);
+    }
+private:
+    uint64_t start = 0;
+    uint64_t allocations = 0;
+    uint64_t blocks = 0;
+};
+
+template <typename Buffer>
+static void ApplyTransfers(benchmark::State& state)
+{
+    auto const keys = MakeBalanceKeys();
+    Buffer buffer;
+    TBytes value(sizeof(int64_t));
+    uint32_t n = 0;
+    CAllocationsPerBlock allocs;
+    while (state.KeepRunning()) {
+        allocs.Start();
+        for (int i = 0; i < TRANSFERS_PER_BLOCK; ++i, ++n) {
+            TBytes const & from = keys[n % keys.size()];
+            TBytes const & to = keys[(n * 7 + 1) % keys.size()];
+            if (!buffer.Read(from, value)) {
+                value.assign(sizeof(int64_t), 0xff);
+            }
+            --value[0];
+            buffer.Write(from, value);
+            if (!buffer.Read(to, value)) {
+                value.assign(sizeof(int64_t), 0);
+            }
+            ++value[0];
+            buffer.Write(to, value);
+        }
+        buffer.Clear();
+        allocs.Stop();
+    }
+    allocs.Report(state);
+}
+
+// Fresh keys only (new accounts, undo records): every write inserts a new entry
+template <typename Buffer>
+static void InsertFreshKeys(benchmark::State& state)
+{
+    auto keys = MakeBalanceKeys();
+    Buffer buffer;
+    TBytes const value(sizeof(int64_t), 1);
+    uint32_t n = 0;
+    CAllocationsPerBlock allocs;
+    while (state.KeepRunning()) {
+        allocs.Start();
+        for (auto & key : keys) {
+            key.back() = static_cast<unsigned char>(++n);
+            buffer.Write(key, value);
+        }
+        buffer.Clear();
+        allocs.Stop();
+    }
+    allocs.Report(state);
+}
+
+static void WriteBufferLegacyMap(benchmark::State& state)
+{
+    ApplyTransfers<CLegacyWriteBuffer>(state);
+}
+
+static void WriteBufferArena(benchmark::State& state)
+{
+    ApplyTransfers<CArenaWriteBuffer>(state);
+}
+
+static void WriteBufferLegacyMapInsert(benchmark::State& state)
+{
+    InsertFreshKeys<CLegacyWriteBuffer>(state);
+}
+
+static void WriteBufferArenaInsert(benchmark::State& state)
+{
+    InsertFreshKeys<CArenaWriteBuffer>(state);
+}
+
+BENCHMARK(WriteBufferLegacyMap, 400);
+BENCHMARK(WriteBufferArena, 400);
+BENCHMARK(WriteBufferLegacyMapInsert, 2000);
+BENCHMARK(WriteBufferArenaInsert, 2000);
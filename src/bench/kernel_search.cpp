@@ -0,0 +1,61 @@
+// Copyright (c) 2020 The DeFi Blockchain Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <chainparams.h>
+#include <pos_kernel.h>
+
+// One staker pass: a window of coinstake times for a few masternodes, against a target which is rarely met.
+// CheckKernelHash serializes the whole preimage into a new stream and divides the 256-bit hash by the collateral
+// on every attempt, the kernel search patches the time into the prepared preimage and compares with a bound.
+
+static const int MASTERNODES_COUNT = 8;
+static const int64_t SEARCH_INTERVAL = 64;
+static const uint32_t SEARCH_BITS = 0x1500ffff;
+
+static uint256 MasternodeID(int i)
+{
+    uint256 id;
+    memcpy(id.begin(), &i, sizeof(i));
+    return id;
+}
+
+static void KernelSearchLegacy(benchmark::State& state)
+{
+    SelectParams(CBaseChainParams::REGTEST);
+    uint256 const stakeModifier = uint256S("1234567890abcdef1234567890abcdef1234567890abcdef1234567890abcdef");
+    int64_t coinstakeTime = 1600000000;
+    size_t found = 0;
+    while (state.KeepRunning()) {
+        for (int64_t t = 0; t < SEARCH_INTERVAL; ++t, ++coinstakeTime) {
+            for (int i = 0; i < MASTERNODES_COUNT; ++i) {
+                found += pos::CheckKernelHash(stakeModifier, SEARCH_BITS, coinstakeTime, Params().GetConsensus(), MasternodeID(i)).hashOk;
+            }
+        }
+    }
+    assert(found == 0);
+}
+
+static void KernelSearch(benchmark::State& state)
+{
+    SelectParams(CBaseChainParams::REGTEST);
+    uint256 const stakeModifier = uint256S("1234567890abcdef1234567890abcdef1234567890abcdef1234567890abcdef");
+    std::vector<pos::CKernelSearch> kernels;
+    for (int i = 0; i < MASTERNODES_COUNT; ++i) {
+        kernels.emplace_back(stakeModifier, SEARCH_BITS, MasternodeID(i));
+    }
+    int64_t coinstakeTime = 1600000000;
+    size_t found = 0;
+    while (state.KeepRunning()) {
+        for (int64_t t = 0; t < SEARCH_INTERVAL; ++t, ++coinstakeTime) {
+            for (auto & kernel : kernels) {
+                found += kernel.Check(coinstakeTime);
+            }
+        }
+    }
+    assert(found == 0);
+}
+
+BENCHMARK(KernelSearchLegacy, 10);
+BENCHMARK(KernelSearch, 100);
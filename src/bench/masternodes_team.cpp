@@ -0,0 +1,91 @@
+// Copyright (c) 2020 The DeFi Blockchain Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <arith_uint256.h>
+#include <bench/bench.h>
+#include <chainparams.h>
+#include <hash.h>
+#include <masternodes/masternodes.h>
+
+// Anchoring team selection (CalcNextTeam) over a view with 10k+ masternodes: the previous full scan of
+// the masternodes table, the top-k selection over the in-memory active set (new stakeModifier every
+// block) and the memoized result (the same stakeModifier asked by ConnectBlock, miner and anchors).
+
+static const int MASTERNODES = 12000;
+static const int HEIGHT = 100000;
+
+static CKeyID MakeKeyID(uint32_t n)
+{
+    std::vector<unsigned char> bytes(20, 0);
+    memcpy(bytes.data(), &n, sizeof(n));
+    return CKeyID(uint160(bytes));
+}
+
+static std::unique_ptr<CCustomCSView> MakeMasternodesView(std::unique_ptr<CStorageLevelDB> & db)
+{
+    SelectParams(CBaseChainParams::REGTEST);
+    db = MakeUnique<CStorageLevelDB>(fs::path("mnteam"), 8 << 20, true);
+    auto view = MakeUnique<CCustomCSView>(*db);
+    for (int i = 0; i < MASTERNODES; ++i) {
+        CMasternode node;
+        node.operatorType = node.ownerType = 1;
+        node.operatorAuthAddress = MakeKeyID(2 * i + 1);
+        node.ownerAuthAddress = MakeKeyID(2 * i + 2);
+        node.creationHeight = 1 + i % 1000;
+        if (i % 10 == 0) { // some are resigned
+            node.resignHeight = node.creationHeight + 100;
+        }
+        view->CreateMasternode(ArithToUint256(arith_uint256(i + 1)), node);
+    }
+    view->Flush();
+    return view;
+}
+
+static void TeamFullScan(benchmark::State& state)
+{
+    std::unique_ptr<CStorageLevelDB> db;
+    auto view = MakeMasternodesView(db);
+    int const teamSize = Params().GetConsensus().mn.anchoringTeamSize;
+    uint64_t n = 0;
+    while (state.KeepRunning()) {
+        uint256 const stakeModifier = ArithToUint256(arith_uint256(++n));
+        std::map<arith_uint256, CKeyID> priorityMN;
+        view->ForEachMasternode([&] (uint256 const & id, CMasternode & node) {
+            if (node.IsActive(HEIGHT)) {
+                CDataStream ss{SER_GETHASH, PROTOCOL_VERSION};
+                ss << id << stakeModifier;
+                priorityMN.emplace(UintToArith256(Hash(ss.begin(), ss.end())), node.operatorAuthAddress);
+            }
+            return true;
+        });
+        CTeamView::CTeam team;
+        for (auto it = priorityMN.begin(); it != priorityMN.end() && (int) team.size() < teamSize; ++it) {
+            team.insert(it->second);
+        }
+        assert(!team.empty());
+    }
+}
+
+static void TeamTopK(benchmark::State& state)
+{
+    std::unique_ptr<CStorageLevelDB> db;
+    auto view = MakeMasternodesView(db);
+    uint64_t n = 0;
+    while (state.KeepRunning()) {
+        assert(!view->CalcNextTeam(ArithToUint256(arith_uint256(++n)), HEIGHT).empty());
+    }
+}
+
+static void TeamMemoized(benchmark::State& state)
+{
+    std::unique_ptr<CStorageLevelDB> db;
+    auto view = MakeMasternodesView(db);
+    while (state.KeepRunning()) {
+        assert(!view->CalcNextTeam(uint256S("01"), HEIGHT).empty());
+    }
+}
+
+BENCHMARK(TeamFullScan, 5);
+BENCHMARK(TeamTopK, 20);
+BENCHMARK(TeamMemoized, 100000);
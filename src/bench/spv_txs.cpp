@@ -0,0 +1,100 @@
+// Copyright (c) 2020 The DeFi Blockchain Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <chainparams.h>
+#include <dbwrapper.h>
+#include <fs.h>
+#include <masternodes/anchors.h>
+#include <random.h>
+#include <spv/spv_wrapper.h>
+#include <txdb.h>
+#include <validation.h>
+
+#include <spv/bitcoin/BRTransaction.h>
+
+// Confirmation of the wallet txs by the spv peer manager ('txUpdated' callback with a batch of hashes).
+// The previous "tx2msg" table kept the body and the confirmation in one record, so every update read the whole
+// serialized tx back and wrote it again, unbatched. Now bodies are written once and the confirmations live in
+// their own small records, written by one batch per callback.
+
+static const size_t WALLET_TXS = 1000;
+
+static BRTransaction * MakeWalletTx()
+{
+    BRTransaction *tx = BRTransactionNew();
+    spv::TBytes const script(25, 0x76);
+    for (int i = 0; i < 3; ++i) {
+        UInt256 prevHash;
+        GetRandBytes(prevHash.u8, sizeof(prevHash.u8));
+        BRTransactionAddInput(tx, prevHash, i, 100000, script.data(), script.size(), NULL, 0, NULL, 0, TXIN_SEQUENCE);
+    }
+    BRTransactionAddOutput(tx, 330, script.data(), script.size());
+    BRTransactionAddOutput(tx, 0, script.data(), script.size());
+    GetRandBytes(tx->txHash.u8, sizeof(tx->txHash.u8));
+    return tx;
+}
+
+static void SpvTxsUpdateLegacy(benchmark::State& state)
+{
+    using db_tx_rec = std::pair<spv::TBytes, std::pair<uint32_t, uint32_t>>;
+    CDBWrapper db(fs::temp_directory_path() / fs::unique_path(), 1 << 23, true, true);
+
+    std::vector<uint256> hashes;
+    for (size_t i = 0; i < WALLET_TXS; ++i) {
+        BRTransaction *tx = MakeWalletTx();
+        spv::TBytes buf(BRTransactionSerialize(tx, NULL, 0));
+        BRTransactionSerialize(tx, buf.data(), buf.size());
+        hashes.push_back(spv::to_uint256(tx->txHash));
+        db.Write(std::make_pair('T', hashes.back()), db_tx_rec{buf, {TX_UNCONFIRMED, 0}});
+        BRTransactionFree(tx);
+    }
+
+    uint32_t height = 0;
+    while (state.KeepRunning()) {
+        ++height;
+        for (auto const & hash : hashes) {
+            db_tx_rec rec;
+            if (db.Read(std::make_pair('T', hash), rec)) {
+                rec.second = {height, height * 600};
+                db.Write(std::make_pair('T', hash), rec);
+            }
+        }
+    }
+}
+
+// regtest stand-in of the spv (CFakeSpvWrapper), the whole callback is measured (with the anchors index lookup)
+static void SpvTxsUpdate(benchmark::State& state)
+{
+    SelectParams(CBaseChainParams::REGTEST);
+    // the callbacks look the txs up in the global anchors index, an empty one is swapped in for the bench
+    std::unique_ptr<CAnchorIndex> savedAnchors;
+    {
+        LOCK(cs_main);
+        savedAnchors = std::move(panchors);
+        panchors = MakeUnique<CAnchorIndex>(nMinDbCache << 20, true, true);
+        panchors->Load();
+    }
+    spv::CFakeSpvWrapper spv;
+
+    std::vector<UInt256> hashes;
+    for (size_t i = 0; i < WALLET_TXS; ++i) {
+        BRTransaction *tx = MakeWalletTx();
+        spv.OnTxAdded(tx);
+        hashes.push_back(tx->txHash);
+        BRTransactionFree(tx);
+    }
+
+    uint32_t height = 0;
+    while (state.KeepRunning()) {
+        ++height;
+        spv.OnTxUpdated(hashes.data(), hashes.size(), height, height * 600);
+    }
+
+    LOCK(cs_main);
+    panchors = std::move(savedAnchors);
+}
+
+BENCHMARK(SpvTxsUpdateLegacy, 10);
+BENCHMARK(SpvTxsUpdate, 10);
@@ -0,0 +1,90 @@
+// Copyright (c) 2020 The DeFi Blockchain Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <amount.h>
+#include <flushablestorage.h>
+#include <masternodes/balances.h>
+
+// Full scan of 1M balances (like listaccounts): leveldb (in memory) under the flushable layer, with a few
+// thousands of pending changes in the layer, and neighbour prefixes around. The previous ForEach copied
+// key and value of every entry out of each layer and decoded the whole key just to check its prefix.
+
+static const int BALANCES_COUNT = 1000000;
+static const int PENDING_CHANGES = 5000;
+
+struct ByBenchBalanceKey { static const unsigned char prefix; };
+const unsigned char ByBenchBalanceKey::prefix = 'a';
+
+static CScript MakeOwner(uint32_t n)
+{
+    std::vector<unsigned char> hash(20, 0);
+    memcpy(hash.data(), &n, sizeof(n));
+    CScript script;
+    script << OP_DUP << OP_HASH160 << hash << OP_EQUALVERIFY << OP_CHECKSIG;
+    return script;
+}
+
+class CBenchStorage : public CStorageView {
+public:
+    explicit CBenchStorage(CStorageKV& db) : CStorageView(new CFlushableStorageKV(db)) {}
+
+    // ForEach as it was: Key()/Value() copies, the full key is decoded for the prefix check
+    template<typename By, typename KeyType, typename ValueType>
+    void ForEachLegacy(std::function<bool(KeyType const &, ValueType &)> callback) {
+        auto key = std::make_pair<unsigned char, KeyType>((unsigned char) By::prefix, KeyType());
+        auto it = DB().NewIterator();
+        for(it->Seek(DbTypeToBytes(key)); it->Valid() && (BytesToDbType(it->Key(), key), key.first == By::prefix); it->Next()) {
+            ValueType value;
+            BytesToDbType(it->Value(), value);
+            if (!callback(key.second, value))
+                break;
+        }
+    }
+};
+
+static void FillBalances(CStorageLevelDB& db, CBenchStorage& view)
+{
+    for (int i = 0; i < BALANCES_COUNT; ++i) {
+        db.Write(DbTypeToBytes(std::make_pair(ByBenchBalanceKey::prefix, BalanceKey{MakeOwner(i), DCT_ID{uint32_t(i % 4)}})), DbTypeToBytes(CAmount(i)));
+    }
+    db.Write(DbTypeToBytes(std::make_pair('b', uint32_t(0))), DbTypeToBytes(CAmount(0)));
+    db.Flush();
+    for (int i = 0; i < PENDING_CHANGES; ++i) {
+        view.WriteBy<ByBenchBalanceKey>(BalanceKey{MakeOwner(i * 97), DCT_ID{uint32_t(i % 4)}}, CAmount(-i));
+    }
+}
+
+static void StorageForEachLegacy(benchmark::State& state)
+{
+    CStorageLevelDB db(fs::path("bench_foreach"), 64 << 20, true);
+    CBenchStorage view(db);
+    FillBalances(db, view);
+    while (state.KeepRunning()) {
+        CAmount sum = 0;
+        view.ForEachLegacy<ByBenchBalanceKey, BalanceKey, CAmount>([&] (BalanceKey const &, CAmount & amount) {
+            sum += amount;
+            return true;
+        });
+        assert(sum != 0);
+    }
+}
+
+static void StorageForEach(benchmark::State& state)
+{
+    CStorageLevelDB db(fs::path("bench_foreach"), 64 << 20, true);
+    CBenchStorage view(db);
+    FillBalances(db, view);
+    while (state.KeepRunning()) {
+        CAmount sum = 0;
+        view.ForEach<ByBenchBalanceKey, BalanceKey, CAmount>([&] (BalanceKey const &, CAmount & amount) {
+            sum += amount;
+            return true;
+        });
+        assert(sum != 0);
+    }
+}
+
+BENCHMARK(StorageForEachLegacy, 1);
+BENCHMARK(StorageForEach, 1);
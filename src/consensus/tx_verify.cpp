@@ -216,8 +216,7 @@ bool Consensus::CheckTxInputs(const CTransaction& tx, CValidationState& state, c
     }
 
     // check for tokens values
-    std::vector<unsigned char> dummy;
-    const auto txType = GuessCustomTxType(tx, dummy);
+    const auto txType = GetCustomTx(tx).type;
 
     if (NotAllowedToFail(txType)) {
         auto res = ApplyCustomTx(const_cast<CCustomCSView&>(*mnview), inputs, tx, Params(), nSpendHeight, true); // note for 'isCheck == true' here
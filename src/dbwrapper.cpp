@@ -6,6 +6,7 @@
 
 #include <memory>
 #include <random.h>
+#include <sync.h>
 
 #include <leveldb/cache.h>
 #include <leveldb/env.h>
@@ -13,6 +14,8 @@
 #include <memenv.h>
 #include <stdint.h>
 #include <algorithm>
+#include <atomic>
+#include <set>
 
 class CDefiLevelDBLogger : public leveldb::Logger {
 public:
@@ -97,10 +100,47 @@ static void SetMaxOpenFiles(leveldb::Options *options) {
              options->max_open_files, default_open_files);
 }
 
+// LRU block cache which counts the lookups, to tell how well the db's share of -dbcache works
+class CDefiLevelDBCache : public leveldb::Cache
+{
+public:
+    explicit CDefiLevelDBCache(size_t capacity_) : capacity(capacity_), hits(0), misses(0), cache(leveldb::NewLRUCache(capacity_)) {}
+    ~CDefiLevelDBCache() override { delete cache; }
+
+    Handle* Insert(const leveldb::Slice& key, void* value, size_t charge, void (*deleter)(const leveldb::Slice& key, void* value)) override {
+        return cache->Insert(key, value, charge, deleter);
+    }
+    Handle* Lookup(const leveldb::Slice& key) override {
+        Handle* handle = cache->Lookup(key);
+        if (handle) {
+            ++hits;
+        } else {
+            ++misses;
+        }
+        return handle;
+    }
+    void Release(Handle* handle) override { cache->Release(handle); }
+    void* Value(Handle* handle) override { return cache->Value(handle); }
+    void Erase(const leveldb::Slice& key) override { cache->Erase(key); }
+    uint64_t NewId() override { return cache->NewId(); }
+    void Prune() override { cache->Prune(); }
+    size_t TotalCharge() const override { return cache->TotalCharge(); }
+
+    const size_t capacity;
+    std::atomic<uint64_t> hits;
+    std::atomic<uint64_t> misses;
+private:
+    leveldb::Cache* const cache;
+};
+
+// open databases, for GetDBCacheStats
+static Mutex cs_dbwrappers;
+static std::set<const CDBWrapper*> g_dbwrappers GUARDED_BY(cs_dbwrappers);
+
 static leveldb::Options GetOptions(size_t nCacheSize)
 {
     leveldb::Options options;
-    options.block_cache = leveldb::NewLRUCache(nCacheSize / 2);
+    options.block_cache = new CDefiLevelDBCache(nCacheSize / 2);
     options.write_buffer_size = nCacheSize / 4; // up to two write buffers may be held in memory simultaneously
     options.filter_policy = leveldb::NewBloomFilterPolicy(10);
     options.compression = leveldb::kNoCompression;
@@ -164,10 +204,17 @@ CDBWrapper::CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory, bo
     }
 
     LogPrintf("Using obfuscation key for %s: %s\n", path.string(), HexStr(obfuscate_key));
+
+    LOCK(cs_dbwrappers);
+    g_dbwrappers.insert(this);
 }
 
 CDBWrapper::~CDBWrapper()
 {
+    {
+        LOCK(cs_dbwrappers);
+        g_dbwrappers.erase(this);
+    }
     delete pdb;
     pdb = nullptr;
     delete options.filter_policy;
@@ -180,6 +227,19 @@ CDBWrapper::~CDBWrapper()
     options.env = nullptr;
 }
 
+void CDBBatch::Append(const CDBBatch& other)
+{
+    assert(&parent == &other.parent);
+    struct Appender : public leveldb::WriteBatch::Handler {
+        explicit Appender(leveldb::WriteBatch& batch_) : batch(batch_) {}
+        void Put(const leveldb::Slice& key, const leveldb::Slice& value) override { batch.Put(key, value); }
+        void Delete(const leveldb::Slice& key) override { batch.Delete(key); }
+        leveldb::WriteBatch& batch;
+    } appender(batch);
+    dbwrapper_private::HandleError(other.batch.Iterate(&appender));
+    size_estimate += other.size_estimate;
+}
+
 bool CDBWrapper::WriteBatch(CDBBatch& batch, bool fSync)
 {
     const bool log_memory = LogAcceptCategory(BCLog::LEVELDB);
@@ -206,6 +266,25 @@ size_t CDBWrapper::DynamicMemoryUsage() const {
     return stoul(memory);
 }
 
+CDBWrapper::CacheStats CDBWrapper::GetCacheStats() const
+{
+    auto const & cache = static_cast<const CDefiLevelDBCache&>(*options.block_cache);
+    return CacheStats{cache.capacity, cache.TotalCharge(), cache.hits, cache.misses, options.write_buffer_size};
+}
+
+std::vector<std::pair<std::string, CDBWrapper::CacheStats>> GetDBCacheStats()
+{
+    LOCK(cs_dbwrappers);
+    std::vector<std::pair<std::string, CDBWrapper::CacheStats>> result;
+    for (auto const db : g_dbwrappers) {
+        result.emplace_back(db->GetName(), db->GetCacheStats());
+    }
+    std::sort(result.begin(), result.end(), [](const std::pair<std::string, CDBWrapper::CacheStats>& a, const std::pair<std::string, CDBWrapper::CacheStats>& b) {
+        return a.first < b.first;
+    });
+    return result;
+}
+
 // Prefixed with null character to avoid collisions with other keys
 //
 // We must use a string constructor which specifies length so that we copy
@@ -8,6 +8,7 @@
 #include <clientversion.h>
 #include <fs.h>
 #include <serialize.h>
+#include <span.h>
 #include <streams.h>
 #include <util/system.h>
 #include <util/strencodings.h>
@@ -127,6 +128,9 @@ public:
     }
 
     size_t SizeEstimate() const { return size_estimate; }
+
+    /** Appends the operations of another batch of the same db (the values are obfuscated already) */
+    void Append(const CDBBatch& other);
 };
 
 class CDBIterator
@@ -187,6 +191,22 @@ public:
         return piter->value().size();
     }
 
+    /** Raw key bytes, valid until the iterator moves */
+    Span<const unsigned char> GetKeySpan() const {
+        leveldb::Slice slKey = piter->key();
+        return Span<const unsigned char>(reinterpret_cast<const unsigned char*>(slKey.data()), slKey.size());
+    }
+
+    /** Raw (still obfuscated, see GetObfuscateKey) value bytes, valid until the iterator moves */
+    Span<const unsigned char> GetRawValueSpan() const {
+        leveldb::Slice slValue = piter->value();
+        return Span<const unsigned char>(reinterpret_cast<const unsigned char*>(slValue.data()), slValue.size());
+    }
+
+    const std::vector<unsigned char>& GetObfuscateKey() const {
+        return dbwrapper_private::GetObfuscateKey(parent);
+    }
+
 };
 
 //template<>
@@ -257,8 +277,29 @@ public:
     CDBWrapper(const CDBWrapper&) = delete;
     CDBWrapper& operator=(const CDBWrapper&) = delete;
 
+    /** Caches of the db: size and usage of the block cache, its lookups since the db was opened, write buffer size */
+    struct CacheStats {
+        size_t capacity;
+        size_t usage;
+        uint64_t hits;
+        uint64_t misses;
+        size_t writeBuffer;
+    };
+    CacheStats GetCacheStats() const;
+    const std::string& GetName() const { return m_name; }
+
+    /** Consistent point-in-time view of the database for Read/Exists/NewIterator, released together with the
+     *  last copy of the pointer (which shouldn't outlive the database) */
+    std::shared_ptr<const leveldb::Snapshot> GetSnapshot() const
+    {
+        leveldb::DB* db = pdb;
+        return std::shared_ptr<const leveldb::Snapshot>(pdb->GetSnapshot(), [db](const leveldb::Snapshot* snapshot) {
+            db->ReleaseSnapshot(snapshot);
+        });
+    }
+
     template <typename K, typename V>
-    bool Read(const K& key, V& value) const
+    bool Read(const K& key, V& value, const leveldb::Snapshot* snapshot = nullptr) const
     {
         CDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(DBWRAPPER_PREALLOC_KEY_SIZE);
@@ -266,8 +307,10 @@ public:
         leveldb::Slice slKey(ssKey.data(), ssKey.size());
 //        leveldb::Slice slKey(SliceKey(key));
 
+        leveldb::ReadOptions options = readoptions;
+        options.snapshot = snapshot;
         std::string strValue;
-        leveldb::Status status = pdb->Get(readoptions, slKey, &strValue);
+        leveldb::Status status = pdb->Get(options, slKey, &strValue);
         if (!status.ok()) {
             if (status.IsNotFound())
                 return false;
@@ -293,7 +336,7 @@ public:
     }
 
     template <typename K>
-    bool Exists(const K& key) const
+    bool Exists(const K& key, const leveldb::Snapshot* snapshot = nullptr) const
     {
         CDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(DBWRAPPER_PREALLOC_KEY_SIZE);
@@ -301,8 +344,10 @@ public:
         leveldb::Slice slKey(ssKey.data(), ssKey.size());
 //        leveldb::Slice slKey(SliceKey(key));
 
+        leveldb::ReadOptions options = readoptions;
+        options.snapshot = snapshot;
         std::string strValue;
-        leveldb::Status status = pdb->Get(readoptions, slKey, &strValue);
+        leveldb::Status status = pdb->Get(options, slKey, &strValue);
         if (!status.ok()) {
             if (status.IsNotFound())
                 return false;
@@ -337,9 +382,11 @@ public:
         return WriteBatch(batch, true);
     }
 
-    CDBIterator *NewIterator()
+    CDBIterator *NewIterator(const leveldb::Snapshot* snapshot = nullptr)
     {
-        return new CDBIterator(*this, pdb->NewIterator(iteroptions));
+        leveldb::ReadOptions options = iteroptions;
+        options.snapshot = snapshot;
+        return new CDBIterator(*this, pdb->NewIterator(options));
     }
 
     /**
@@ -381,4 +428,7 @@ public:
 
 };
 
+/** Block cache stats of all of the open databases, by name */
+std::vector<std::pair<std::string, CDBWrapper::CacheStats>> GetDBCacheStats();
+
 #endif // DEFI_DBWRAPPER_H
@@ -6,12 +6,74 @@
 #define DEFI_FLUSHABLESTORAGE_H
 
 #include <dbwrapper.h>
+#include <span.h>
+#include <sync.h>
+#include <util/bytevectorhash.h>
 #include <boost/optional.hpp>
 #include <boost/scoped_ptr.hpp>
 #include <boost/thread.hpp>
 
+#include <algorithm>
+#include <cstring>
+#include <list>
+#include <map>
+#include <memory>
+#include <typeindex>
+#include <unordered_map>
+#include <vector>
+
 using TBytes = std::vector<unsigned char>;
-using MapKV = std::map<TBytes, boost::optional<TBytes>>;
+using TSlice = Span<const unsigned char>; // non-owning view over key/value bytes
+
+static inline TSlice ToSlice(const TBytes& bytes) {
+    return TSlice(bytes.data(), bytes.size());
+}
+
+// bytewise order, the same as leveldb's default comparator
+static inline int CompareSlices(const TSlice& a, const TSlice& b) {
+    size_t const len = std::min(a.size(), b.size());
+    int const cmp = len ? memcmp(a.data(), b.data(), len) : 0;
+    return cmp != 0 ? cmp : (a.size() < b.size() ? -1 : (a.size() > b.size() ? 1 : 0));
+}
+
+static inline bool HasPrefix(const TSlice& bytes, const TBytes& prefix) {
+    return bytes.size() >= static_cast<std::ptrdiff_t>(prefix.size()) && (prefix.empty() || memcmp(bytes.data(), prefix.data(), prefix.size()) == 0);
+}
+
+// Minimal stream for reading from a slice (VectorReader without the vector), to decode in place
+class CSliceReader {
+public:
+    CSliceReader(int type, int version, TSlice data) : m_type(type), m_version(version), m_data(data), m_pos(0) {}
+
+    template<typename T>
+    CSliceReader& operator>>(T& obj) {
+        ::Unserialize(*this, obj);
+        return *this;
+    }
+
+    int GetVersion() const { return m_version; }
+    int GetType() const { return m_type; }
+
+    size_t size() const { return m_data.size() - m_pos; }
+    bool empty() const { return size() == 0; }
+
+    void read(char* dst, size_t n) {
+        if (n == 0) {
+            return;
+        }
+        if (n > size()) {
+            throw std::ios_base::failure("CSliceReader::read(): end of data");
+        }
+        memcpy(dst, m_data.data() + m_pos, n);
+        m_pos += n;
+    }
+
+private:
+    const int m_type;
+    const int m_version;
+    const TSlice m_data;
+    size_t m_pos;
+};
 
 template<typename T>
 static TBytes DbTypeToBytes(const T& value) {
@@ -31,6 +93,16 @@ static void BytesToDbType(const TBytes& bytes, T& value) {
     }
 }
 
+template<typename T>
+static void SliceToDbType(const TSlice& bytes, T& value) {
+    try {
+        CSliceReader stream(SER_DISK, CLIENT_VERSION, bytes);
+        stream >> value;
+    }
+    catch (std::ios_base::failure&) {
+    }
+}
+
 // Key-Value storage iterator interface
 class CStorageKVIterator {
 public:
@@ -38,14 +110,134 @@ public:
     virtual void Seek(const TBytes& key) = 0;
     virtual void Next() = 0;
     virtual bool Valid() = 0;
-    virtual TBytes Key() = 0;
-    virtual TBytes Value() = 0;
+    // bytes of the current entry, valid until the iterator moves
+    virtual TSlice KeySlice() = 0;
+    virtual TSlice ValueSlice() = 0;
+
+    TBytes Key() {
+        auto const key = KeySlice();
+        return TBytes(key.begin(), key.end());
+    }
+    TBytes Value() {
+        auto const value = ValueSlice();
+        return TBytes(value.begin(), value.end());
+    }
+};
+
+// Size-bounded LRU cache of already decoded values, keyed by the serialized db key.
+// Values of any type may be stored; an entry is a hit only if it is read back as the same type.
+// Absent keys are cached too (as empty entries), most lookups of operators/balances are misses.
+class CDecodedValueCache {
+public:
+    struct Stats {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t invalidations;
+        uint64_t evictions;
+        size_t entries;
+        size_t maxEntries;
+    };
+
+    explicit CDecodedValueCache(size_t maxEntries_) : maxEntries(maxEntries_), epoch(0) {
+        stats = {};
+    }
+    CDecodedValueCache(const CDecodedValueCache&) = delete;
+    void operator=(const CDecodedValueCache&) = delete;
+
+    // returns false on miss; on hit, 'exists' tells whether the key is present in the db
+    template<typename T>
+    bool Get(const TBytes& key, T& value, bool& exists) {
+        LOCK(cs);
+        auto it = index.find(key);
+        if (it == index.end() || it->second->type != std::type_index(typeid(T))) {
+            ++stats.misses;
+            return false;
+        }
+        lru.splice(lru.begin(), lru, it->second);
+        ++stats.hits;
+        exists = static_cast<bool>(it->second->value);
+        if (exists) {
+            value = *static_cast<const T*>(it->second->value.get());
+        }
+        return true;
+    }
+    // 'value' is nullptr for the absent key. Dropped if any invalidation happened after 'readEpoch'
+    // was taken, cause the value could be read before the change
+    template<typename T>
+    void Put(const TBytes& key, uint64_t readEpoch, const T* value) {
+        LOCK(cs);
+        if (readEpoch != epoch || maxEntries == 0) {
+            return;
+        }
+        std::shared_ptr<const void> ptr;
+        if (value) {
+            ptr = std::make_shared<const T>(*value);
+        }
+        auto it = index.find(key);
+        if (it != index.end()) {
+            it->second->type = std::type_index(typeid(T));
+            it->second->value = std::move(ptr);
+            lru.splice(lru.begin(), lru, it->second);
+            return;
+        }
+        lru.push_front(Entry{key, std::type_index(typeid(T)), std::move(ptr)});
+        index.emplace(key, lru.begin());
+        while (lru.size() > maxEntries) {
+            index.erase(lru.back().key);
+            lru.pop_back();
+            ++stats.evictions;
+        }
+    }
+    void Invalidate(const TBytes& key) {
+        LOCK(cs);
+        ++epoch;
+        auto it = index.find(key);
+        if (it != index.end()) {
+            lru.erase(it->second);
+            index.erase(it);
+            ++stats.invalidations;
+        }
+    }
+    void Clear() {
+        LOCK(cs);
+        ++epoch;
+        index.clear();
+        lru.clear();
+    }
+    uint64_t Epoch() const {
+        LOCK(cs);
+        return epoch;
+    }
+    Stats GetStats() const {
+        LOCK(cs);
+        Stats result = stats;
+        result.entries = lru.size();
+        result.maxEntries = maxEntries;
+        return result;
+    }
+
+private:
+    struct Entry {
+        TBytes key;
+        std::type_index type;
+        std::shared_ptr<const void> value;
+    };
+    using LruList = std::list<Entry>;
+
+    mutable CCriticalSection cs;
+    LruList lru; // most recently used first
+    std::unordered_map<TBytes, LruList::iterator, ByteVectorHash> index;
+    size_t const maxEntries;
+    uint64_t epoch; // bumped on every invalidation
+    Stats stats;
 };
 
 // Key-Value storage interface
 class CStorageKV {
 public:
     virtual ~CStorageKV() {}
+    // cache of decoded values that is valid for 'key' at this level, if any
+    virtual CDecodedValueCache* GetReadCache(const TBytes& key) const { return nullptr; }
     virtual bool Exists(const TBytes& key) const = 0;
     virtual bool Write(const TBytes& key, const TBytes& value) = 0;
     virtual bool Erase(const TBytes& key) = 0;
@@ -79,206 +271,479 @@ struct RawTBytes {
     }
 };
 
-// LevelDB glue layer Iterator
+// Key as stored in the db: prepended with the storage's prefix (copied) only if the db is shared
+class CStorageLevelDBKey {
+public:
+    CStorageLevelDBKey(const TBytes& prefix, const TBytes& key)
+        : full(prefix.empty() ? TBytes{} : Concat(prefix, key)), raw{prefix.empty() ? (TBytes&)key : full} {}
+    const RawTBytes& Get() const { return raw; }
+private:
+    static TBytes Concat(const TBytes& prefix, const TBytes& key) {
+        TBytes result;
+        result.reserve(prefix.size() + key.size());
+        result.insert(result.end(), prefix.begin(), prefix.end());
+        result.insert(result.end(), key.begin(), key.end());
+        return result;
+    }
+    TBytes full;
+    RawTBytes raw;
+};
+
+// LevelDB glue layer Iterator. Keys and values are not copied out of leveldb's buffers,
+// unless the db is obfuscated (enhancedcs and the other storages built on it are not)
 class CStorageLevelDBIterator : public CStorageKVIterator {
 public:
-    explicit CStorageLevelDBIterator(std::unique_ptr<CDBIterator>&& it) : it{std::move(it)} { }
+    explicit CStorageLevelDBIterator(std::unique_ptr<CDBIterator>&& it, const TBytes& prefix = {}) : it{std::move(it)}, prefix(prefix) {
+        auto const & obfuscateKey = this->it->GetObfuscateKey();
+        obfuscated = std::any_of(obfuscateKey.begin(), obfuscateKey.end(), [](unsigned char c) { return c != 0; });
+    }
     ~CStorageLevelDBIterator() override { }
     void Seek(const TBytes& key) override {
-        it->Seek(RawTBytes{(TBytes&) key}); // lower_bound in fact
+        it->Seek(CStorageLevelDBKey(prefix, key).Get()); // lower_bound in fact
     }
     void Next() override { it->Next(); }
     bool Valid() override {
-        return it->Valid();
+        if (!it->Valid()) {
+            return false;
+        }
+        if (prefix.empty()) {
+            return true;
+        }
+        auto const key = it->GetKeySpan();
+        return static_cast<size_t>(key.size()) >= prefix.size() && std::equal(prefix.begin(), prefix.end(), key.begin());
     }
-    TBytes Key() override {
-        TBytes result;
-        RawTBytes raw{result};
-        return (it->GetKey(raw)) ? result : TBytes{};
+    TSlice KeySlice() override {
+        return it->GetKeySpan().subspan(prefix.size());
     }
-    TBytes Value() override {
-        TBytes result;
-        RawTBytes raw{result};
-        return (it->GetValue(raw)) ? result : TBytes{};
+    TSlice ValueSlice() override {
+        auto const raw = it->GetRawValueSpan();
+        if (!obfuscated) {
+            return raw;
+        }
+        auto const & obfuscateKey = it->GetObfuscateKey();
+        value.assign(raw.begin(), raw.end());
+        for (size_t i = 0; i < value.size(); ++i) {
+            value[i] ^= obfuscateKey[i % obfuscateKey.size()];
+        }
+        return ToSlice(value);
     }
 private:
     std::unique_ptr<CDBIterator> it;
+    TBytes const prefix;
+    bool obfuscated;
+    TBytes value; // deobfuscated value, reused
     // No copying allowed
     CStorageLevelDBIterator(const CStorageLevelDBIterator&);
     void operator=(const CStorageLevelDBIterator&);
 };
 
+// LevelDB glue layer, read-only storage over the db's snapshot
+class CStorageLevelDBSnapshot : public CStorageKV {
+public:
+    explicit CStorageLevelDBSnapshot(CDBWrapper& db_, const TBytes& prefix_ = {}) : db(db_), prefix(prefix_), snapshot(db_.GetSnapshot()) {}
+    ~CStorageLevelDBSnapshot() override { }
+    bool Exists(const TBytes& key) const override {
+        return db.Exists(CStorageLevelDBKey(prefix, key).Get(), snapshot.get());
+    }
+    bool Write(const TBytes& key, const TBytes& value) override {
+        return false;
+    }
+    bool Erase(const TBytes& key) override {
+        return false;
+    }
+    bool Read(const TBytes& key, TBytes& value) const override {
+        auto rawVal = RawTBytes{(TBytes&)value};
+        return db.Read(CStorageLevelDBKey(prefix, key).Get(), rawVal, snapshot.get());
+    }
+    bool Flush() override {
+        return true;
+    }
+    std::unique_ptr<CStorageKVIterator> NewIterator() override {
+        return MakeUnique<CStorageLevelDBIterator>(std::unique_ptr<CDBIterator>(db.NewIterator(snapshot.get())), prefix);
+    }
+private:
+    CDBWrapper& db;
+    TBytes const prefix;
+    std::shared_ptr<const leveldb::Snapshot> snapshot;
+};
+
 // LevelDB glue layer storage
+// Either owns its db, or lives in the keyspace of another one under a key prefix. In the latter case the writes
+// are staged in the batch shared with the db's owner, which commits them atomically with its own writes (see
+// CCoinsViewDB::BatchWrite); Flush() commits them alone.
 class CStorageLevelDB : public CStorageKV {
 public:
     explicit CStorageLevelDB(const fs::path& dbName, std::size_t cacheSize, bool fMemory = false, bool fWipe = false, bool fDirectWrite = false)
-        : db{dbName, cacheSize, fMemory, fWipe}, directWrite(fDirectWrite) {}
+        : ownDb{MakeUnique<CDBWrapper>(dbName, cacheSize, fMemory, fWipe)}, db{*ownDb}, sharedBatch(nullptr), directWrite(fDirectWrite) {}
+    CStorageLevelDB(CDBWrapper& sharedDb, CDBBatch& sharedBatch_, unsigned char keyPrefix)
+        : db{sharedDb}, prefix{keyPrefix}, sharedBatch(&sharedBatch_), directWrite(false) {}
     ~CStorageLevelDB() override { }
     bool Exists(const TBytes& key) const override {
-        return db.Exists(RawTBytes{(TBytes&)key});
+        return db.Exists(CStorageLevelDBKey(prefix, key).Get());
     }
     bool Write(const TBytes& key, const TBytes& value) override {
         if (directWrite)
             return db.Write(RawTBytes{(TBytes&)key}, RawTBytes{(TBytes&)value}, true);
-        BatchWrite(RawTBytes{(TBytes&)key}, RawTBytes{(TBytes&)value});
+        Batch().Write(CStorageLevelDBKey(prefix, key).Get(), RawTBytes{(TBytes&)value});
         return true;
     }
     bool Erase(const TBytes& key) override {
         if (directWrite)
             return db.Erase(RawTBytes{(TBytes&)key}, true);
-        BatchErase(RawTBytes{(TBytes&)key});
+        Batch().Erase(CStorageLevelDBKey(prefix, key).Get());
         return true;
     }
     bool Read(const TBytes& key, TBytes& value) const override {
         auto rawVal = RawTBytes{(TBytes&)value};
-        return db.Read(RawTBytes{(TBytes&)key}, rawVal);
+        return db.Read(CStorageLevelDBKey(prefix, key).Get(), rawVal);
     }
     bool Flush() override { // Commit batch
         bool result = true;
-        if (batch) {
+        if (sharedBatch) {
+            if (sharedBatch->SizeEstimate() > 0) {
+                result = db.WriteBatch(*sharedBatch);
+                sharedBatch->Clear();
+            }
+        } else if (batch) {
             result = db.WriteBatch(*batch);
             batch.reset();
         }
         return result;
     }
     std::unique_ptr<CStorageKVIterator> NewIterator() override {
-        return MakeUnique<CStorageLevelDBIterator>(std::unique_ptr<CDBIterator>(db.NewIterator()));
+        return MakeUnique<CStorageLevelDBIterator>(std::unique_ptr<CDBIterator>(db.NewIterator()), prefix);
+    }
+    // approximate size on disk of the [begin, end) keys range
+    size_t EstimateSize(const TBytes& begin, const TBytes& end) const {
+        return db.EstimateSize(CStorageLevelDBKey(prefix, begin).Get(), CStorageLevelDBKey(prefix, end).Get());
+    }
+    void Compact(const TBytes& begin, const TBytes& end) {
+        db.CompactRange(CStorageLevelDBKey(prefix, begin).Get(), CStorageLevelDBKey(prefix, end).Get());
     }
+    // the current state of the db (pending batch excluded), unaffected by later writes
+    std::unique_ptr<CStorageKV> CreateSnapshot() {
+        return MakeUnique<CStorageLevelDBSnapshot>(db, prefix);
+    }
+    bool IsShared() const { return sharedBatch != nullptr; }
 private:
-    template <typename K, typename V>
-    void BatchWrite(const K& key, const V& value) {
-        if (!batch) {
-            batch.reset(new CDBBatch(db));
+    CDBBatch& Batch() {
+        if (sharedBatch) {
+            return *sharedBatch;
         }
-        batch->Write<K,V>(key, value);
-    }
-    template <typename K>
-    void BatchErase(const K& key) {
         if (!batch) {
             batch.reset(new CDBBatch(db));
         }
-        batch->Erase<K>(key);
+        return *batch;
     }
 
-    CDBWrapper db;
+    std::unique_ptr<CDBWrapper> ownDb;
+    CDBWrapper& db;
+    TBytes const prefix; // empty if the db is owned
     boost::scoped_ptr<CDBBatch> batch;
+    CDBBatch* sharedBatch;
     bool directWrite;
 };
 
 // Flashable storage
 
+// Bump allocator for the write buffer: keys, values and tree nodes of one buffer are
+// carved out of a few big chunks and released all at once on Clear()
+class CKVArena {
+public:
+    CKVArena() : used(0), allocated(0), chunkAllocs(0) {}
+    CKVArena(const CKVArena&) = delete;
+    void operator=(const CKVArena&) = delete;
+
+    void* Allocate(size_t size, size_t align) {
+        size_t offset = (used + align - 1) & ~(align - 1);
+        if (chunks.empty() || offset + size > chunks.back().size) {
+            NewChunk(size);
+            offset = 0; // operator new[] returns memory suitably aligned for any fundamental type
+        }
+        used = offset + size;
+        return chunks.back().data.get() + offset;
+    }
+    // keeps the last (the biggest) chunk for reuse
+    void Clear() {
+        if (chunks.size() > 1) {
+            chunks.erase(chunks.begin(), chunks.end() - 1);
+        }
+        allocated = chunks.empty() ? 0 : chunks.back().size;
+        used = 0;
+    }
+    size_t AllocatedBytes() const { return allocated; }
+    uint64_t ChunkAllocations() const { return chunkAllocs; }
+    size_t DynamicMemoryUsage() const { return allocated + chunks.capacity() * sizeof(Chunk); }
+
+private:
+    static const size_t MIN_CHUNK_SIZE = 4 * 1024;
+    static const size_t MAX_CHUNK_SIZE = 1024 * 1024;
+
+    struct Chunk {
+        std::unique_ptr<unsigned char[]> data;
+        size_t size;
+    };
+
+    void NewChunk(size_t atLeast) {
+        size_t size = chunks.empty() ? MIN_CHUNK_SIZE : std::min(chunks.back().size * 2, MAX_CHUNK_SIZE);
+        size = std::max(size, atLeast);
+        chunks.push_back(Chunk{std::unique_ptr<unsigned char[]>(new unsigned char[size]), size});
+        allocated += size;
+        ++chunkAllocs;
+    }
+
+    std::vector<Chunk> chunks;
+    size_t used;      // bytes used in the last chunk
+    size_t allocated; // total bytes held by chunks
+    uint64_t chunkAllocs;
+};
+
+// STL allocator over CKVArena. Deallocation is a no-op: the buffer never erases
+// single nodes, everything is dropped together with the arena
+template <typename T>
+class CKVArenaAllocator {
+public:
+    using value_type = T;
+
+    explicit CKVArenaAllocator(CKVArena& arena_) : arena(&arena_) {}
+    template <typename U>
+    CKVArenaAllocator(const CKVArenaAllocator<U>& other) : arena(other.arena) {}
+
+    T* allocate(std::size_t n) {
+        return static_cast<T*>(arena->Allocate(n * sizeof(T), alignof(T)));
+    }
+    void deallocate(T*, std::size_t) {}
+
+    template <typename U>
+    bool operator==(const CKVArenaAllocator<U>& other) const { return arena == other.arena; }
+    template <typename U>
+    bool operator!=(const CKVArenaAllocator<U>& other) const { return arena != other.arena; }
+
+    CKVArena* arena;
+};
+
+// Ordered write buffer of the flushable storage: pending writes and erasures (tombstones).
+// Replaces std::map<TBytes, boost::optional<TBytes>>: tree nodes, keys and values live in
+// the buffer's arena, and rewriting a value of the same (or smaller) size is done in place,
+// so the hot "read balance - write balance" path does no heap allocations at all.
+class CKVWriteBuffer {
+public:
+    class Value {
+    public:
+        bool IsErased() const { return erased; }
+        TSlice Bytes() const { return TSlice(data, size); }
+        TBytes ToBytes() const { return TBytes(data, data + size); }
+    private:
+        friend class CKVWriteBuffer;
+        unsigned char* data;
+        uint32_t size;
+        uint32_t capacity;
+        bool erased;
+    };
+
+private:
+    struct SliceLess {
+        bool operator()(const TSlice& a, const TSlice& b) const {
+            return CompareSlices(a, b) < 0;
+        }
+    };
+    using Map = std::map<TSlice, Value, SliceLess, CKVArenaAllocator<std::pair<const TSlice, Value>>>;
+
+public:
+    using const_iterator = Map::const_iterator;
+
+    CKVWriteBuffer() : map(SliceLess(), Map::allocator_type(arena)) {}
+    CKVWriteBuffer(const CKVWriteBuffer&) = delete;
+    void operator=(const CKVWriteBuffer&) = delete;
+
+    void Write(TSlice key, TSlice value) {
+        Value& val = Lookup(key);
+        if (val.capacity < value.size()) {
+            val.data = Store(value.data(), value.size());
+            val.capacity = value.size();
+        } else if (value.size() > 0) {
+            memcpy(val.data, value.data(), value.size());
+        }
+        val.size = value.size();
+        val.erased = false;
+    }
+    void Erase(TSlice key) {
+        Value& val = Lookup(key);
+        val.size = 0;
+        val.erased = true;
+    }
+    // nullptr if there is no pending change for the key
+    Value const * Find(TSlice key) const {
+        auto it = map.find(key);
+        return it != map.end() ? &it->second : nullptr;
+    }
+
+    const_iterator begin() const { return map.begin(); }
+    const_iterator end() const { return map.end(); }
+    const_iterator lower_bound(TSlice key) const { return map.lower_bound(key); }
+    bool empty() const { return map.empty(); }
+    size_t size() const { return map.size(); }
+
+    void Clear() {
+        map.clear();
+        arena.Clear();
+    }
+
+    CKVArena const & GetArena() const { return arena; }
+    // tree nodes, keys and values are all in the arena
+    size_t DynamicMemoryUsage() const { return arena.DynamicMemoryUsage(); }
+
+    // copy of another buffer's pending changes, in its own arena
+    void Assign(const CKVWriteBuffer& other) {
+        Clear();
+        Apply(other);
+    }
+    // another buffer's pending changes on top of these ones
+    void Apply(const CKVWriteBuffer& other) {
+        for (auto const & entry : other) {
+            if (entry.second.IsErased()) {
+                Erase(entry.first);
+            } else {
+                Write(entry.first, entry.second.Bytes());
+            }
+        }
+    }
+
+private:
+    Value& Lookup(TSlice key) {
+        auto it = map.lower_bound(key);
+        if (it == map.end() || SliceLess()(key, it->first)) {
+            TSlice stored(Store(key.data(), key.size()), key.size());
+            Value val;
+            val.data = nullptr;
+            val.size = val.capacity = 0;
+            val.erased = true;
+            it = map.emplace_hint(it, stored, val);
+        }
+        return it->second;
+    }
+    unsigned char* Store(const unsigned char* bytes, size_t size) {
+        if (size == 0)
+            return nullptr;
+        auto dst = static_cast<unsigned char*>(arena.Allocate(size, 1));
+        memcpy(dst, bytes, size);
+        return dst;
+    }
+
+    CKVArena arena; // should be destroyed after the map
+    Map map;
+};
+
 // Flushable Key-Value Storage Iterator
+// Merges the write buffer into the parent's iteration: buffered entries shadow the parent's ones, erasures hide them.
+// The current entry is served in place (buffer's arena or parent's buffers), so the parent is advanced lazily,
+// on the next move.
 class CFlushableStorageKVIterator : public CStorageKVIterator {
 public:
-    explicit CFlushableStorageKVIterator(std::unique_ptr<CStorageKVIterator>&& pIt_, MapKV& map_) : pIt{std::move(pIt_)}, map(map_) {
-        inited = parentOk = mapOk = false;
+    explicit CFlushableStorageKVIterator(std::unique_ptr<CStorageKVIterator>&& pIt_, CKVWriteBuffer const & map_) : pIt{std::move(pIt_)}, map(map_) {
+        inited = false;
+        current = Current::None;
     }
          // No copying allowed
     CFlushableStorageKVIterator(const CFlushableStorageKVIterator&) = delete;
     void operator=(const CFlushableStorageKVIterator&) = delete;
     ~CFlushableStorageKVIterator() override { }
     void Seek(const TBytes& key) override {
-        prevKey.clear();
         pIt->Seek(key);
-        parentOk = pIt->Valid();
-        mIt = map.lower_bound(key);
-        mapOk = mIt != map.end();
+        mIt = map.lower_bound(ToSlice(key));
         inited = true;
+        current = Current::None;
         Next();
     }
     void Next() override {
         if (!inited) throw std::runtime_error("Iterator wasn't inited.");
-        key.clear();
-        value.clear();
-
-        while (mapOk || parentOk) {
-            if (mapOk) {
-                while (mapOk && (!parentOk || mIt->first <= pIt->Key())) {
-                    bool ok = false;
-
-                    if (mIt->second) {
-                        ok = prevKey.empty() || mIt->first > prevKey;
-                    }
-                    else {
-                        prevKey = mIt->first;
-                    }
-                    if (ok) {
-                        key = mIt->first;
-                        value = *mIt->second;
-                        prevKey = key;
-                    }
-                    if (mapOk) {
-                        mIt++;
-                        mapOk = mIt != map.end();
-                    }
-                    if (ok) return;
-                }
+        if (current == Current::Parent) {
+            pIt->Next();
+        }
+        current = Current::None;
+
+        while (true) {
+            bool const mapOk = mIt != map.end();
+            bool const parentOk = pIt->Valid();
+            if (!mapOk && !parentOk) {
+                return;
             }
-            if (parentOk) {
-                bool ok = prevKey.empty() || pIt->Key() > prevKey;
-                if (ok) {
-                    key = pIt->Key();
-                    value = pIt->Value();
-                    prevKey = key;
-                }
-                if (parentOk) {
-                    pIt->Next();
-                    parentOk = pIt->Valid();
-                }
-                if (ok) return;
+            int const cmp = !mapOk ? 1 : !parentOk ? -1 : CompareSlices(mIt->first, pIt->KeySlice());
+            if (cmp > 0) {
+                current = Current::Parent;
+                return;
+            }
+            if (cmp == 0) {
+                pIt->Next(); // shadowed by the buffer
+            }
+            auto const entry = mIt++;
+            if (!entry->second.IsErased()) {
+                key = entry->first;
+                value = entry->second.Bytes();
+                current = Current::Map;
+                return;
             }
         }
     }
     bool Valid() override {
-        return !key.empty();
+        return current != Current::None;
     }
-    TBytes Key() override {
-        return key;
+    TSlice KeySlice() override {
+        return current == Current::Parent ? pIt->KeySlice() : key;
     }
-    TBytes Value() override {
-        return value;
+    TSlice ValueSlice() override {
+        return current == Current::Parent ? pIt->ValueSlice() : value;
     }
 private:
+    enum class Current { None, Map, Parent };
+
     bool inited;
     std::unique_ptr<CStorageKVIterator> pIt;
-    bool parentOk;
-    MapKV& map;
-    MapKV::iterator mIt;
-    bool mapOk;
-    TBytes key;
-    TBytes value;
-    TBytes prevKey;
+    CKVWriteBuffer const & map;
+    CKVWriteBuffer::const_iterator mIt;
+    Current current;
+    TSlice key;   // current buffered entry
+    TSlice value;
 };
 
 // Flushable Key-Value Storage
+// Pending changes may be partly frozen into shared read-only layers (see Freeze), the writes go to the top one.
 class CFlushableStorageKV : public CStorageKV {
 public:
-    explicit CFlushableStorageKV(CStorageKV& db_) : db(db_) {}
+    using TLayers = std::vector<std::shared_ptr<const CKVWriteBuffer>>;
+
+    explicit CFlushableStorageKV(CStorageKV& db_) : db(db_), changed(MakeUnique<CKVWriteBuffer>()) {}
+    // read-only layers (of another storage's Freeze) over 'db_'
+    CFlushableStorageKV(CStorageKV& db_, TLayers layers) : db(db_), frozen(std::move(layers)), changed(MakeUnique<CKVWriteBuffer>()) {}
     CFlushableStorageKV(const CFlushableStorageKV& db) = delete;
     ~CFlushableStorageKV() override {}
     bool Exists(const TBytes& key) const override {
-        auto it = changed.find(key);
-        if (it != changed.end()) {
-            return (bool) it->second;
+        auto val = FindPending(ToSlice(key));
+        if (val) {
+            return !val->IsErased();
         }
         return db.Exists(key);
     }
     bool Write(const TBytes& key, const TBytes& value) override {
-        changed[key] = {value};
+        if (cache)
+            cache->Invalidate(key);
+        changed->Write(ToSlice(key), ToSlice(value));
         return true;
     }
     bool Erase(const TBytes& key) override {
-        changed[key] = {};
+        if (cache)
+            cache->Invalidate(key);
+        changed->Erase(ToSlice(key));
         return true;
     }
     bool Read(const TBytes& key, TBytes& value) const override {
-        auto it = changed.find(key);
-        if (it == changed.end()) {
+        auto val = FindPending(ToSlice(key));
+        if (!val) {
             return db.Read(key, value);
         }
         else {
-            if (it->second) {
-                value = it->second.get();
+            if (!val->IsErased()) {
+                value.assign(val->Bytes().begin(), val->Bytes().end());
                 return true;
             }
             else {
@@ -287,30 +752,121 @@ public:
         }
     }
     bool Flush() override {
-        for (auto it = changed.begin(); it != changed.end(); it++) {
-            if (!it->second) {
-                if (!db.Erase(it->first))
-                    return false;
-            }
-            else {
-                if (!db.Write(it->first, it->second.get()))
-                    return false;
+        // reusable buffers, to not allocate per entry
+        TBytes key, value;
+        // oldest layer first, so the newer changes overwrite it
+        auto flushLayer = [&] (CKVWriteBuffer const & layer) {
+            for (auto it = layer.begin(); it != layer.end(); it++) {
+                key.assign(it->first.begin(), it->first.end());
+                if (it->second.IsErased()) {
+                    if (!db.Erase(key))
+                        return false;
+                }
+                else {
+                    value.assign(it->second.Bytes().begin(), it->second.Bytes().end());
+                    if (!db.Write(key, value))
+                        return false;
+                }
             }
+            return true;
+        };
+        for (auto const & layer : frozen) {
+            if (!flushLayer(*layer))
+                return false;
         }
-        changed.clear();
+        if (!flushLayer(*changed))
+            return false;
+        frozen.clear();
+        changed->Clear();
         return true;
     }
     std::unique_ptr<CStorageKVIterator> NewIterator() override {
-        return MakeUnique<CFlushableStorageKVIterator>(db.NewIterator(), changed);
+        auto it = db.NewIterator();
+        for (auto const & layer : frozen) {
+            it = MakeUnique<CFlushableStorageKVIterator>(std::move(it), *layer);
+        }
+        return MakeUnique<CFlushableStorageKVIterator>(std::move(it), *changed);
+    }
+
+    // Own cache covers everything this level sees (flush doesn't change it, so the cache survives).
+    // Without own cache, the parent's one is usable only for keys that aren't changed at this level.
+    CDecodedValueCache* GetReadCache(const TBytes& key) const override {
+        if (cache)
+            return cache.get();
+        if (FindPending(ToSlice(key)))
+            return nullptr;
+        return db.GetReadCache(key);
+    }
+
+    void EnableReadCache(size_t maxEntries) {
+        cache = MakeUnique<CDecodedValueCache>(maxEntries);
+    }
+    CDecodedValueCache const * GetOwnReadCache() const {
+        return cache.get();
+    }
+
+    // the pending changes which aren't frozen
+    CKVWriteBuffer const & GetRaw() const {
+        return *changed;
+    }
+
+    // Freezes the pending changes into a read-only layer and returns all of the layers, to be shared w/o copying
+    // (by a snapshot). Newer layers are merged into the older ones of similar size, so there are O(log) of them
+    // and an entry is copied O(log) times until the flush.
+    TLayers Freeze() {
+        if (!changed->empty()) {
+            frozen.push_back(std::move(changed));
+            changed = MakeUnique<CKVWriteBuffer>();
+        }
+        while (frozen.size() >= 2 && frozen[frozen.size() - 2]->size() <= 2 * frozen.back()->size()) {
+            auto merged = std::make_shared<CKVWriteBuffer>();
+            merged->Assign(*frozen[frozen.size() - 2]);
+            merged->Apply(*frozen.back());
+            frozen.pop_back();
+            frozen.back() = std::move(merged);
+        }
+        return frozen;
+    }
+    size_t FrozenLayers() const {
+        return frozen.size();
+    }
+
+    // number of the pending changes (a key changed in several layers is counted in each of them)
+    size_t PendingChanges() const {
+        size_t count = changed->size();
+        for (auto const & layer : frozen) {
+            count += layer->size();
+        }
+        return count;
     }
 
-    MapKV& GetRaw() {
-        return changed;
+    // memory held by the pending changes (the read cache is bounded by itself and survives the flush)
+    size_t DynamicMemoryUsage() const {
+        size_t usage = changed->DynamicMemoryUsage();
+        for (auto const & layer : frozen) {
+            usage += layer->DynamicMemoryUsage();
+        }
+        return usage;
     }
 
 private:
+    // nullptr if there is no pending change for the key, in any of the layers
+    CKVWriteBuffer::Value const * FindPending(TSlice key) const {
+        if (auto val = changed->Find(key)) {
+            return val;
+        }
+        for (auto it = frozen.rbegin(); it != frozen.rend(); ++it) {
+            if (auto val = (*it)->Find(key)) {
+                return val;
+            }
+        }
+        return nullptr;
+    }
+
     CStorageKV& db;
-    MapKV changed;
+    TLayers frozen; // oldest first
+    std::unique_ptr<CKVWriteBuffer> changed;
+    std::unique_ptr<CDecodedValueCache> cache;
 };
 
 class CStorageView {
@@ -373,22 +929,61 @@ public:
         return {};
     }
 
+    // Same as Read, but goes through the decoded values cache of the storage, if there is one
+    template<typename KeyType, typename ValueType>
+    bool ReadCached(const KeyType& key, ValueType& value) const {
+        auto vKey = DbTypeToBytes(key);
+        auto cache = DB().GetReadCache(vKey);
+        bool exists = false;
+        if (cache && cache->Get(vKey, value, exists)) {
+            return exists;
+        }
+        uint64_t const epoch = cache ? cache->Epoch() : 0;
+        TBytes vValue;
+        exists = DB().Read(vKey, vValue);
+        if (exists) {
+            BytesToDbType(vValue, value);
+        }
+        if (cache) {
+            cache->Put(vKey, epoch, exists ? &value : nullptr);
+        }
+        return exists;
+    }
+    template<typename By, typename KeyType, typename ValueType>
+    bool ReadCachedBy(const KeyType& key, ValueType& value) const {
+        return ReadCached(std::make_pair(By::prefix, key), value);
+    }
+    template<typename By, typename ResultType, typename KeyType>
+    boost::optional<ResultType> ReadCachedBy(KeyType const & id) const {
+        ResultType result;
+        if (ReadCachedBy<By>(id, result))
+            return {result};
+        return {};
+    }
+
     template<typename By, typename KeyType, typename ValueType>
     bool ForEach(std::function<bool(KeyType const &, ValueType &)> callback, KeyType const & start = KeyType()) const {
         auto& self = const_cast<CStorageView&>(*this);
 
         using pref_type = typename std::remove_const<decltype( By::prefix )>::type;
-        auto key = std::make_pair<pref_type, KeyType>(pref_type(By::prefix), KeyType(start));
-//            std::pair<char, KeyType> key; // failsafe
+        auto const prefix = DbTypeToBytes(pref_type(By::prefix));
 
+        // keys and values are decoded right from the iterator's buffers, and the range end is found
+        // on the raw bytes, so the first key of the next prefix isn't decoded at all
+        KeyType key(start); // may be a reference wrapper (VARINT), so it is copied, not default constructed
         auto it = self.DB().NewIterator();
-        for(it->Seek(DbTypeToBytes(key)); it->Valid() && (BytesToDbType(it->Key(), key), key.first == By::prefix); it->Next()) {
+        for(it->Seek(DbTypeToBytes(std::make_pair(pref_type(By::prefix), start))); it->Valid(); it->Next()) {
             boost::this_thread::interruption_point();
 
+            auto const rawKey = it->KeySlice();
+            if (!HasPrefix(rawKey, prefix))
+                break;
+
+            SliceToDbType(rawKey.subspan(prefix.size()), key);
             ValueType value;
-            BytesToDbType(it->Value(), value);
+            SliceToDbType(it->ValueSlice(), value);
 
-            if (!callback(key.second, value))
+            if (!callback(key, value))
                 break;
         }
         return true;
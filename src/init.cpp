@@ -25,6 +25,7 @@
 #include <interfaces/chain.h>
 #include <key.h>
 #include <key_io.h>
+#include <masternodes/anchor_queue.h>
 #include <masternodes/anchors.h>
 #include <masternodes/criminals.h>
 #include <miner.h>
@@ -268,16 +269,23 @@ void Shutdown(InitInterfaces& interfaces)
     spv::pspv.reset();
     {
         LOCK(cs_main);
-        if (g_chainstate && g_chainstate->CanFlushToDisk()) {
+        bool const fFlushed = g_chainstate && g_chainstate->CanFlushToDisk();
+        if (fFlushed) {
             g_chainstate->ForceFlushStateToDisk();
-            g_chainstate->ResetCoinsViews();
         }
+        g_anchorMessageQueue.Clear();
+        panchorjournal.reset();
         panchors.reset();
         panchorAwaitingConfirms.reset();
         panchorauths.reset();
+        ReleaseCustomCSSnapshot();
         pcustomcsview.reset();
-        pcustomcsDB.reset();
+        pcustomcsDB.reset(); // may live in the coins db
+        if (fFlushed) {
+            g_chainstate->ResetCoinsViews();
+        }
         pcriminals.reset();
+        pcriminalsDB.reset();
         pblocktree.reset();
     }
     for (const auto& client : interfaces.chain_clients) {
@@ -392,6 +400,10 @@ void SetupServerArgs()
     gArgs.AddArg("-datadir=<dir>", "Specify data directory", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-dbbatchsize", strprintf("Maximum database write batch size in bytes (default: %u)", nDefaultDbBatchSize), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-dbcache=<n>", strprintf("Maximum database cache size <n> MiB (%d to %d, default: %d). In addition, unused mempool memory is shared for this cache (see -maxmempool).", nMinDbCache, nMaxDbCache, nDefaultDbCache), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-enhancedcsdbcache=<n>", strprintf("Share of -dbcache for the masternodes, tokens and balances database, in percent (up to %d MiB, default: %d)", nMaxCustomCSDBCache, DEFAULT_CUSTOMCS_DB_CACHE_SHARE), ArgsManager::ALLOW_INT, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-criminalsdbcache=<n>", strprintf("Share of -dbcache for the criminals database, in percent (up to %d MiB, default: %d)", nMaxCriminalsDBCache, DEFAULT_CRIMINALS_DB_CACHE_SHARE), ArgsManager::ALLOW_INT, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-anchorsdbcache=<n>", strprintf("Share of -dbcache for the anchors database, in percent (up to %d MiB, default: %d)", nMaxAnchorsDBCache, DEFAULT_ANCHORS_DB_CACHE_SHARE), ArgsManager::ALLOW_INT, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-spvdbcache=<n>", strprintf("Share of -dbcache for the spv database, in percent (up to %d MiB, default: %d)", nMaxSpvDBCache, DEFAULT_SPV_DB_CACHE_SHARE), ArgsManager::ALLOW_INT, OptionsCategory::OPTIONS);
     gArgs.AddArg("-debuglogfile=<file>", strprintf("Specify location of debug log file. Relative paths will be prefixed by a net-specific datadir location. (-nodebuglogfile to disable; default: %s)", DEFAULT_DEBUGLOGFILE), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-feefilter", strprintf("Tell other nodes to filter invs to us by our mempool min fee (default: %u)", DEFAULT_FEEFILTER), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-includeconf=<file>", "Specify additional configuration file, relative to the -datadir path (only useable from configuration file, not command line)", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
@@ -451,10 +463,14 @@ void SetupServerArgs()
     gArgs.AddArg("-torcontrol=<ip>:<port>", strprintf("Tor control port to use if onion listening enabled (default: %s)", DEFAULT_TOR_CONTROL), ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
     gArgs.AddArg("-torpassword=<pass>", "Tor control port password (default: empty)", ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
     gArgs.AddArg("-masternode_owner=<address>", "Masternode owner address (default: empty)", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
-    gArgs.AddArg("-masternode_operator=<address>", "Masternode operator address (default: empty)", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-masternode_operator=<address>", "Masternode operator address, can be specified multiple times to stake with several masternodes (default: empty)", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-customundodepth=<n>", strprintf("Prune undo data of masternodes, tokens and accounts changes deeper than <n> blocks below the tip. Blocks below it can't be disconnected (default: %u = keep all, minimum: %u)", DEFAULT_CUSTOM_UNDO_DEPTH, MIN_BLOCKS_TO_KEEP), ArgsManager::ALLOW_INT, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-customcsinchainstate", strprintf("Keep the masternodes, tokens and balances in the chainstate database, committed in one batch with the coins, instead of the separate enhancedcs database. Switching moves them on the next start (default: %u)", DEFAULT_CUSTOMCS_IN_CHAINSTATE), ArgsManager::ALLOW_BOOL, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-customcsreadcache=<n>", strprintf("Number of decoded masternodes, tokens and balances to keep in memory, 0 to disable (default: %d)", DEFAULT_CUSTOMCS_READ_CACHE), ArgsManager::ALLOW_INT, OptionsCategory::OPTIONS);
     gArgs.AddArg("-dummypos", "Flag to skip PoS-related checks (regtest only)", ArgsManager::ALLOW_ANY, OptionsCategory::CHAINPARAMS);
     gArgs.AddArg("-txnotokens", "Flag to force old tx serialization (regtest only)", ArgsManager::ALLOW_ANY, OptionsCategory::CHAINPARAMS);
     gArgs.AddArg("-anchorquorum", "Min quorum size (regtest only)", ArgsManager::ALLOW_ANY, OptionsCategory::CHAINPARAMS);
+    gArgs.AddArg("-anchorjournal", strprintf("Keep the accepted anchor auths and confirms on disk between restarts (default: %u)", DEFAULT_ANCHOR_JOURNAL), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-anchorsbinding", "Strict binding of defi chain to btc anchors (default: true)", ArgsManager::ALLOW_ANY, OptionsCategory::CHAINPARAMS);
     gArgs.AddArg("-spv", "Enable SPV to bitcoin blockchain (default: 1)", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-fakespv", "Fake SPV for testing purposes (default: 0, regtest only)", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
@@ -1126,6 +1142,14 @@ bool AppInitParameterInteraction()
         fPruneMode = true;
     }
 
+    nCustomUndoDepth = gArgs.GetArg("-customundodepth", DEFAULT_CUSTOM_UNDO_DEPTH);
+    if (nCustomUndoDepth < 0) {
+        return InitError(_("Custom undo depth cannot be configured with a negative value.").translated);
+    }
+    if (nCustomUndoDepth > 0 && nCustomUndoDepth < (int) MIN_BLOCKS_TO_KEEP) {
+        return InitError(strprintf(_("Custom undo depth configured below the minimum of %d blocks.").translated, MIN_BLOCKS_TO_KEEP));
+    }
+
     nConnectTimeout = gArgs.GetArg("-timeout", DEFAULT_CONNECT_TIMEOUT);
     if (nConnectTimeout <= 0) {
         nConnectTimeout = DEFAULT_CONNECT_TIMEOUT;
@@ -1300,7 +1324,10 @@ bool AppInitMain(InitInterfaces& interfaces)
     if (nScriptCheckThreads) {
         for (int i=0; i<nScriptCheckThreads-1; i++)
             threadGroup.create_thread([i]() { return ThreadScriptCheck(i); });
+        for (int i=0; i<GetAuxCheckThreads()-1; i++)
+            threadGroup.create_thread([i]() { return ThreadAuxCheck(i); });
     }
+    threadGroup.create_thread([]() { TraceThread("anchormsg", []() { g_anchorMessageQueue.Thread(); }); });
 
     // Start the lightweight task scheduler thread
     CScheduler::Function serviceLoop = std::bind(&CScheduler::serviceQueue, &scheduler);
@@ -1480,9 +1507,27 @@ bool AppInitMain(InitInterfaces& interfaces)
         filter_index_cache = max_cache / n_indexes;
         nTotalCache -= filter_index_cache * n_indexes;
     }
+    // masternodes related dbs: a share of the same remainder each, capped, but not less than nMinDbCache
+    auto dbCacheShare = [nTotalCache](const std::string& arg, int64_t defaultShare, int64_t maxCache) {
+        int64_t const share = std::max<int64_t>(0, std::min<int64_t>(gArgs.GetArg(arg, defaultShare), 100));
+        return std::min(nTotalCache * share / 100, maxCache << 20);
+    };
+    bool const fCustomCSInChainstate = gArgs.GetBoolArg("-customcsinchainstate", DEFAULT_CUSTOMCS_IN_CHAINSTATE);
+    int64_t nCustomCSDBCache = dbCacheShare("-enhancedcsdbcache", DEFAULT_CUSTOMCS_DB_CACHE_SHARE, nMaxCustomCSDBCache);
+    int64_t nCriminalsDBCache = dbCacheShare("-criminalsdbcache", DEFAULT_CRIMINALS_DB_CACHE_SHARE, nMaxCriminalsDBCache);
+    int64_t nAnchorsDBCache = dbCacheShare("-anchorsdbcache", DEFAULT_ANCHORS_DB_CACHE_SHARE, nMaxAnchorsDBCache);
+    int64_t nSpvDBCache = gArgs.GetBoolArg("-spv", false) ? dbCacheShare("-spvdbcache", DEFAULT_SPV_DB_CACHE_SHARE, nMaxSpvDBCache) : 0;
+    nTotalCache -= nCustomCSDBCache + nCriminalsDBCache + nAnchorsDBCache + nSpvDBCache;
+    nCustomCSDBCache = std::max(nCustomCSDBCache, nMinDbCache << 20);
+    nCriminalsDBCache = std::max(nCriminalsDBCache, nMinDbCache << 20);
+    nAnchorsDBCache = std::max(nAnchorsDBCache, nMinDbCache << 20);
+    nSpvDBCache = std::max(nSpvDBCache, nMinDbCache << 20);
     int64_t nCoinDBCache = std::min(nTotalCache / 2, (nTotalCache / 4) + (1 << 23)); // use 25%-50% of the remainder for disk cache
     nCoinDBCache = std::min(nCoinDBCache, nMaxCoinsDBCache << 20); // cap total coins db cache
     nTotalCache -= nCoinDBCache;
+    if (fCustomCSInChainstate) {
+        nCoinDBCache += nCustomCSDBCache; // it's the same db
+    }
     nCoinCacheUsage = nTotalCache; // the rest goes to in-memory cache
     int64_t nMempoolSizeMax = gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
     LogPrintf("Cache configuration:\n");
@@ -1495,6 +1540,14 @@ bool AppInitMain(InitInterfaces& interfaces)
                   filter_index_cache * (1.0 / 1024 / 1024), BlockFilterTypeName(filter_type));
     }
     LogPrintf("* Using %.1f MiB for chain state database\n", nCoinDBCache * (1.0 / 1024 / 1024));
+    if (!fCustomCSInChainstate) {
+        LogPrintf("* Using %.1f MiB for enhanced chain state database\n", nCustomCSDBCache * (1.0 / 1024 / 1024));
+    }
+    LogPrintf("* Using %.1f MiB for criminals database\n", nCriminalsDBCache * (1.0 / 1024 / 1024));
+    LogPrintf("* Using %.1f MiB for anchors database\n", nAnchorsDBCache * (1.0 / 1024 / 1024));
+    if (gArgs.GetBoolArg("-spv", false)) {
+        LogPrintf("* Using %.1f MiB for spv database\n", nSpvDBCache * (1.0 / 1024 / 1024));
+    }
     LogPrintf("* Using %.1f MiB for in-memory UTXO set (plus up to %.1f MiB of unused mempool space)\n", nCoinCacheUsage * (1.0 / 1024 / 1024), nMempoolSizeMax * (1.0 / 1024 / 1024));
 
     bool fLoaded = false;
@@ -1563,6 +1616,11 @@ bool AppInitMain(InitInterfaces& interfaces)
                 // At this point we're either in reindex or we've loaded a useful
                 // block tree into BlockIndex()!
 
+                // the enhanced chainstate may live in the coins db, release it first
+                ReleaseCustomCSSnapshot();
+                pcustomcsview.reset();
+                pcustomcsDB.reset();
+
                 ::ChainstateActive().InitCoinsDB(
                     /* cache_size_bytes */ nCoinDBCache,
                     /* in_memory */ false,
@@ -1575,20 +1633,72 @@ bool AppInitMain(InitInterfaces& interfaces)
                 });
 
                 pcriminals.reset();
-                pcriminals = MakeUnique<CCriminalsView>(GetDataDir() / "criminals", nMinDbCache << 20, false, fReset || fReindexChainState);
+                pcriminalsDB.reset();
+                pcriminalsDB = MakeUnique<CStorageLevelDB>(GetDataDir() / "criminals", nCriminalsDBCache, false, fReset || fReindexChainState);
+                pcriminals = MakeUnique<CCriminalsView>(*pcriminalsDB.get());
+                if (!pcriminals->HasMintedHeadersHeightIndex()) {
+                    LogPrintf("Building minted headers heights index...\n");
+                    pcriminals->ReindexMintedHeadersHeights();
+                    if (!pcriminals->Flush() || !pcriminalsDB->Flush()) {
+                        strLoadError = _("Error building minted headers heights index").translated;
+                        break;
+                    }
+                }
 
-                pcustomcsDB.reset();
-                pcustomcsDB = MakeUnique<CStorageLevelDB>(GetDataDir() / "enhancedcs", nMinDbCache << 20, false, fReset || fReindexChainState);
-                pcustomcsview.reset();
+                {
+                    fs::path const separatePath = GetDataDir() / "enhancedcs";
+                    auto & coinsDB = ::ChainstateActive().CoinsDB();
+                    auto hosted = MakeUnique<CStorageLevelDB>(coinsDB.GetDB(), coinsDB.GetHostedBatch(), CCoinsViewDB::DB_CUSTOM_STATE);
+                    std::unique_ptr<CStorageLevelDB> separate;
+                    if (!fCustomCSInChainstate || fs::exists(separatePath)) {
+                        separate = MakeUnique<CStorageLevelDB>(separatePath, nCustomCSDBCache, false, fReset || fReindexChainState);
+                    }
+                    if (separate) {
+                        size_t const moved = fCustomCSInChainstate ? MoveCustomCSStorage(*separate, *hosted) : MoveCustomCSStorage(*hosted, *separate);
+                        if (moved > 0) {
+                            LogPrintf("Moved %d enhanced chainstate records %s the chainstate database\n", moved, fCustomCSInChainstate ? "into" : "out of");
+                        }
+                    }
+                    if (fCustomCSInChainstate) {
+                        separate.reset();
+                        fs::remove_all(separatePath);
+                    }
+                    pcustomcsDB = fCustomCSInChainstate ? std::move(hosted) : std::move(separate);
+                }
                 pcustomcsview = MakeUnique<CCustomCSView>(*pcustomcsDB.get());
+                pcustomcsview->EnableReadCache(std::max<int64_t>(0, gArgs.GetArg("-customcsreadcache", DEFAULT_CUSTOMCS_READ_CACHE)));
+                if (!pcustomcsview->HasTokenHoldersIndex()) {
+                    LogPrintf("Building token holders index...\n");
+                    pcustomcsview->ReindexTokenHolders(pcustomcsview->GetLastHeight());
+                    if (!pcustomcsview->Flush() || !pcustomcsDB->Flush()) {
+                        strLoadError = _("Error building token holders index").translated;
+                        break;
+                    }
+                }
+                if (!pcustomcsview->HasActiveMasternodesIndex()) {
+                    LogPrintf("Building active masternodes index...\n");
+                    pcustomcsview->ReindexActiveMasternodes(pcustomcsview->GetLastHeight());
+                    if (!pcustomcsview->Flush() || !pcustomcsDB->Flush()) {
+                        strLoadError = _("Error building active masternodes index").translated;
+                        break;
+                    }
+                }
+                if (size_t const fixed = pcriminals->ReconcilePunishedCriminals(*pcustomcsview)) {
+                    LogPrintf("Fixed %d punished criminals flags to match the chainstate\n", fixed);
+                    if (!pcriminals->Flush() || !pcriminalsDB->Flush()) {
+                        strLoadError = _("Error fixing punished criminals flags").translated;
+                        break;
+                    }
+                }
 
+                panchorjournal.reset();
                 panchorauths.reset();
                 panchorauths = MakeUnique<CAnchorAuthIndex>();
                 panchorAwaitingConfirms.reset();
                 panchorAwaitingConfirms = MakeUnique<CAnchorAwaitingConfirms>();
                 panchors.reset();
                 /// @todo research best way of spv+anchors loading/update/regeneration
-                panchors = MakeUnique<CAnchorIndex>(nMinDbCache << 20, false, gArgs.GetBoolArg("-spv", false) && gArgs.GetBoolArg("-spv_resync", false) /*fReset || fReindexChainState*/);
+                panchors = MakeUnique<CAnchorIndex>(nAnchorsDBCache, false, gArgs.GetBoolArg("-spv", false) && gArgs.GetBoolArg("-spv_resync", false) /*fReset || fReindexChainState*/);
                 // load anchors after spv due to spv (and spv height) not set before (no last height yet)
 
                 if (gArgs.GetBoolArg("-spv", false)) {
@@ -1596,11 +1706,20 @@ bool AppInitMain(InitInterfaces& interfaces)
                     if (gArgs.GetBoolArg("-fakespv", false) && Params().NetworkIDString() == "regtest") {
                         spv::pspv = MakeUnique<spv::CFakeSpvWrapper>();
                     } else {
-                        spv::pspv = MakeUnique<spv::CSpvWrapper>(!gArgs.GetBoolArg("-spv_testnet", false), nMinDbCache << 20, false, gArgs.GetBoolArg("-spv_resync", false));
+                        spv::pspv = MakeUnique<spv::CSpvWrapper>(!gArgs.GetBoolArg("-spv_testnet", false), nSpvDBCache, false, gArgs.GetBoolArg("-spv_resync", false));
                     }
                 }
                 panchors->Load();
 
+                if (gArgs.GetBoolArg("-anchorjournal", DEFAULT_ANCHOR_JOURNAL)) {
+                    auto journal = MakeUnique<CAnchorMessageJournal>(nMinDbCache << 20, false, fReset || fReindexChainState);
+                    if (!journal->Load(*panchorauths, *panchorAwaitingConfirms)) {
+                        strLoadError = _("Error loading anchor journal").translated;
+                        break;
+                    }
+                    panchorjournal = std::move(journal);
+                }
+
                 // If necessary, upgrade from older database format.
                 // This is a no-op if we cleared the coinsviewdb with -reindex or -reindex-chainstate
                 if (!::ChainstateActive().CoinsDB().Upgrade()) {
@@ -1897,8 +2016,8 @@ bool AppInitMain(InitInterfaces& interfaces)
     if(gArgs.GetBoolArg("-gen", DEFAULT_GENERATE)) {
         LOCK(cs_main);
 
-        auto myIDs = pcustomcsview->AmIOperator();
-        if (myIDs)
+        auto operators = pcustomcsview->GetOperatorsMulti();
+        if (!operators.empty())
         {
             pos::ThreadStaker::Args stakerParams{};
             {
@@ -1907,33 +2026,40 @@ bool AppInitMain(InitInterfaces& interfaces)
                     LogPrintf("Warning! wallets not found\n");
                     return true;
                 }
-                std::shared_ptr<CWallet> defaultWallet = wallets[0];
 
-                CKey minterKey;
-                bool found =false;
-                for (auto&& wallet : wallets) {
-                    if (wallet->GetKey(myIDs->first, minterKey)) {
-                        found = true;
-                        break;
-                    }
-                }
-                if (!found) {
-                    LogPrintf("Error: masternode operator private key not found\n");
-                    return false;
-                }
+                CTxDestination const mintToAddress = DecodeDestination(gArgs.GetArg("-rewardaddress", ""), Params());
 
-                CMasternode const node = *pcustomcsview->GetMasternode(myIDs->second);
-                CTxDestination destination = node.ownerType == 1 ? CTxDestination(PKHash(node.ownerAuthAddress)) : CTxDestination(WitnessV0KeyHash(node.ownerAuthAddress));
+                for (auto const & myIDs : operators) {
+                    CKey minterKey;
+                    bool found =false;
+                    for (auto&& wallet : wallets) {
+                        if (wallet->GetKey(myIDs.first, minterKey)) {
+                            found = true;
+                            break;
+                        }
+                    }
+                    if (!found) {
+                        LogPrintf("Warning: masternode operator private key not found for %s, skipping it\n", myIDs.second.ToString());
+                        continue;
+                    }
 
-                CTxDestination const mintToAddress = DecodeDestination(gArgs.GetArg("-rewardaddress", ""), Params());
-                if (IsValidDestination(mintToAddress))
-                    destination = mintToAddress;
+                    CMasternode const node = *pcustomcsview->GetMasternode(myIDs.second);
+                    CTxDestination destination = node.ownerType == 1 ? CTxDestination(PKHash(node.ownerAuthAddress)) : CTxDestination(WitnessV0KeyHash(node.ownerAuthAddress));
 
-                CScript coinbaseScript = GetScriptForDestination(destination);
+                    if (IsValidDestination(mintToAddress))
+                        destination = mintToAddress;
 
-                stakerParams.coinbaseScript = coinbaseScript;
-                stakerParams.minterKey = minterKey;
-                stakerParams.masternodeID = myIDs->second;
+                    pos::ThreadStaker::MasternodeArgs mnArgs;
+                    mnArgs.coinbaseScript = GetScriptForDestination(destination);
+                    mnArgs.minterKey = minterKey;
+                    mnArgs.masternodeID = myIDs.second;
+                    stakerParams.masternodes.push_back(mnArgs);
+                }
+                if (stakerParams.masternodes.empty()) {
+                    LogPrintf("Error: no masternode operator private keys found\n");
+                    return false;
+                }
+                LogPrintf("Staking with %u masternode(s)\n", stakerParams.masternodes.size());
             }
 
             // Mint proof-of-stake blocks in background
@@ -6,6 +6,10 @@
 
 /// @attention make sure that it does not overlap with those in masternodes.cpp/tokens.cpp/undos.cpp/accounts.cpp !!!
 const unsigned char CAccountsView::ByBalanceKey::prefix = 'a';
+const unsigned char CAccountsView::ByHolderKey ::prefix = 'b';
+const unsigned char CAccountsView::ByTokenSupply::prefix = 's';
+
+const unsigned char DB_TOKEN_HOLDERS_INDEX = 'I'; // single record, height the holders index was built at
 
 void CAccountsView::ForEachBalance(std::function<bool(CScript const & owner, CTokenAmount const & amount)> callback, BalanceKey start) const
 {
@@ -17,19 +21,102 @@ void CAccountsView::ForEachBalance(std::function<bool(CScript const & owner, CTo
 CTokenAmount CAccountsView::GetBalance(CScript const & owner, DCT_ID tokenID) const
 {
     CAmount val;
-    bool ok = ReadBy<ByBalanceKey>(BalanceKey{owner, tokenID}, val);
+    bool ok = ReadCachedBy<ByBalanceKey>(BalanceKey{owner, tokenID}, val);
     if (ok) {
         return CTokenAmount{tokenID, val};
     }
     return CTokenAmount{tokenID, 0};
 }
 
+void CAccountsView::ForEachTokenHolder(DCT_ID tokenID, std::function<bool(CScript const & owner, CAmount amount)> callback, CScript const & start) const
+{
+    ForEach<ByHolderKey, TokenHolderKey, CAmount>([&] (TokenHolderKey const & key, CAmount const & val) {
+        if (key.tokenID != tokenID) {
+            return false;
+        }
+        return callback(key.owner, val);
+    }, TokenHolderKey{tokenID, start});
+}
+
+CTokenSupply CAccountsView::GetTokenSupply(DCT_ID tokenID) const
+{
+    CTokenSupply result;
+    ReadCachedBy<ByTokenSupply>(tokenID, result);
+    return result;
+}
+
+bool CAccountsView::HasTokenHoldersIndex() const
+{
+    return Exists(DB_TOKEN_HOLDERS_INDEX);
+}
+
+int CAccountsView::GetTokenHoldersIndexHeight() const
+{
+    int result = 0;
+    Read(DB_TOKEN_HOLDERS_INDEX, result);
+    return result;
+}
+
+void CAccountsView::ReindexTokenHolders(int height)
+{
+    // drop the stale records first, the index may be rebuilt over the partially reverted one
+    std::vector<TokenHolderKey> holderKeys;
+    ForEach<ByHolderKey, TokenHolderKey, CAmount>([&holderKeys] (TokenHolderKey const & key, CAmount const &) {
+        holderKeys.push_back(key);
+        return true;
+    });
+    for (auto const & key : holderKeys) {
+        EraseBy<ByHolderKey>(key);
+    }
+    std::vector<DCT_ID> supplyKeys;
+    ForEach<ByTokenSupply, DCT_ID, CTokenSupply>([&supplyKeys] (DCT_ID const & key, CTokenSupply const &) {
+        supplyKeys.push_back(key);
+        return true;
+    });
+    for (auto const & key : supplyKeys) {
+        EraseBy<ByTokenSupply>(key);
+    }
+
+    std::map<DCT_ID, CTokenSupply> supplies;
+    ForEachBalance([&] (CScript const & owner, CTokenAmount const & balance) {
+        WriteBy<ByHolderKey>(TokenHolderKey{balance.nTokenId, owner}, balance.nValue);
+        auto & supply = supplies[balance.nTokenId];
+        supply.holders++;
+        supply.supply += balance.nValue;
+        return true;
+    }, BalanceKey{});
+    for (auto const & kv : supplies) {
+        WriteBy<ByTokenSupply>(kv.first, kv.second);
+    }
+    Write(DB_TOKEN_HOLDERS_INDEX, height);
+}
+
 Res CAccountsView::SetBalance(CScript const & owner, CTokenAmount amount)
 {
+    CAmount const before = GetBalance(owner, amount.nTokenId).nValue;
+    if (before == amount.nValue) {
+        return Res::Ok();
+    }
     if (amount.nValue != 0) {
         WriteBy<ByBalanceKey>(BalanceKey{owner, amount.nTokenId}, amount.nValue);
+        WriteBy<ByHolderKey>(TokenHolderKey{amount.nTokenId, owner}, amount.nValue);
     } else {
         EraseBy<ByBalanceKey>(BalanceKey{owner, amount.nTokenId});
+        EraseBy<ByHolderKey>(TokenHolderKey{amount.nTokenId, owner});
+    }
+
+    // the index records are written to the same view, so undo reverts them together with the balance
+    auto supply = GetTokenSupply(amount.nTokenId);
+    supply.supply += amount.nValue - before;
+    if (before == 0) {
+        supply.holders++;
+    } else if (amount.nValue == 0) {
+        supply.holders--;
+    }
+    if (supply.holders != 0) {
+        WriteBy<ByTokenSupply>(amount.nTokenId, supply);
+    } else {
+        EraseBy<ByTokenSupply>(amount.nTokenId);
     }
     return Res::Ok();
 }
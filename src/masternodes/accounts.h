@@ -11,12 +11,34 @@
 #include <amount.h>
 #include <script/script.h>
 
+struct CTokenSupply {
+    uint64_t holders = 0;   // accounts with non-zero balance of the token
+    CAmount supply = 0;     // sum of all accounts' balances of the token (UTXOs are not counted)
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(VARINT(holders));
+        READWRITE(supply);
+    }
+};
+
 class CAccountsView : public virtual CStorageView
 {
 public:
     void ForEachBalance(std::function<bool(CScript const & owner, CTokenAmount const & amount)> callback, BalanceKey start) const;
     CTokenAmount GetBalance(CScript const & owner, DCT_ID tokenID) const;
 
+    // holders index, maintained by SetBalance
+    void ForEachTokenHolder(DCT_ID tokenID, std::function<bool(CScript const & owner, CAmount amount)> callback, CScript const & start = {}) const;
+    CTokenSupply GetTokenSupply(DCT_ID tokenID) const;
+    bool HasTokenHoldersIndex() const;
+    // the undos of the blocks up to this height were written w/o the index records and don't revert them
+    int GetTokenHoldersIndexHeight() const;
+    // builds holders index and supplies from scratch, for the databases created before them
+    void ReindexTokenHolders(int height);
+
     Res SetBalance(CScript const & owner, CTokenAmount amount);
     Res AddBalance(CScript const & owner, CTokenAmount amount);
     Res AddBalances(CScript const & owner, CBalances const & balances);
@@ -25,6 +47,8 @@ public:
 
     // tags
     struct ByBalanceKey { static const unsigned char prefix; };
+    struct ByHolderKey { static const unsigned char prefix; };
+    struct ByTokenSupply { static const unsigned char prefix; };
 };
 
 #endif //DEFI_MASTERNODES_ACCOUNTS_H
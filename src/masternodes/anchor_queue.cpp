@@ -0,0 +1,179 @@
+// Copyright (c) 2020 The DeFi Blockchain Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <masternodes/anchor_queue.h>
+
+#include <logging.h>
+#include <net_processing.h>
+#include <util/system.h>
+#include <validation.h>
+
+#include <algorithm>
+#include <tuple>
+
+CAnchorMessageQueue g_anchorMessageQueue;
+
+// relays to all of the peers except of the sender (if it's still here)
+template <typename TRelay>
+static void RelayExceptSender(NodeId from, TRelay relay)
+{
+    if (!g_connman->ForNode(from, [&relay] (CNode* pfrom) { relay(pfrom); return true; })) {
+        relay(nullptr);
+    }
+}
+
+bool CAnchorMessageQueue::AddHash(uint256 const & hash)
+{
+    if (hashes.size() >= MAX_ANCHOR_MESSAGE_QUEUE_SIZE) {
+        LogPrint(BCLog::NET, "Anchor message queue is full, message %s dropped\n", hash.ToString());
+        return false;
+    }
+    return hashes.insert(hash).second;
+}
+
+bool CAnchorMessageQueue::AddAuth(CAnchorAuthMessage const & auth, NodeId from)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    if (!AddHash(auth.GetHash())) {
+        return false;
+    }
+    auths.push_back(PendingAuth{auth, from});
+    cond.notify_one();
+    return true;
+}
+
+bool CAnchorMessageQueue::AddConfirm(CAnchorConfirmMessage const & confirm, NodeId from)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    if (!AddHash(confirm.GetHash())) {
+        return false;
+    }
+    confirms.push_back(PendingConfirm{confirm, from});
+    cond.notify_one();
+    return true;
+}
+
+size_t CAnchorMessageQueue::ProcessPending()
+{
+    std::vector<PendingAuth> pendingAuths;
+    std::vector<PendingConfirm> pendingConfirms;
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        pendingAuths.swap(auths);
+        pendingConfirms.swap(confirms);
+        hashes.clear();
+    }
+    if (pendingAuths.empty() && pendingConfirms.empty()) {
+        return 0;
+    }
+
+    // 1. recover the signers (the expensive part) in parallel, w/o cs_main
+    {
+        std::vector<CAuxCheck> checks;
+        checks.reserve(pendingAuths.size() + pendingConfirms.size());
+        for (auto const & pending : pendingAuths) {
+            checks.emplace_back(CAnchorSignerCheck(pending.message));
+        }
+        for (auto const & pending : pendingConfirms) {
+            checks.emplace_back(CAnchorSignerCheck(pending.message));
+        }
+        RunAuxChecks(checks);
+    }
+
+    // 2. group auths by the validation context
+    std::stable_sort(pendingAuths.begin(), pendingAuths.end(), [] (PendingAuth const & a, PendingAuth const & b) {
+        return std::tie(a.message.height, a.message.previousAnchor) < std::tie(b.message.height, b.message.previousAnchor);
+    });
+
+    std::vector<std::pair<uint256, NodeId>> relayAuths, relayConfirms;
+    std::vector<NodeId> doubleSigners;
+    {
+        LOCK(cs_main);
+
+        for (auto it = pendingAuths.begin(); it != pendingAuths.end(); ) {
+            auto const groupEnd = std::find_if(it, pendingAuths.end(), [&it] (PendingAuth const & pending) {
+                return pending.message.height != it->message.height || pending.message.previousAnchor != it->message.previousAnchor;
+            });
+            CCustomCSView::CTeam team, nextTeam;
+            bool const contextOk = panchorauths->ValidateAuthContext(it->message.height, it->message.previousAnchor, team, nextTeam);
+
+            for (; it != groupEnd; ++it) {
+                auto const & auth = it->message;
+                if (panchorauths->GetAuth(auth.GetHash())) {
+                    continue;
+                }
+                if (panchorauths->GetVote(auth.GetSignHash(), auth.GetSigner())) {
+                    // disconnect immidiately! possible even ban here, but only if sender peer is an author itself
+                    doubleSigners.push_back(it->from);
+                    continue;
+                }
+
+                LogPrintf("Got anchor auth, hash %s, blockheight: %d\n", auth.GetHash().ToString(), auth.height);
+
+                // if valid, add and rebroadcast
+                if (contextOk && panchorauths->ValidateAuth(auth, team, nextTeam) && panchorauths->AddAuth(auth)) {
+                    relayAuths.emplace_back(auth.GetHash(), it->from);
+                }
+            }
+        }
+
+        for (auto const & pending : pendingConfirms) {
+            auto const & confirmMessage = pending.message;
+            if (!panchorAwaitingConfirms->GetConfirm(confirmMessage.GetHash())) {
+                LogPrintf("Got anchor confirm, hash %s, Anchor Message hash: %d\n", confirmMessage.GetHash().ToString(), confirmMessage.btcTxHash.ToString());
+                // if valid, AND UNIQUE AGAINST VOTER (this is encapsulated in the index itself) - add and rebroadcast
+                if (panchorAwaitingConfirms->Validate(confirmMessage) && panchorAwaitingConfirms->Add(confirmMessage)) {
+                    relayConfirms.emplace_back(confirmMessage.GetHash(), pending.from);
+                }
+            }
+        }
+    }
+
+    if (g_connman) {
+        for (auto const & from : doubleSigners) {
+            g_connman->ForNode(from, [] (CNode* pnode) {
+                pnode->fDisconnect = true;
+                return true;
+            });
+        }
+        for (auto const & relay : relayAuths) {
+            RelayExceptSender(relay.second, [&relay] (CNode* skipNode) {
+                RelayAnchorAuths({CInv(MSG_ANCHOR_AUTH, relay.first)}, *g_connman, skipNode);
+            });
+        }
+        for (auto const & relay : relayConfirms) {
+            RelayExceptSender(relay.second, [&relay] (CNode* skipNode) {
+                RelayAnchorConfirm(relay.first, *g_connman, skipNode);
+            });
+        }
+    }
+    return pendingAuths.size() + pendingConfirms.size();
+}
+
+void CAnchorMessageQueue::Thread()
+{
+    while (true) {
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            while (auths.empty() && confirms.empty()) {
+                cond.wait(lock); // interruption point
+            }
+        }
+        ProcessPending();
+    }
+}
+
+size_t CAnchorMessageQueue::Size() const
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    return auths.size() + confirms.size();
+}
+
+void CAnchorMessageQueue::Clear()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    auths.clear();
+    confirms.clear();
+    hashes.clear();
+}
@@ -0,0 +1,82 @@
+// Copyright (c) 2020 The DeFi Blockchain Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef DEFI_MASTERNODES_ANCHOR_QUEUE_H
+#define DEFI_MASTERNODES_ANCHOR_QUEUE_H
+
+#include <masternodes/anchors.h>
+#include <net.h>
+
+#include <set>
+#include <vector>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+/** Max number of anchor messages waiting for verification, the rest are dropped (they are relayed again by others) */
+static const size_t MAX_ANCHOR_MESSAGE_QUEUE_SIZE = 10000;
+
+/** Recovers (and caches) the signer of the anchor message, on the auxiliary check queue's workers */
+class CAnchorSignerCheck {
+public:
+    explicit CAnchorSignerCheck(CAnchorAuthMessage const & authIn) : auth(&authIn), confirm(nullptr) {}
+    explicit CAnchorSignerCheck(CAnchorConfirmMessage const & confirmIn) : auth(nullptr), confirm(&confirmIn) {}
+
+    bool operator()() {
+        if (auth) {
+            auth->GetSigner();
+        }
+        if (confirm) {
+            confirm->GetSigner();
+        }
+        return true;
+    }
+
+private:
+    CAnchorAuthMessage const * auth;
+    CAnchorConfirmMessage const * confirm;
+};
+
+/**
+ * Anchor auths and confirms received from the peers, waiting for verification.
+ * Messages are deduplicated by hash and verified in batches by the "anchormsg" thread: signers are recovered in
+ * parallel w/o cs_main, then auths are validated in groups by (height, previousAnchor), with the team context
+ * computed once per group. cs_main is held only for the validation and insertion into the indexes.
+ */
+class CAnchorMessageQueue
+{
+public:
+    // false if the message is queued already (or the queue is full)
+    bool AddAuth(CAnchorAuthMessage const & auth, NodeId from);
+    bool AddConfirm(CAnchorConfirmMessage const & confirm, NodeId from);
+
+    // verifies and applies all of the queued messages, returns their count
+    size_t ProcessPending();
+    // waits for the messages and processes them, until interrupted
+    void Thread();
+
+    size_t Size() const;
+    void Clear();
+
+private:
+    template <typename TMessage>
+    struct Pending {
+        TMessage message;
+        NodeId from;
+    };
+    using PendingAuth = Pending<CAnchorAuthMessage>;
+    using PendingConfirm = Pending<CAnchorConfirmMessage>;
+
+    bool AddHash(uint256 const & hash);
+
+    mutable boost::mutex mutex;
+    boost::condition_variable cond;
+    std::vector<PendingAuth> auths;
+    std::vector<PendingConfirm> confirms;
+    std::set<uint256> hashes;
+};
+
+extern CAnchorMessageQueue g_anchorMessageQueue;
+
+#endif // DEFI_MASTERNODES_ANCHOR_QUEUE_H
@@ -16,24 +16,94 @@
 #include <validation.h>
 
 #include <algorithm>
-
+#include <deque>
+#include <map>
 #include <tuple>
 
 std::unique_ptr<CAnchorAuthIndex> panchorauths;
 std::unique_ptr<CAnchorIndex> panchors;
 std::unique_ptr<CAnchorAwaitingConfirms> panchorAwaitingConfirms;
+std::unique_ptr<CAnchorMessageJournal> panchorjournal;
+
+namespace {
+
+// Bounded (FIFO) cache of the recovered signers, keyed by hash of the sign hash and the signature.
+// Failed recoveries are cached too, so the bad sigs repeated by peers don't cost a recovery each.
+class CAnchorSignerCache
+{
+public:
+    bool Get(uint256 const & key, CKeyID & signer) const
+    {
+        LOCK(cs);
+        auto it = signers.find(key);
+        if (it == signers.end()) {
+            return false;
+        }
+        signer = it->second;
+        return true;
+    }
+
+    void Set(uint256 const & key, CKeyID const & signer)
+    {
+        LOCK(cs);
+        if (!signers.emplace(key, signer).second) {
+            return;
+        }
+        order.push_back(key);
+        if (order.size() > ANCHOR_SIGNER_CACHE_SIZE) {
+            signers.erase(order.front());
+            order.pop_front();
+        }
+    }
+
+private:
+    mutable CCriticalSection cs;
+    std::map<uint256, CKeyID> signers GUARDED_BY(cs);
+    std::deque<uint256> order GUARDED_BY(cs); // insertion order, for eviction
+};
+
+CAnchorSignerCache signerCache;
+
+}
+
+CKeyID RecoverAnchorSigner(uint256 const & sigHash, std::vector<unsigned char> const & sig)
+{
+    if (sig.empty()) {
+        return {};
+    }
+    uint256 const key = Hash(sigHash.begin(), sigHash.end(), sig.begin(), sig.end());
+    CKeyID signer;
+    if (!signerCache.Get(key, signer)) {
+        CPubKey pubKey;
+        if (pubKey.RecoverCompact(sigHash, sig)) {
+            signer = pubKey.GetID();
+        }
+        signerCache.Set(key, signer);
+    }
+    return signer;
+}
 
 template <typename TContainer>
 bool CheckSigs(uint256 const & sigHash, TContainer const & sigs, std::set<CKeyID> const & keys)
 {
     for (auto const & sig : sigs) {
-        CPubKey pubkey;
-        if (!pubkey.RecoverCompact(sigHash, sig) || keys.find(pubkey.GetID()) == keys.end())
+        CKeyID const signer = RecoverAnchorSigner(sigHash, sig);
+        if (signer.IsNull() || keys.find(signer) == keys.end())
             return false;
     }
     return true;
 }
 
+// shared by both of the messages
+static CKeyID GetCachedSigner(CAnchorMessageCache & cache, uint256 const & signHash, std::vector<unsigned char> const & signature)
+{
+    if (!cache.signer || cache.signerSig != signature) {
+        cache.signer = RecoverAnchorSigner(signHash, signature);
+        cache.signerSig = signature;
+    }
+    return *cache.signer;
+}
+
 CAnchorAuthMessage::CAnchorAuthMessage(uint256 const & previousAnchor, int height, uint256 const & hash, CTeam const & nextTeam)
     : previousAnchor(previousAnchor)
     , height(height)
@@ -57,6 +127,7 @@ uint256 CAnchorAuthMessage::GetHash() const
 
 bool CAnchorAuthMessage::SignWithKey(const CKey& key)
 {
+    cache.Clear();
     if (!key.SignCompact(GetSignHash(), signature)) {
         signature.clear();
     }
@@ -70,15 +141,17 @@ bool CAnchorAuthMessage::GetPubKey(CPubKey& pubKey) const
 
 CKeyID CAnchorAuthMessage::GetSigner() const
 {
-    CPubKey pubKey;
-    return (!signature.empty() && pubKey.RecoverCompact(GetSignHash(), signature)) ? pubKey.GetID() : CKeyID{};
+    return GetCachedSigner(cache, GetSignHash(), signature);
 }
 
 uint256 CAnchorAuthMessage::GetSignHash() const
 {
-    CDataStream ss{SER_GETHASH, PROTOCOL_VERSION};
-    ss << previousAnchor << height << blockHash << nextTeam; // << salt_;
-    return Hash(ss.begin(), ss.end());
+    if (!cache.signHash) {
+        CDataStream ss{SER_GETHASH, PROTOCOL_VERSION};
+        ss << previousAnchor << height << blockHash << nextTeam; // << salt_;
+        cache.signHash = Hash(ss.begin(), ss.end());
+    }
+    return *cache.signHash;
 }
 
 CAnchor CAnchor::Create(const std::vector<CAnchorAuthMessage> & auths, CTxDestination const & rewardDest)
@@ -130,44 +203,58 @@ bool CAnchorAuthIndex::ValidateAuth(const CAnchorAuthIndex::Auth & auth) const
 {
     AssertLockHeld(cs_main);
 
+    CTeam team, nextTeam;
+    return ValidateAuthContext(auth.height, auth.previousAnchor, team, nextTeam) && ValidateAuth(auth, team, nextTeam);
+}
+
+bool CAnchorAuthIndex::ValidateAuthContext(THeight height, uint256 const & previousAnchor, CTeam & team, CTeam & nextTeam) const
+{
+    AssertLockHeld(cs_main);
+
     // 1. common (prev and top checks)
-    if (!auth.previousAnchor.IsNull()) {
-        auto prev = panchors->GetAnchorByTx(auth.previousAnchor);
+    if (!previousAnchor.IsNull()) {
+        auto prev = panchors->GetAnchorByTx(previousAnchor);
         if (!prev) {
-            return error("%s: Got anchor auth, hash %s, blockheight: %d, but can't find previousAnchor %s", __func__, auth.GetHash().ToString(), auth.height, auth.previousAnchor.ToString());
+            return error("%s: Got anchor auth, blockheight: %d, but can't find previousAnchor %s", __func__, height, previousAnchor.ToString());
         }
-        if (auth.height <= prev->anchor.height) {
-            return error("%s: Auth blockHeight should be higher than previousAnchor height! %d > %d !", __func__, auth.height, prev->anchor.height);
+        if (height <= prev->anchor.height) {
+            return error("%s: Auth blockHeight should be higher than previousAnchor height! %d > %d !", __func__, height, prev->anchor.height);
         }
     }
     auto const * topAnchor = panchors->GetActiveAnchor();
-    if (topAnchor && auth.height <= topAnchor->anchor.height) {
-        return error("%s: Auth blockHeight should be higher than top anchor height! %d > %d !", __func__, auth.height, topAnchor->anchor.height);
+    if (topAnchor && height <= topAnchor->anchor.height) {
+        return error("%s: Auth blockHeight should be higher than top anchor height! %d > %d !", __func__, height, topAnchor->anchor.height);
     }
 
     // 2. chain context:
     // we not check that blockHash is in active chain due to they wouldn't be signed with current team
 
-    // 3. team context and signs:
-    CTeam const team = panchors->GetNextTeam(auth.previousAnchor);
+    // 3. team context:
+    team = panchors->GetNextTeam(previousAnchor);
     if (team.empty()) {
-        return error("%s: Can't get team for previousAnchor tx %s !", __func__, auth.previousAnchor.ToString());
+        return error("%s: Can't get team for previousAnchor tx %s !", __func__, previousAnchor.ToString());
     }
 
-    CBlockIndex* block = ::ChainActive()[auth.height];
+    CBlockIndex* block = ::ChainActive()[height];
     if (block == nullptr) {
-        return error("%s: Can't get block from height: %d !", __func__, auth.height);
+        return error("%s: Can't get block from height: %d !", __func__, height);
     }
+    nextTeam = pcustomcsview->CalcNextTeam(block->stakeModifier);
+    return true;
+}
 
-    if (auth.nextTeam != pcustomcsview->CalcNextTeam(block->stakeModifier)) {
+bool CAnchorAuthIndex::ValidateAuth(const CAnchorAuthIndex::Auth & auth, CTeam const & team, CTeam const & nextTeam) const
+{
+    AssertLockHeld(cs_main);
+
+    if (auth.nextTeam != nextTeam) {
         return error("%s: Wrong nextTeam for auth %s!!!", __func__, auth.GetHash().ToString());
     }
 
-    CPubKey pubKey;
-    if (!auth.GetPubKey(pubKey)) {
+    const CKeyID masternodeKey{auth.GetSigner()};
+    if (masternodeKey.IsNull()) {
         return error("%s: Can't recover pubkey from sig, auth: ", __func__, auth.GetHash().ToString());
     }
-    const CKeyID masternodeKey{pubKey.GetID()};
     if (team.find(masternodeKey) == team.end()) {
         return error("%s: Recovered keyID %s is not a current team member!", __func__, masternodeKey.ToString());
     }
@@ -178,7 +265,14 @@ bool CAnchorAuthIndex::ValidateAuth(const CAnchorAuthIndex::Auth & auth) const
 bool CAnchorAuthIndex::AddAuth(const CAnchorAuthIndex::Auth & auth)
 {
     AssertLockHeld(cs_main);
-    return auths.insert(auth).second;
+    if (!auths.insert(auth).second) {
+        return false;
+    }
+    summaries.erase(auth.height);
+    if (panchorjournal) {
+        panchorjournal->WriteAuth(auth);
+    }
+    return true;
 }
 
 uint32_t GetMinAnchorQuorum(CCustomCSView::CTeam const & team)
@@ -248,6 +342,65 @@ void CAnchorAuthIndex::ForEachAnchorAuthByHeight(std::function<bool (const CAnch
         if (!callback(*it)) break;
 }
 
+CAnchorAuthIndex::HeightSummary const & CAnchorAuthIndex::GetHeightSummary(THeight height) const
+{
+    AssertLockHeld(cs_main);
+    CBlockIndex const * pindex = ::ChainActive()[height];
+    uint256 const activeHash = pindex ? pindex->GetBlockHash() : uint256{};
+
+    auto it = summaries.find(height);
+    if (it != summaries.end() && it->second.blockHash == activeHash) {
+        return it->second;
+    }
+
+    HeightSummary summary;
+    summary.blockHash = activeHash;
+    if (pindex) {
+        // KList is sorted by defi height + signHash, so the votes for the same sign hash go in a row
+        typedef Auths::index<Auth::ByKey>::type KList;
+        KList const & list = auths.get<Auth::ByKey>();
+        uint256 curSignHash;
+        uint32_t votes = 0;
+        for (auto range = list.equal_range(std::make_tuple(height)); range.first != range.second; ++range.first) {
+            if (range.first->blockHash != activeHash) {
+                continue;
+            }
+            summary.msgHashes.push_back(range.first->GetHash());
+            if (votes == 0 || curSignHash != range.first->GetSignHash()) {
+                curSignHash = range.first->GetSignHash();
+                votes = 0;
+            }
+            summary.maxVotes = std::max(summary.maxVotes, ++votes);
+        }
+    }
+    return summaries[height] = std::move(summary);
+}
+
+std::vector<uint256> CAnchorAuthIndex::GetActiveAuths(THeight low, THeight high, uint32_t quorum) const
+{
+    AssertLockHeld(cs_main);
+    std::vector<uint256> result;
+    if (low > high) {
+        return result;
+    }
+
+    typedef Auths::index<Auth::ByKey>::type KList;
+    KList const & list = auths.get<Auth::ByKey>();
+    auto const begin = list.lower_bound(std::make_tuple(low));
+    auto it = list.upper_bound(std::make_tuple(high));
+    // jumps over the heights w/o auths, each height is summarized only once
+    while (it != begin) {
+        THeight const height = std::prev(it)->height;
+        auto const & summary = GetHeightSummary(height);
+        result.insert(result.end(), summary.msgHashes.begin(), summary.msgHashes.end());
+        if (summary.maxVotes >= quorum) {
+            break; // the freshest consensus, no need to walk deeper
+        }
+        it = list.lower_bound(std::make_tuple(height));
+    }
+    return result;
+}
+
 void CAnchorAuthIndex::PruneOlderThan(THeight height)
 {
     AssertLockHeld(cs_main);
@@ -257,9 +410,15 @@ void CAnchorAuthIndex::PruneOlderThan(THeight height)
 
     auto it = list.upper_bound(std::make_tuple(height, uint256{}));
     list.erase(list.begin(), it);
+    summaries.erase(summaries.begin(), summaries.lower_bound(height));
+    if (panchorjournal) {
+        panchorjournal->PruneAuths(height);
+    }
 }
 
 static const char DB_ANCHORS = 'A';
+// anchors with less confirmations are neither rewarded nor pruned from the auths
+static const int ANCHOR_REWARD_CONFIRMATIONS = 6;
 
 CAnchorIndex::CAnchorIndex(size_t nCacheSize, bool fMemory, bool fWipe)
     : db(new CDBWrapper(GetDataDir() / "anchors", nCacheSize, fMemory, fWipe))
@@ -271,6 +430,8 @@ bool CAnchorIndex::Load()
     AssertLockHeld(cs_main);
 
     AnchorIndexImpl().swap(anchors);
+    top = nullptr;
+    ResetUnrewarded();
 
     std::function<void (uint256 const &, AnchorRec &)> onLoad = [this] (uint256 const &, AnchorRec & rec) {
         // just for debug
@@ -284,6 +445,7 @@ bool CAnchorIndex::Load()
         // (in the 'Load' it is safe to call spv under lock cause it is not connected yet)
         spvLastHeight = spv::pspv ? spv::pspv->GetLastBlockHeight() : 0;
         ActivateBestAnchor(true);
+        UpdateUnrewarded();
     }
     return result;
 }
@@ -344,9 +506,12 @@ bool CAnchorIndex::DeleteAnchorByBtcTx(const uint256 & btcTxHash)
                 break;
             }
         }
+        // the deleted one may be anywhere in the unrewarded chain, rebuild it
+        ResetUnrewarded();
         anchors.get<AnchorRec::ByBtcTxHash>().erase(btcTxHash);
         if (DbExists(btcTxHash))
             DbErase(btcTxHash);
+        UpdateUnrewarded();
         return true;
     }
     return false;
@@ -392,26 +557,71 @@ CAnchorIndex::AnchorRec const * CAnchorIndex::GetAnchorByBtcTx(uint256 const & t
 CAnchorIndex::UnrewardedResult CAnchorIndex::GetUnrewarded() const
 {
     AssertLockHeld(cs_main);
+    return unrewarded;
+}
+
+void CAnchorIndex::OnRewardConnected(uint256 const & btcTxHash)
+{
+    AssertLockHeld(cs_main);
+    unrewarded.erase(btcTxHash);
+}
+
+void CAnchorIndex::OnRewardDisconnected(uint256 const & btcTxHash)
+{
+    AssertLockHeld(cs_main);
+
+    auto const rec = GetAnchorByBtcTx(btcTxHash);
+    if (!rec) {
+        return;
+    }
+    // only if it's still on the confirmed part of the active chain
+    for (auto it = confirmedTop; it && it->btcHeight >= rec->btcHeight; it = GetAnchorByBtcTx(it->anchor.previousAnchor)) {
+        if (it == rec) {
+            unrewarded.insert(btcTxHash);
+            break;
+        }
+    }
+}
 
-    auto it = panchors->GetActiveAnchor();
+void CAnchorIndex::ResetUnrewarded()
+{
+    unrewarded.clear();
+    confirmedTop = nullptr;
+}
+
+/// Moves 'confirmedTop' to the highest confirmed anchor of the active chain. Only the newly confirmed anchors are
+/// checked for rewards if the chain was extended, the whole chain is rescanned on rollback or switching the chain.
+void CAnchorIndex::UpdateUnrewarded()
+{
+    AssertLockHeld(cs_main);
+
+    auto newTop = top;
     // skip unconfirmed
-    for (; it && GetAnchorConfirmations(it) < 6; it = panchors->GetAnchorByBtcTx(it->anchor.previousAnchor))
+    for (; newTop && GetAnchorConfirmations(newTop) < ANCHOR_REWARD_CONFIRMATIONS; newTop = GetAnchorByBtcTx(newTop->anchor.previousAnchor))
         ;
-    // create confirmed set
-    UnrewardedResult confirmed;
-    for (; it ; it = panchors->GetAnchorByBtcTx(it->anchor.previousAnchor)) {
-        confirmed.insert(it->txHash);
+    if (newTop == confirmedTop) {
+        return;
     }
 
-    // find unrewarded
-    for (auto && it = confirmed.begin(); it != confirmed.end(); /* no advance */) {
-        if (pcustomcsview->GetRewardForAnchor(*it))
-            it = confirmed.erase(it);
-        else
-            it++;
+    std::vector<AnchorRec const *> confirmed;
+    auto it = newTop;
+    for (; it && it != confirmedTop && (!confirmedTop || it->btcHeight >= confirmedTop->btcHeight); it = GetAnchorByBtcTx(it->anchor.previousAnchor)) {
+        confirmed.push_back(it);
     }
-
-    return confirmed;
+    if (it != confirmedTop) {
+        // not an extension of the previous chain
+        unrewarded.clear();
+        confirmed.clear();
+        for (it = newTop; it; it = GetAnchorByBtcTx(it->anchor.previousAnchor)) {
+            confirmed.push_back(it);
+        }
+    }
+    for (auto const & rec : confirmed) {
+        if (!pcustomcsview->GetRewardForAnchor(rec->txHash)) {
+            unrewarded.insert(rec->txHash);
+        }
+    }
+    confirmedTop = newTop;
 }
 
 int CAnchorIndex::GetAnchorConfirmations(uint256 const & txHash) const
@@ -442,16 +652,13 @@ void CAnchorIndex::CheckActiveAnchor(bool forced)
         LOCK(cs_main);
         spvLastHeight = tmp;
         topChanged = panchors->ActivateBestAnchor(forced);
+        UpdateUnrewarded();
 
         // prune auths older than anchor with 6 confirmations. Warning! This constant are using for start confirming reward too!
-        auto it = panchors->GetActiveAnchor();
-        for (; it && GetAnchorConfirmations(it) < 6; it = panchors->GetAnchorByBtcTx(it->anchor.previousAnchor))
-            ;
-        if (it)
-            panchorauths->PruneOlderThan(it->anchor.height+1);
+        if (confirmedTop)
+            panchorauths->PruneOlderThan(confirmedTop->anchor.height+1);
 
         /// @todo panchorAwaitingConfirms - optimize?
-        /// @attention - 'it' depends on previous loop conditions (>=6).
         if (!::ChainstateActive().IsInitialBlockDownload()) {
 //            for (; it; it = panchors->GetAnchorByBtcTx(it->anchor.previousAnchor)) {
 //                if (penhancedview->GetRewardForAnchor(it->txHash) == uint256{}) {
@@ -473,6 +680,7 @@ void CAnchorIndex::UpdateLastHeight(uint32_t height)
 {
     AssertLockHeld(cs_main);
     spvLastHeight = height;
+    UpdateUnrewarded();
 }
 
 // selects "best" of two anchors at the equal btc height (prevs must be checked before)
@@ -547,6 +755,7 @@ bool CAnchorIndex::ActivateBestAnchor(bool forced)
         }
         it = it1;
     }
+    UpdateUnrewarded();
     return top != oldTop;
 }
 
@@ -633,9 +842,12 @@ CAnchorConfirmMessage CAnchorConfirmMessage::Create(CAnchor const & anchor, THei
 
 uint256 CAnchorConfirmMessage::GetSignHash() const
 {
-    CDataStream ss{SER_GETHASH, 0};
-    ss << btcTxHash << anchorHeight << prevAnchorHeight << rewardKeyID << rewardKeyType;
-    return Hash(ss.begin(), ss.end());
+    if (!cache.signHash) {
+        CDataStream ss{SER_GETHASH, 0};
+        ss << btcTxHash << anchorHeight << prevAnchorHeight << rewardKeyID << rewardKeyType;
+        cache.signHash = Hash(ss.begin(), ss.end());
+    }
+    return *cache.signHash;
 }
 
 bool CAnchorConfirmMessage::CheckConfirmSigs(std::vector<Signature> const & sigs, CCustomCSView::CTeam team)
@@ -661,8 +873,7 @@ uint256 CAnchorConfirmMessage::GetHash() const
 
 CKeyID CAnchorConfirmMessage::GetSigner() const
 {
-    CPubKey pubKey;
-    return (!signature.empty() && pubKey.RecoverCompact(GetSignHash(), signature)) ? pubKey.GetID() : CKeyID{};
+    return GetCachedSigner(cache, GetSignHash(), signature);
 }
 
 bool CAnchorAwaitingConfirms::EraseAnchor(AnchorTxHash const &txHash)
@@ -671,6 +882,9 @@ bool CAnchorAwaitingConfirms::EraseAnchor(AnchorTxHash const &txHash)
 
     auto & list = confirms.get<Confirm::ByAnchor>();
     auto count = list.erase(txHash); // should erase ALL with that key. Check it!
+    if (panchorjournal && count > 0) {
+        panchorjournal->EraseConfirms(txHash);
+    }
     LogPrintf("AnchorConfirms::EraseAnchor: erase %d confirms for anchor %s\n", count, txHash.ToString());
 
     return count > 0;
@@ -704,13 +918,22 @@ bool CAnchorAwaitingConfirms::Validate(CAnchorConfirmMessage const &confirmMessa
 bool CAnchorAwaitingConfirms::Add(CAnchorConfirmMessage const &newConfirmMessage)
 {
     AssertLockHeld(cs_main);
-    return confirms.insert(newConfirmMessage).second;
+    if (!confirms.insert(newConfirmMessage).second) {
+        return false;
+    }
+    if (panchorjournal) {
+        panchorjournal->WriteConfirm(newConfirmMessage);
+    }
+    return true;
 }
 
 void CAnchorAwaitingConfirms::Clear()
 {
     AssertLockHeld(cs_main);
     Confirms().swap(confirms);
+    if (panchorjournal) {
+        panchorjournal->ClearConfirms();
+    }
 }
 
 void CAnchorAwaitingConfirms::ReVote()
@@ -771,3 +994,114 @@ void CAnchorAwaitingConfirms::ForEachConfirm(std::function<void (const CAnchorAw
     for (auto it = list.begin(); it != list.end(); ++it)
         callback(*it);
 }
+
+static const char DB_JOURNAL_AUTHS = 'a';
+static const char DB_JOURNAL_CONFIRMS = 'c';
+static const char DB_JOURNAL_PRUNED_HEIGHT = 'p'; // single record, no auths below it
+
+CAnchorMessageJournal::CAnchorMessageJournal(size_t nCacheSize, bool fMemory, bool fWipe)
+    : db(GetDataDir() / "anchorjournal", nCacheSize, fMemory, fWipe)
+{
+    db.Read(DB_JOURNAL_PRUNED_HEIGHT, prunedHeight);
+}
+
+void CAnchorMessageJournal::WriteAuth(CAnchorAuthMessage const & auth)
+{
+    CDBBatch batch(db);
+    batch.Write(std::make_pair(DB_JOURNAL_AUTHS, AuthKey{auth.height, auth.GetHash()}), auth);
+    // late auth below the pruned ones (accepted again after a btc reorg), shouldn't be left unpruned
+    if (auth.height < prunedHeight) {
+        prunedHeight = auth.height;
+        batch.Write(DB_JOURNAL_PRUNED_HEIGHT, prunedHeight);
+    }
+    db.WriteBatch(batch);
+}
+
+void CAnchorMessageJournal::WriteConfirm(CAnchorConfirmMessage const & confirm)
+{
+    db.Write(std::make_pair(DB_JOURNAL_CONFIRMS, ConfirmKey{confirm.btcTxHash, confirm.GetHash()}), confirm);
+}
+
+template <typename Key>
+void CAnchorMessageJournal::EraseRange(char prefix, Key const & start, std::function<bool(Key const &)> isInRange)
+{
+    CDBBatch batch(db);
+    std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
+    for (pcursor->Seek(std::make_pair(prefix, start)); pcursor->Valid(); pcursor->Next()) {
+        std::pair<char, Key> key;
+        if (!pcursor->GetKey(key) || key.first != prefix || !isInRange(key.second)) {
+            break;
+        }
+        batch.Erase(key);
+    }
+    if (batch.SizeEstimate() > 0) {
+        db.WriteBatch(batch);
+    }
+}
+
+void CAnchorMessageJournal::PruneAuths(THeight height)
+{
+    if (height <= prunedHeight) {
+        return;
+    }
+    // start past the erased ones, seeking over their tombstones gets slower with every prune until compaction
+    EraseRange<AuthKey>(DB_JOURNAL_AUTHS, AuthKey{prunedHeight, uint256{}}, [height] (AuthKey const & key) {
+        return key.height < height;
+    });
+    prunedHeight = height;
+    db.Write(DB_JOURNAL_PRUNED_HEIGHT, prunedHeight);
+}
+
+void CAnchorMessageJournal::EraseConfirms(uint256 const & btcTxHash)
+{
+    EraseRange<ConfirmKey>(DB_JOURNAL_CONFIRMS, ConfirmKey{btcTxHash, uint256{}}, [&btcTxHash] (ConfirmKey const & key) {
+        return key.first == btcTxHash;
+    });
+}
+
+void CAnchorMessageJournal::ClearConfirms()
+{
+    EraseRange<ConfirmKey>(DB_JOURNAL_CONFIRMS, ConfirmKey{}, [] (ConfirmKey const &) {
+        return true;
+    });
+}
+
+bool CAnchorMessageJournal::Load(CAnchorAuthIndex & auths, CAnchorAwaitingConfirms & confirms)
+{
+    AssertLockHeld(cs_main);
+    int64_t const nStart = GetTimeMillis();
+    size_t authsCount = 0, confirmsCount = 0;
+
+    std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
+    for (pcursor->Seek(DB_JOURNAL_AUTHS); pcursor->Valid(); pcursor->Next()) {
+        boost::this_thread::interruption_point();
+        std::pair<char, AuthKey> key;
+        if (!pcursor->GetKey(key) || key.first != DB_JOURNAL_AUTHS) {
+            break;
+        }
+        CAnchorAuthMessage auth;
+        if (!pcursor->GetValue(auth)) {
+            return error("%s: unable to read auth %s", __func__, key.second.msgHash.ToString());
+        }
+        authsCount += auths.AddAuth(auth);
+    }
+    for (pcursor->Seek(DB_JOURNAL_CONFIRMS); pcursor->Valid(); pcursor->Next()) {
+        boost::this_thread::interruption_point();
+        std::pair<char, ConfirmKey> key;
+        if (!pcursor->GetKey(key) || key.first != DB_JOURNAL_CONFIRMS) {
+            break;
+        }
+        CAnchorConfirmMessage confirm;
+        if (!pcursor->GetValue(confirm)) {
+            return error("%s: unable to read confirm %s", __func__, key.second.second.ToString());
+        }
+        confirmsCount += confirms.Add(confirm);
+    }
+    LogPrintf("Anchor journal: %d auths and %d confirms loaded in %dms, ~%d bytes on disk\n", authsCount, confirmsCount, GetTimeMillis() - nStart, EstimateSize());
+    return true;
+}
+
+size_t CAnchorMessageJournal::EstimateSize() const
+{
+    return db.EstimateSize(DB_JOURNAL_AUTHS, static_cast<char>(DB_JOURNAL_CONFIRMS + 1));
+}
@@ -40,6 +40,27 @@ namespace spv
 }
 
 typedef uint32_t THeight; // cause not decided yet which type to use for heights
+
+/** Max number of recovered anchor signers kept in the shared cache */
+static const size_t ANCHOR_SIGNER_CACHE_SIZE = 20000;
+/** Default for -anchorjournal, keep the accepted auths and awaiting confirms on disk between restarts */
+static const bool DEFAULT_ANCHOR_JOURNAL = false;
+
+/** Recovers the key of the compact signature 'sig' of 'sigHash' (null if failed). Shared bounded cache over all of the
+ *  anchor messages and anchors sigs, so relayed copies of the same auth/confirm don't recover it again */
+CKeyID RecoverAnchorSigner(uint256 const & sigHash, std::vector<unsigned char> const & sig);
+
+/** Sign hash and signer of the anchor message, computed on first use.
+ *  Reset on deserialization and signing, the messages aren't changed after that (except of the confirm's signature) */
+struct CAnchorMessageCache
+{
+    boost::optional<uint256> signHash;
+    boost::optional<CKeyID> signer;
+    std::vector<unsigned char> signerSig; // signature the 'signer' was recovered from
+
+    void Clear() { signHash.reset(); signer.reset(); signerSig.clear(); }
+};
+
 class CAnchorAuthMessage
 {
     using Signature = std::vector<unsigned char>;
@@ -69,6 +90,9 @@ public:
          READWRITE(blockHash);
          READWRITE(nextTeam);
          READWRITE(signature);
+         if (ser_action.ForRead()) {
+             cache.Clear();
+         }
     }
 
     // tags for multiindex
@@ -79,6 +103,7 @@ public:
 
 private:
     Signature signature;
+    mutable CAnchorMessageCache cache;
 };
 
 class CAnchor
@@ -144,7 +169,7 @@ public:
                 >
             >,
             // restriction index that helps detect doublesigning
-            // it may by quite expensive to index by GetSigner on the fly, but it should happen only on insertion
+            // signers are recovered once per message and cached (see CAnchorMessageCache)
             ordered_unique<
                 tag<Auth::ByVote>, composite_key<Auth,
                     const_mem_fun<Auth, uint256, &Auth::GetSignHash>,
@@ -158,14 +183,29 @@ public:
     Auth const * GetAuth(uint256 const & msgHash) const;
     Auth const * GetVote(uint256 const & signHash, CKeyID const & signer) const;
     bool ValidateAuth(Auth const & auth) const;
+    // the part of the validation common for all auths of the same height and previous anchor (and its results)
+    bool ValidateAuthContext(THeight height, uint256 const & previousAnchor, CTeam & team, CTeam & nextTeam) const;
+    bool ValidateAuth(Auth const & auth, CTeam const & team, CTeam const & nextTeam) const;
     bool AddAuth(Auth const & auth);
 
     CAnchor CreateBestAnchor(CTxDestination const & rewardDest) const;
     void ForEachAnchorAuthByHeight(std::function<bool(const CAnchorAuthIndex::Auth &)> callback) const;
+    // auths of the active chain within [low, high], from the top down to the first height that reached the quorum (GETANCHORAUTHS)
+    std::vector<uint256> GetActiveAuths(THeight low, THeight high, uint32_t quorum) const;
     void PruneOlderThan(THeight height);
 
 protected:
+    // auths of the height which belong to the active chain, summarized once and reused until the height's auths
+    // or the active block at that height change
+    struct HeightSummary {
+        uint256 blockHash;              // active block at the height (null if there is no block yet)
+        std::vector<uint256> msgHashes; // auths of that block
+        uint32_t maxVotes = 0;          // size of the biggest group of the auths with the same sign hash
+    };
+    HeightSummary const & GetHeightSummary(THeight height) const;
+
     Auths auths;
+    mutable std::map<THeight, HeightSummary> summaries;
 };
 
 class CAnchorIndex
@@ -222,6 +262,9 @@ public:
 
     using UnrewardedResult = std::set<uint256>;
     UnrewardedResult GetUnrewarded() const;
+    // keep unrewarded set in sync with the rewards of the active chain (ConnectTip/DisconnectTip)
+    void OnRewardConnected(uint256 const & btcTxHash);
+    void OnRewardDisconnected(uint256 const & btcTxHash);
 
     int GetAnchorConfirmations(uint256 const & txHash) const;
     int GetAnchorConfirmations(AnchorRec const * rec) const;
@@ -235,6 +278,13 @@ private:
     bool possibleReActivation = false;
     uint32_t spvLastHeight = 0;
 
+    // confirmed (for rewarding) anchors of the active chain without reward, maintained incrementally
+    UnrewardedResult unrewarded;
+    AnchorRec const * confirmedTop = nullptr; // the highest anchor 'unrewarded' was built up to
+
+    void UpdateUnrewarded();
+    void ResetUnrewarded();
+
 private:
     template <typename Key, typename Value>
     bool IterateTable(char prefix, std::function<void(Key const &, Value &)> callback)
@@ -301,6 +351,9 @@ public:
         READWRITE(rewardKeyID);
         READWRITE(rewardKeyType);
         READWRITE(signature);
+        if (ser_action.ForRead()) {
+            cache.Clear();
+        }
     }
 
     // tags for multiindex
@@ -308,6 +361,9 @@ public:
     struct ByAnchor{};      // by btctxhash
     struct ByKey{};         // composite, by btctxhash and GetSignHash for miner/reward creation
     struct ByVote{};        // composite, by GetSignHash and signer, helps detect doublesigning
+
+private:
+    mutable CAnchorMessageCache cache;
 };
 
 class CAnchorAwaitingConfirms
@@ -337,7 +393,7 @@ protected:
                 >
             >,
             // restriction index that helps detect doublesigning
-            // it may by quite expensive to index by GetSigner on the fly, but it should happen only on insertion
+            // signers are recovered once per message and cached (see CAnchorMessageCache)
             ordered_unique<
                 tag<Confirm::ByVote>, composite_key<Confirm,
                     const_mem_fun<Confirm, uint256, &Confirm::GetSignHash>,
@@ -361,6 +417,48 @@ public:
     void ForEachConfirm(std::function<void(Confirm const &)> callback) const;
 };
 
+/**
+ * Optional on-disk journal of the accepted auths (CAnchorAuthIndex) and awaiting confirms (CAnchorAwaitingConfirms).
+ * Mirrors their inserts and prunes, so a team member doesn't need to request all of the auths again after restart.
+ * Messages are loaded w/o revalidation: they were validated on acceptance and old ones are pruned by the indexes.
+ */
+class CAnchorMessageJournal
+{
+public:
+    CAnchorMessageJournal(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+
+    void WriteAuth(CAnchorAuthMessage const & auth);
+    void PruneAuths(THeight height); // all below the height
+    void WriteConfirm(CAnchorConfirmMessage const & confirm);
+    void EraseConfirms(uint256 const & btcTxHash);
+    void ClearConfirms();
+
+    // loads the messages into the indexes, returns false if the journal can't be read
+    bool Load(CAnchorAuthIndex & auths, CAnchorAwaitingConfirms & confirms);
+    size_t EstimateSize() const;
+
+private:
+    struct AuthKey {
+        THeight height; // big endian, to prune with lexicographic iteration
+        uint256 msgHash;
+
+        ADD_SERIALIZE_METHODS;
+
+        template <typename Stream, typename Operation>
+        inline void SerializationOp(Stream& s, Operation ser_action) {
+            READWRITE(WrapBigEndian(height));
+            READWRITE(msgHash);
+        }
+    };
+    using ConfirmKey = std::pair<uint256, uint256>; // btcTxHash, msgHash
+
+    template <typename Key>
+    void EraseRange(char prefix, Key const & start, std::function<bool(Key const &)> isInRange);
+
+    CDBWrapper db;
+    THeight prunedHeight = 0; // no auths below it, the next prune starts from there
+};
+
 /// dummy, unknown consensus rules yet. may be additional params needed (smth like 'height')
 /// even may be not here, but in CCustomCSView
 uint32_t GetMinAnchorQuorum(CCustomCSView::CTeam const & team);
@@ -376,5 +474,7 @@ class CNode;
 extern std::unique_ptr<CAnchorAuthIndex> panchorauths;
 extern std::unique_ptr<CAnchorIndex> panchors;
 extern std::unique_ptr<CAnchorAwaitingConfirms> panchorAwaitingConfirms;
+/** Journal of the auths and confirms above (if enabled by -anchorjournal), set after loading from it */
+extern std::unique_ptr<CAnchorMessageJournal> panchorjournal;
 
 #endif // DEFI_MASTERNODES_ANCHORS_H
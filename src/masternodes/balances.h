@@ -221,4 +221,18 @@ struct BalanceKey {
     }
 };
 
+// same as BalanceKey, but ordered by token first (holders index)
+struct TokenHolderKey {
+    DCT_ID tokenID;
+    CScript owner;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(WrapBigEndian(tokenID.v));
+        READWRITE(owner);
+    }
+};
+
 #endif //DEFI_MASTERNODES_BALANCES_H
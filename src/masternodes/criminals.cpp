@@ -5,10 +5,16 @@
 #include <masternodes/criminals.h>
 #include <masternodes/masternodes.h>
 
-static const unsigned int DOUBLE_SIGN_MINIMUM_PROOF_INTERVAL = 100;
+#include <limits>
+#include <set>
 
-const unsigned char CMintedHeadersView::MintedHeaders ::prefix = 'h';
-const unsigned char CCriminalProofsView::Proofs       ::prefix = 'm';
+const unsigned char DB_MINTED_HEADERS_HEIGHT_INDEX = 'I'; // single record, marks the heights index as built
+const unsigned char DB_MINTED_HEADERS_PRUNED_HEIGHT = 'P'; // single record, no headers below it
+
+const unsigned char CMintedHeadersView::MintedHeaders        ::prefix = 'h';
+const unsigned char CMintedHeadersView::MintedHeadersByHeight::prefix = 'i';
+const unsigned char CCriminalProofsView::Proofs              ::prefix = 'm';
+const unsigned char CCriminalProofsView::Punished            ::prefix = 'n';
 
 struct DBMNBlockHeadersKey
 {
@@ -27,13 +33,41 @@ struct DBMNBlockHeadersKey
     }
 };
 
+// heights index of the minted headers, for pruning
+struct DBMNBlockHeadersHeightKey
+{
+    uint32_t height;
+    DBMNBlockHeadersKey header;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action)
+    {
+        READWRITE(WrapBigEndian(height));
+        READWRITE(header);
+    }
+};
+
+static uint32_t HeaderIndexHeight(CBlockHeader const & blockHeader)
+{
+    return static_cast<uint32_t>(std::min<uint64_t>(blockHeader.height, std::numeric_limits<uint32_t>::max()));
+}
+
 void CMintedHeadersView::WriteMintedBlockHeader(const uint256 & txid, const uint64_t mintedBlocks, const uint256 & hash, const CBlockHeader & blockHeader, bool fIsFakeNet)
 {
     if (fIsFakeNet) {
         return;
     }
-    // directly!
-    WriteBy<MintedHeaders>(DBMNBlockHeadersKey{txid, mintedBlocks, hash}, blockHeader);
+    DBMNBlockHeadersKey const key{txid, mintedBlocks, hash};
+    uint32_t const height = HeaderIndexHeight(blockHeader);
+    WriteBy<MintedHeaders>(key, blockHeader);
+    WriteBy<MintedHeadersByHeight>(DBMNBlockHeadersHeightKey{height, key}, '\0');
+    // late header (of a stale fork) below the pruned ones, shouldn't be left unpruned
+    uint32_t prunedHeight{0};
+    if (Read(DB_MINTED_HEADERS_PRUNED_HEIGHT, prunedHeight) && height < prunedHeight) {
+        Write(DB_MINTED_HEADERS_PRUNED_HEIGHT, height);
+    }
 }
 
 bool CMintedHeadersView::FetchMintedHeaders(const uint256 & txid, const uint64_t mintedBlocks, std::map<uint256, CBlockHeader> & blockHeaders, bool fIsFakeNet)
@@ -58,11 +92,63 @@ bool CMintedHeadersView::FetchMintedHeaders(const uint256 & txid, const uint64_t
 
 void CMintedHeadersView::EraseMintedBlockHeader(const uint256 & txid, const uint64_t mintedBlocks, const uint256 & hash)
 {
-    // directly!
-    EraseBy<MintedHeaders>(DBMNBlockHeadersKey{txid, mintedBlocks, hash});
+    DBMNBlockHeadersKey const key{txid, mintedBlocks, hash};
+    CBlockHeader blockHeader;
+    if (ReadBy<MintedHeaders>(key, blockHeader)) {
+        EraseBy<MintedHeadersByHeight>(DBMNBlockHeadersHeightKey{HeaderIndexHeight(blockHeader), key});
+    }
+    EraseBy<MintedHeaders>(key);
+}
+
+size_t CMintedHeadersView::PruneMintedHeaders(uint32_t belowHeight, size_t limit)
+{
+    // start past the erased ones, seeking over their tombstones gets slower with every prune until compaction
+    uint32_t prunedHeight{0};
+    Read(DB_MINTED_HEADERS_PRUNED_HEIGHT, prunedHeight);
+    if (prunedHeight >= belowHeight) {
+        return 0;
+    }
+    std::vector<DBMNBlockHeadersHeightKey> keys;
+    ForEach<MintedHeadersByHeight, DBMNBlockHeadersHeightKey, char>([&] (DBMNBlockHeadersHeightKey const & key, char &) {
+        if (key.height >= belowHeight) {
+            return false;
+        }
+        keys.push_back(key);
+        return keys.size() < limit;
+    }, DBMNBlockHeadersHeightKey{prunedHeight, DBMNBlockHeadersKey{}});
+    for (auto const & key : keys) {
+        EraseBy<MintedHeaders>(key.header);
+        EraseBy<MintedHeadersByHeight>(key);
+    }
+    // the batch may stop in the middle of the height
+    Write(DB_MINTED_HEADERS_PRUNED_HEIGHT, keys.size() < limit ? belowHeight : keys.back().height);
+    return keys.size();
+}
+
+bool CMintedHeadersView::HasMintedHeadersHeightIndex() const
+{
+    return Exists(DB_MINTED_HEADERS_HEIGHT_INDEX);
+}
+
+void CMintedHeadersView::ReindexMintedHeadersHeights()
+{
+    std::vector<DBMNBlockHeadersHeightKey> keys;
+    ForEach<MintedHeaders, DBMNBlockHeadersKey, CBlockHeader>([&keys] (DBMNBlockHeadersKey const & key, CBlockHeader & blockHeader) {
+        keys.push_back(DBMNBlockHeadersHeightKey{HeaderIndexHeight(blockHeader), key});
+        return true;
+    });
+    for (auto const & key : keys) {
+        WriteBy<MintedHeadersByHeight>(key, '\0');
+    }
+    Erase(DB_MINTED_HEADERS_PRUNED_HEIGHT);
+    Write(DB_MINTED_HEADERS_HEIGHT_INDEX, true);
 }
 
 void CCriminalProofsView::AddCriminalProof(const uint256 & id, const CBlockHeader & blockHeader, const CBlockHeader & conflictBlockHeader) {
+    if (IsCriminalPunished(id)) {
+        LogPrintf("Criminals: node %s is punished already, proof ignored\n", id.ToString());
+        return;
+    }
     WriteBy<Proofs>(id, CDoubleSignFact{blockHeader, conflictBlockHeader});
     LogPrintf("Add criminal proof for node %s, blocks: %s, %s\n", id.ToString(), blockHeader.GetHash().ToString(), conflictBlockHeader.GetHash().ToString());
 }
@@ -73,13 +159,26 @@ void CCriminalProofsView::RemoveCriminalProofs(const uint256 & mnId) {
     LogPrintf("Criminals: erase proofs for node %s\n", mnId.ToString());
 }
 
+void CCriminalProofsView::MarkCriminalPunished(const uint256 & mnId) {
+    WriteBy<Punished>(mnId, '\0');
+    RemoveCriminalProofs(mnId);
+}
+
+void CCriminalProofsView::UnmarkCriminalPunished(const uint256 & mnId) {
+    EraseBy<Punished>(mnId);
+}
+
+bool CCriminalProofsView::IsCriminalPunished(const uint256 & mnId) const {
+    return ExistsBy<Punished>(mnId);
+}
+
 CCriminalProofsView::CMnCriminals CCriminalProofsView::GetUnpunishedCriminals() {
 
     CMnCriminals result;
     ForEach<Proofs, uint256, CDoubleSignFact>([&result] (uint256 const & id, CDoubleSignFact & proof) {
-
-        // matching with already punished. and this is the ONLY measure!
-        auto node = pcustomcsview->GetMasternode(id); // assert?
+        // the punished flags live in the criminals db, which is flushed apart from the chainstate, so matching
+        // with the bans of the chain is still the ONLY reliable measure (cheap: pending proofs only)
+        auto node = pcustomcsview->GetMasternode(id);
         if (node && node->banTx.IsNull()) {
             result.emplace(id, std::move(proof));
         }
@@ -89,6 +188,35 @@ CCriminalProofsView::CMnCriminals CCriminalProofsView::GetUnpunishedCriminals()
 
 }
 
+size_t CCriminalProofsView::ReconcilePunishedCriminals(CCustomCSView & mnview)
+{
+    std::set<uint256> banned;
+    mnview.ForEachMasternode([&banned] (uint256 const & id, CMasternode & node) {
+        if (!node.banTx.IsNull()) {
+            banned.insert(id);
+        }
+        return true;
+    });
+    std::vector<uint256> stale;
+    ForEach<Punished, uint256, char>([&banned, &stale] (uint256 const & id, char &) {
+        if (!banned.count(id)) {
+            stale.push_back(id);
+        }
+        return true;
+    });
+    for (auto const & id : stale) {
+        UnmarkCriminalPunished(id);
+    }
+    size_t changed = stale.size();
+    for (auto const & id : banned) {
+        if (!IsCriminalPunished(id)) {
+            MarkCriminalPunished(id);
+            ++changed;
+        }
+    }
+    return changed;
+}
+
 bool IsDoubleSignRestricted(uint64_t height1, uint64_t height2)
 {
     return (std::max(height1, height2) - std::min(height1, height2)) <= DOUBLE_SIGN_MINIMUM_PROOF_INTERVAL;
@@ -113,5 +241,6 @@ bool IsDoubleSigned(CBlockHeader const & oneHeader, CBlockHeader const & twoHead
     return false;
 }
 
-/** Global variable that holds CCriminalsView (should be protected by cs_main) */
+/** Global DB and view that holds CCriminalsView (should be protected by cs_main) */
+std::unique_ptr<CStorageLevelDB> pcriminalsDB;
 std::unique_ptr<CCriminalsView> pcriminals;
@@ -32,6 +32,9 @@ public:
 };
 
 
+/** Only headers that close (by height) can prove double signing, see IsDoubleSignRestricted */
+static const unsigned int DOUBLE_SIGN_MINIMUM_PROOF_INTERVAL = 100;
+
 class CMintedHeadersView : public virtual CStorageView
 {
 public:
@@ -39,7 +42,14 @@ public:
     bool FetchMintedHeaders(uint256 const & txid, uint64_t const mintedBlocks, std::map<uint256, CBlockHeader> & blockHeaders, bool fIsFakeNet);
     void EraseMintedBlockHeader(uint256 const & txid, uint64_t const mintedBlocks, uint256 const & hash);
 
+    // erases up to 'limit' headers with height below 'belowHeight' (the lowest first), returns how many were erased
+    size_t PruneMintedHeaders(uint32_t belowHeight, size_t limit);
+    // headers written before the heights index existed aren't prunable until it is built
+    bool HasMintedHeadersHeightIndex() const;
+    void ReindexMintedHeadersHeights();
+
     struct MintedHeaders { static const unsigned char prefix; };
+    struct MintedHeadersByHeight { static const unsigned char prefix; };
 };
 
 
@@ -49,25 +59,40 @@ public:
     void AddCriminalProof(uint256 const & id, CBlockHeader const & blockHeader, CBlockHeader const & conflictBlockHeader);
     void RemoveCriminalProofs(uint256 const & mnId);
 
+    // the masternode is banned by the criminal tx (BanCriminal): its proofs are dropped, the new ones are ignored
+    void MarkCriminalPunished(uint256 const & mnId);
+    // the criminal tx is disconnected (UnbanCriminal), its proof should be added back
+    void UnmarkCriminalPunished(uint256 const & mnId);
+    bool IsCriminalPunished(uint256 const & mnId) const;
+
     using CMnCriminals = std::map<uint256, CDoubleSignFact>; // nodeId, two headers
+    // the proofs of the banned masternodes (on the chainstate) are skipped
     CMnCriminals GetUnpunishedCriminals();
 
+    // makes the punished flags match the bans of the chainstate: the criminals db is flushed before the chainstate,
+    // so after a crash it may be ahead of it (and the db of an older version has no flags at all). returns number of fixed flags
+    size_t ReconcilePunishedCriminals(CCustomCSView & mnview);
+
     struct Proofs { static const unsigned char prefix; };
+    struct Punished { static const unsigned char prefix; };
 };
 
-// "off-chain" data, should be written directly
+// "off-chain" data. Buffered, flushed to the db together with the chainstate (and the block index, so the headers
+// lost on crash are accepted, and checked, again)
 class CCriminalsView
         : public CMintedHeadersView
         , public CCriminalProofsView
 {
 public:
-    CCriminalsView(const fs::path& dbName, std::size_t cacheSize, bool fMemory = false, bool fWipe = false)
-        : CStorageView(new CStorageLevelDB(dbName, cacheSize, fMemory, fWipe, true)) // direct!
+    CCriminalsView(CStorageKV & st)
+        : CStorageView(new CFlushableStorageKV(st))
     {}
 
+    bool Flush() { return DB().Flush(); }
 };
 
-/** Global variable that holds CCriminalsView (should be protected by cs_main) */
+/** Global DB and view that holds CCriminalsView (should be protected by cs_main) */
+extern std::unique_ptr<CStorageLevelDB> pcriminalsDB;
 extern std::unique_ptr<CCriminalsView> pcriminals;
 
 bool IsDoubleSignRestricted(uint64_t height1, uint64_t height2);
@@ -16,7 +16,13 @@
 #include <wallet/wallet.h>
 
 #include <algorithm>
+#include <deque>
 #include <functional>
+#include <limits>
+#include <list>
+#include <memory>
+#include <queue>
+#include <tuple>
 
 /// @attention make sure that it does not overlap with those in tokens.cpp !!!
 // Prefixes for the 'custom chainstate database' (customsc/)
@@ -27,10 +33,14 @@ const unsigned char DB_MN_HEIGHT = 'H';       // single record with last process
 const unsigned char DB_MN_ANCHOR_REWARD = 'r';
 const unsigned char DB_MN_CURRENT_TEAM = 't';
 const unsigned char DB_MN_FOUNDERS_DEBT = 'd';
+const unsigned char DB_MN_ACTIVITY = 'A';     // active masternodes index
+const unsigned char DB_MN_ACTIVE_SET_VERSION = 'V'; // single record, hash chain of the active masternodes index updates
+const unsigned char DB_MN_ACTIVE_INDEX_HEIGHT = 'B'; // single record, height the active masternodes index was built at
 
 const unsigned char CMasternodesView::ID      ::prefix = DB_MASTERNODES;
 const unsigned char CMasternodesView::Operator::prefix = DB_MN_OPERATORS;
 const unsigned char CMasternodesView::Owner   ::prefix = DB_MN_OWNERS;
+const unsigned char CMasternodesView::Activity::prefix = DB_MN_ACTIVITY;
 const unsigned char CAnchorRewardsView::BtcTx ::prefix = DB_MN_ANCHOR_REWARD;
 
 std::unique_ptr<CCustomCSView> pcustomcsview;
@@ -128,6 +138,21 @@ bool CMasternode::IsActive(int h) const
     return state == ENABLED || state == PRE_RESIGNED || state == PRE_BANNED;
 }
 
+CMasternodeActivity::CMasternodeActivity(CMasternode const & node)
+    : operatorAuthAddress(node.operatorAuthAddress)
+    , activeFrom(std::numeric_limits<int32_t>::min())
+    , activeUntil(std::numeric_limits<int32_t>::max())
+{
+    // the same ranges as CMasternode::GetState gives for ENABLED, PRE_RESIGNED and PRE_BANNED
+    if (node.resignHeight != -1) {
+        activeUntil = node.resignHeight + GetMnResignDelay();
+    } else if (node.banHeight != -1) {
+        activeUntil = node.banHeight + GetMnResignDelay();
+    } else if (node.creationHeight != 0) { // special case for genesis block
+        activeFrom = node.creationHeight + GetMnActivationDelay();
+    }
+}
+
 std::string CMasternode::GetHumanReadableState(State state)
 {
     switch (state) {
@@ -197,17 +222,17 @@ bool operator!=(CDoubleSignFact const & a, CDoubleSignFact const & b)
  */
 boost::optional<CMasternode> CMasternodesView::GetMasternode(const uint256 & id) const
 {
-    return ReadBy<ID, CMasternode>(id);
+    return ReadCachedBy<ID, CMasternode>(id);
 }
 
 boost::optional<uint256> CMasternodesView::GetMasternodeIdByOperator(const CKeyID & id) const
 {
-    return ReadBy<Operator, uint256>(id);
+    return ReadCachedBy<Operator, uint256>(id);
 }
 
 boost::optional<uint256> CMasternodesView::GetMasternodeIdByOwner(const CKeyID & id) const
 {
-    return ReadBy<Owner, uint256>(id);
+    return ReadCachedBy<Owner, uint256>(id);
 }
 
 void CMasternodesView::ForEachMasternode(std::function<bool (const uint256 &, CMasternode &)> callback, uint256 const & start)
@@ -250,7 +275,7 @@ bool CMasternodesView::BanCriminal(const uint256 txid, std::vector<unsigned char
         if (node && node->operatorAuthAddress == minter && node->banTx.IsNull()) {
             node->banTx = txid;
             node->banHeight = height;
-            WriteBy<ID>(nodeId, *node);
+            WriteMasternode(nodeId, *node);
 
             return true;
         }
@@ -270,7 +295,7 @@ bool CMasternodesView::UnbanCriminal(const uint256 txid, std::vector<unsigned ch
     if (node && node->banTx == txid) {
         node->banTx = {};
         node->banHeight = -1;
-        WriteBy<ID>(nodeId, *node);
+        WriteMasternode(nodeId, *node);
         return true;
     }
     return false;
@@ -288,6 +313,23 @@ boost::optional<std::pair<CKeyID, uint256> > CMasternodesView::AmIOperator() con
     return {};
 }
 
+std::vector<std::pair<CKeyID, uint256>> CMasternodesView::GetOperatorsMulti() const
+{
+    std::vector<std::pair<CKeyID, uint256>> result;
+    for (auto const & address : gArgs.GetArgs("-masternode_operator")) {
+        CTxDestination dest = DecodeDestination(address);
+        CKeyID const authAddress = dest.which() == 1 ? CKeyID(*boost::get<PKHash>(&dest)) : (dest.which() == 4 ? CKeyID(*boost::get<WitnessV0KeyHash>(&dest)) : CKeyID());
+        if (authAddress.IsNull()) {
+            continue;
+        }
+        auto nodeId = GetMasternodeIdByOperator(authAddress);
+        if (nodeId && std::find(result.begin(), result.end(), std::make_pair(authAddress, *nodeId)) == result.end()) {
+            result.emplace_back(authAddress, *nodeId);
+        }
+    }
+    return result;
+}
+
 boost::optional<std::pair<CKeyID, uint256> > CMasternodesView::AmIOwner() const
 {
     CTxDestination dest = DecodeDestination(gArgs.GetArg("-masternode_owner", ""));
@@ -312,7 +354,7 @@ Res CMasternodesView::CreateMasternode(const uint256 & nodeId, const CMasternode
         return Res::Err("bad owner and|or operator address (should be P2PKH or P2WPKH only) or node with those addresses exists");
     }
 
-    WriteBy<ID>(nodeId, node);
+    WriteMasternode(nodeId, node);
     WriteBy<Owner>(node.ownerAuthAddress, nodeId);
     WriteBy<Operator>(node.operatorAuthAddress, nodeId);
 
@@ -333,11 +375,75 @@ Res CMasternodesView::ResignMasternode(const uint256 & nodeId, const uint256 & t
 
     node->resignTx =  txid;
     node->resignHeight = height;
-    WriteBy<ID>(nodeId, *node);
+    WriteMasternode(nodeId, *node);
 
     return Res::Ok();
 }
 
+void CMasternodesView::WriteMasternode(const uint256 & nodeId, const CMasternode & node)
+{
+    WriteBy<ID>(nodeId, node);
+
+    CMasternodeActivity const activity(node);
+    WriteBy<Activity>(nodeId, activity);
+    CDataStream ss{SER_GETHASH, PROTOCOL_VERSION};
+    ss << GetActiveSetVersion().value_or(uint256()) << nodeId << activity;
+    Write(DB_MN_ACTIVE_SET_VERSION, Hash(ss.begin(), ss.end()));
+}
+
+void CMasternodesView::ForEachMasternodeActivity(std::function<bool (const uint256 &, const CMasternodeActivity &)> callback) const
+{
+    ForEach<Activity, uint256, CMasternodeActivity>([&callback] (uint256 const & id, CMasternodeActivity & activity) {
+        return callback(id, activity);
+    });
+}
+
+boost::optional<uint256> CMasternodesView::GetActiveSetVersion() const
+{
+    uint256 version;
+    if (Read(DB_MN_ACTIVE_SET_VERSION, version))
+        return {version};
+    return {};
+}
+
+bool CMasternodesView::HasActiveMasternodesIndex() const
+{
+    return Exists(DB_MN_ACTIVE_INDEX_HEIGHT);
+}
+
+int CMasternodesView::GetActiveMasternodesIndexHeight() const
+{
+    int result = 0;
+    Read(DB_MN_ACTIVE_INDEX_HEIGHT, result);
+    return result;
+}
+
+void CMasternodesView::ReindexActiveMasternodes(int height)
+{
+    std::vector<std::pair<uint256, CMasternodeActivity>> stale;
+    ForEach<Activity, uint256, CMasternodeActivity>([&stale] (uint256 const & id, CMasternodeActivity & activity) {
+        stale.emplace_back(id, activity);
+        return true;
+    });
+    for (auto const & kv : stale) {
+        EraseBy<Activity>(kv.first);
+    }
+    Erase(DB_MN_ACTIVE_SET_VERSION);
+
+    std::vector<std::pair<uint256, CMasternode>> nodes;
+    ForEach<ID, uint256, CMasternode>([&nodes] (uint256 const & id, CMasternode & node) {
+        nodes.emplace_back(id, node);
+        return true;
+    });
+    for (auto const & kv : nodes) {
+        WriteMasternode(kv.first, kv.second);
+    }
+    if (nodes.empty()) {
+        Write(DB_MN_ACTIVE_SET_VERSION, uint256()); // the version of the empty index
+    }
+    Write(DB_MN_ACTIVE_INDEX_HEIGHT, height);
+}
+
 //void CMasternodesView::UnCreateMasternode(const uint256 & nodeId)
 //{
 //    auto node = GetMasternode(nodeId);
@@ -435,26 +541,130 @@ void CAnchorRewardsView::ForEachAnchorReward(std::function<bool (const CAnchorRe
 /*
  *  CCustomCSView
  */
+namespace {
+
+using CMasternodeActivities = std::vector<std::pair<uint256, CMasternodeActivity>>;
+
+/*
+ * In-memory copies of the active masternodes index and teams calculated upon them. Both are keyed by the active set version,
+ * so the index is scanned only once after each masternode's state change, and the team is calculated once per stakeModifier.
+ */
+class CTeamSelectionCache
+{
+public:
+    using TeamKey = std::tuple<uint256, int, uint256>; // stakeModifier, height, active set version
+
+    std::shared_ptr<const CMasternodeActivities> GetActivities(uint256 const & version) const
+    {
+        LOCK(cs);
+        for (auto const & entry : activities) {
+            if (entry.first == version) {
+                return entry.second;
+            }
+        }
+        return {};
+    }
+
+    void PutActivities(uint256 const & version, std::shared_ptr<const CMasternodeActivities> list)
+    {
+        LOCK(cs);
+        activities.emplace_front(version, std::move(list));
+        if (activities.size() > MAX_ACTIVITY_LISTS) {
+            activities.pop_back();
+        }
+    }
+
+    bool GetTeam(TeamKey const & key, CTeamView::CTeam & team) const
+    {
+        LOCK(cs);
+        auto it = teams.find(key);
+        if (it == teams.end()) {
+            return false;
+        }
+        team = it->second;
+        return true;
+    }
+
+    void PutTeam(TeamKey const & key, CTeamView::CTeam const & team)
+    {
+        LOCK(cs);
+        if (!teams.emplace(key, team).second) {
+            return;
+        }
+        teamsOrder.push_back(key);
+        if (teamsOrder.size() > MAX_TEAMS) {
+            teams.erase(teamsOrder.front());
+            teamsOrder.pop_front();
+        }
+    }
+
+private:
+    // tip view and the one of the block being connected
+    static const size_t MAX_ACTIVITY_LISTS = 2;
+    static const size_t MAX_TEAMS = 32;
+
+    mutable CCriticalSection cs;
+    std::list<std::pair<uint256, std::shared_ptr<const CMasternodeActivities>>> activities;
+    std::map<TeamKey, CTeamView::CTeam> teams;
+    std::deque<TeamKey> teamsOrder;
+};
+
+CTeamSelectionCache teamSelectionCache;
+
+}
+
 CTeamView::CTeam CCustomCSView::CalcNextTeam(const uint256 & stakeModifier)
+{
+    return CalcNextTeam(stakeModifier, ::ChainActive().Height());
+}
+
+CTeamView::CTeam CCustomCSView::CalcNextTeam(const uint256 & stakeModifier, int height)
 {
     int anchoringTeamSize = Params().GetConsensus().mn.anchoringTeamSize;
+    if (anchoringTeamSize <= 0) {
+        return {};
+    }
 
-    std::map<arith_uint256, CKeyID, std::less<arith_uint256>> priorityMN;
-    ForEachMasternode([&stakeModifier, &priorityMN] (uint256 const & id, CMasternode & node) {
-        if(!node.IsActive())
+    auto const version = GetActiveSetVersion().value_or(uint256()); // index is built on startup, so no version means no masternodes
+    CTeamSelectionCache::TeamKey const key{stakeModifier, height, version};
+
+    CTeam newTeam;
+    if (teamSelectionCache.GetTeam(key, newTeam)) {
+        return newTeam;
+    }
+
+    auto activities = teamSelectionCache.GetActivities(version);
+    if (!activities) {
+        auto list = std::make_shared<CMasternodeActivities>();
+        ForEachMasternodeActivity([&list] (uint256 const & id, CMasternodeActivity const & activity) {
+            list->emplace_back(id, activity);
             return true;
+        });
+        activities = list;
+        teamSelectionCache.PutActivities(version, activities);
+    }
 
-        CDataStream ss{SER_GETHASH, PROTOCOL_VERSION};
-        ss << id << stakeModifier;
-        priorityMN.insert(std::make_pair(UintToArith256(Hash(ss.begin(), ss.end())), node.operatorAuthAddress));
-        return true;
-    });
+    // bounded max-heap: keeps the 'anchoringTeamSize' lowest priorities seen so far, its top is the worst of them
+    std::priority_queue<std::pair<arith_uint256, CKeyID>> priorityMN;
+    for (auto const & kv : *activities) {
+        if (!kv.second.IsActive(height))
+            continue;
+
+        CHashWriter ss{SER_GETHASH, PROTOCOL_VERSION};
+        ss << kv.first << stakeModifier;
+        auto priority = UintToArith256(ss.GetHash());
+        if (priorityMN.size() < static_cast<size_t>(anchoringTeamSize)) {
+            priorityMN.emplace(priority, kv.second.operatorAuthAddress);
+        } else if (priority < priorityMN.top().first) {
+            priorityMN.pop();
+            priorityMN.emplace(priority, kv.second.operatorAuthAddress);
+        }
+    }
 
-    CTeam newTeam;
-    auto && it = priorityMN.begin();
-    for (int i = 0; i < anchoringTeamSize && it != priorityMN.end(); ++i, ++it) {
-        newTeam.insert(it->second);
+    for (; !priorityMN.empty(); priorityMN.pop()) {
+        newTeam.insert(priorityMN.top().second);
     }
+    teamSelectionCache.PutTeam(key, newTeam);
     return newTeam;
 }
 
@@ -499,6 +709,19 @@ void CCustomCSView::CreateAndRelayConfirmMessageIfNeed(const CAnchor & anchor, c
 
 }
 
+void CCustomCSView::OnUndoBlock(int height)
+{
+    // the undos of the blocks connected before an index was built don't revert its records
+    if (height <= GetTokenHoldersIndexHeight()) {
+        LogPrintf("Rebuilding token holders index at height %d\n", height - 1);
+        ReindexTokenHolders(height - 1);
+    }
+    if (height <= GetActiveMasternodesIndexHeight()) {
+        LogPrintf("Rebuilding active masternodes index at height %d\n", height - 1);
+        ReindexActiveMasternodes(height - 1);
+    }
+}
+
 void CCustomCSView::OnUndoTx(uint256 const & txid, uint32_t height)
 {
     const auto undo = this->GetUndo(UndoKey{height, txid});
@@ -523,3 +746,72 @@ bool CCustomCSView::CanSpend(const uint256 & txId, int height) const
     return !pair || pair->second.destructionTx != uint256{};
 }
 
+
+CCustomCSSnapshot::CCustomCSSnapshot(CStorageLevelDB & db, CCustomCSView & current, int height_, uint256 const & blockHash_)
+    : dbSnapshot(db.CreateSnapshot())
+    , pending(*dbSnapshot, dynamic_cast<CFlushableStorageKV &>(current.GetRaw()).Freeze())
+    , view(pending)
+    , height(height_)
+    , blockHash(blockHash_)
+{
+}
+
+static CCriticalSection cs_customcs_snapshot;
+static std::shared_ptr<CCustomCSSnapshot> lastCustomCSSnapshot GUARDED_BY(cs_customcs_snapshot);
+
+std::shared_ptr<CCustomCSSnapshot> GetCustomCSSnapshot(int height, uint256 const & blockHash)
+{
+    AssertLockHeld(cs_main);
+    LOCK(cs_customcs_snapshot);
+    if (!lastCustomCSSnapshot || lastCustomCSSnapshot->GetBlockHash() != blockHash) {
+        lastCustomCSSnapshot = std::make_shared<CCustomCSSnapshot>(*pcustomcsDB, *pcustomcsview, height, blockHash);
+    }
+    return lastCustomCSSnapshot;
+}
+
+void ReleaseCustomCSSnapshot()
+{
+    LOCK(cs_customcs_snapshot);
+    lastCustomCSSnapshot.reset();
+}
+
+size_t MoveCustomCSStorage(CStorageLevelDB & from, CStorageLevelDB & to)
+{
+    static const size_t batchBytes = 16 << 20;
+    auto flush = [](CStorageLevelDB & storage) {
+        if (!storage.Flush()) {
+            throw std::runtime_error("failed to move the enhanced chainstate");
+        }
+    };
+
+    // copy, then erase: the source stays complete until the target is
+    size_t moved = 0, bytes = 0;
+    auto it = from.NewIterator();
+    for (it->Seek({}); it->Valid(); it->Next()) {
+        auto const key = it->KeySlice(), value = it->ValueSlice();
+        to.Write(TBytes(key.begin(), key.end()), TBytes(value.begin(), value.end()));
+        ++moved;
+        bytes += key.size() + value.size();
+        if (bytes >= batchBytes) {
+            flush(to);
+            bytes = 0;
+        }
+    }
+    if (!moved) {
+        return 0;
+    }
+    flush(to);
+    bytes = 0;
+    it = from.NewIterator();
+    for (it->Seek({}); it->Valid(); it->Next()) {
+        auto const key = it->KeySlice();
+        from.Erase(TBytes(key.begin(), key.end()));
+        bytes += key.size();
+        if (bytes >= batchBytes) {
+            flush(from);
+            bytes = 0;
+        }
+    }
+    flush(from);
+    return moved;
+}
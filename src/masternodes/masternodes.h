@@ -35,6 +35,11 @@ CAmount GetMnCreationFee(int height);
 CAmount GetTokenCollateralAmount();
 CAmount GetTokenCreationFee(int height);
 
+/** Default for -customcsreadcache, entries of decoded masternodes/tokens/balances kept by pcustomcsview */
+static const int64_t DEFAULT_CUSTOMCS_READ_CACHE = 50000;
+/** Default for -customcsinchainstate, host the enhanced chainstate in the chainstate db instead of enhancedcs */
+static const bool DEFAULT_CUSTOMCS_IN_CHAINSTATE = false;
+
 class CMasternode
 {
 public:
@@ -105,6 +110,32 @@ public:
 };
 
 
+/*
+ * Compact record of the active masternodes index: the heights range where CMasternode::IsActive(h) is true
+ * and the operator. Rewritten on every state change of the masternode (create/resign/ban/unban).
+ */
+struct CMasternodeActivity
+{
+    CKeyID operatorAuthAddress;
+    int32_t activeFrom;
+    int32_t activeUntil; // exclusive
+
+    CMasternodeActivity() : activeFrom(0), activeUntil(0) {}
+    explicit CMasternodeActivity(CMasternode const & node);
+
+    bool IsActive(int h) const { return h >= activeFrom && h < activeUntil; }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action)
+    {
+        READWRITE(operatorAuthAddress);
+        READWRITE(activeFrom);
+        READWRITE(activeUntil);
+    }
+};
+
 class CMasternodesView : public virtual CStorageView
 {
 public:
@@ -122,6 +153,8 @@ public:
     bool UnbanCriminal(const uint256 txid, std::vector<unsigned char> & metadata);
 
     boost::optional<std::pair<CKeyID, uint256>> AmIOperator() const;
+    // all of -masternode_operator which are known masternodes (AmIOperator() gives only one of them)
+    std::vector<std::pair<CKeyID, uint256>> GetOperatorsMulti() const;
     boost::optional<std::pair<CKeyID, uint256>> AmIOwner() const;
 
     Res CreateMasternode(uint256 const & nodeId, CMasternode const & node);
@@ -129,10 +162,24 @@ public:
 //    void UnCreateMasternode(uint256 const & nodeId);
 //    void UnResignMasternode(uint256 const & nodeId, uint256 const & resignTx);
 
+    // active masternodes index, see CMasternodeActivity
+    void ForEachMasternodeActivity(std::function<bool(uint256 const & id, CMasternodeActivity const & activity)> callback) const;
+    // hash chain over all index updates, so equal versions mean equal sets (even for different views and forks)
+    boost::optional<uint256> GetActiveSetVersion() const;
+    bool HasActiveMasternodesIndex() const;
+    // the undos of the blocks up to this height were written w/o the index records and don't revert them
+    int GetActiveMasternodesIndexHeight() const;
+    void ReindexActiveMasternodes(int height);
+
+private:
+    void WriteMasternode(uint256 const & nodeId, CMasternode const & node);
+
+public:
     // tags
     struct ID { static const unsigned char prefix; };
     struct Operator { static const unsigned char prefix; };
     struct Owner { static const unsigned char prefix; };
+    struct Activity { static const unsigned char prefix; };
 };
 
 class CLastHeightView : public virtual CStorageView
@@ -193,17 +240,39 @@ public:
 
     // cause depends on current mns:
     CTeamView::CTeam CalcNextTeam(uint256 const & stakeModifier);
+    CTeamView::CTeam CalcNextTeam(uint256 const & stakeModifier, int height);
 
     /// @todo newbase move to networking?
     void CreateAndRelayConfirmMessageIfNeed(const CAnchor & anchor, const uint256 & btcTxHash);
 
     // simplified version of undo, without any unnecessary undo data
     void OnUndoTx(uint256 const & txid, uint32_t height);
+    // after all the txs of the block at the height are undone: rebuilds the indexes its undos don't cover
+    void OnUndoBlock(int height);
 
     bool CanSpend(const uint256 & txId, int height) const;
 
     bool Flush() { return DB().Flush(); }
 
+    // pending changes of this view and the memory they hold (the top-level view counts toward -dbcache)
+    size_t GetPendingChanges() const {
+        return static_cast<CFlushableStorageKV const &>(DB()).PendingChanges();
+    }
+    size_t DynamicMemoryUsage() const {
+        return static_cast<CFlushableStorageKV const &>(DB()).DynamicMemoryUsage();
+    }
+
+    // attaches cache of decoded masternodes/tokens/balances to this view (intended for top-level one)
+    void EnableReadCache(size_t maxEntries) {
+        static_cast<CFlushableStorageKV&>(DB()).EnableReadCache(maxEntries);
+    }
+    boost::optional<CDecodedValueCache::Stats> GetReadCacheStats() const {
+        auto cache = static_cast<CFlushableStorageKV const &>(DB()).GetOwnReadCache();
+        if (cache)
+            return {cache->GetStats()};
+        return {};
+    }
+
     CStorageKV& GetRaw() {
         return DB();
     }
@@ -213,4 +282,38 @@ public:
 extern std::unique_ptr<CStorageLevelDB> pcustomcsDB;
 extern std::unique_ptr<CCustomCSView> pcustomcsview;
 
+/** Read-only copy of the enhanced chainstate as of some block: snapshot of pcustomcsDB plus pcustomcsview's pending
+ *  (not flushed yet) changes, frozen into layers shared with it. Long reads (RPC listings) go through it without cs_main. */
+class CCustomCSSnapshot
+{
+public:
+    CCustomCSSnapshot(CStorageLevelDB & db, CCustomCSView & view, int height, uint256 const & blockHash);
+    CCustomCSSnapshot(CCustomCSSnapshot const &) = delete;
+    void operator=(CCustomCSSnapshot const &) = delete;
+
+    // may be read concurrently, must not be written
+    CCustomCSView & View() { return view; }
+    int GetHeight() const { return height; }
+    uint256 const & GetBlockHash() const { return blockHash; }
+
+private:
+    std::unique_ptr<CStorageKV> dbSnapshot;
+    CFlushableStorageKV pending;
+    CCustomCSView view;
+    int const height;
+    uint256 const blockHash;
+};
+
+/** Snapshot of pcustomcsDB + pcustomcsview, which should be the state of 'blockHash' (the caller holds cs_main).
+ *  Nothing is copied under cs_main but the merges of the frozen layers (amortized), the last snapshot is shared
+ *  while the tip stays the same. */
+std::shared_ptr<CCustomCSSnapshot> GetCustomCSSnapshot(int height, uint256 const & blockHash);
+/** Drops the shared snapshot, should be called before pcustomcsDB is destroyed */
+void ReleaseCustomCSSnapshot();
+
+/** Moves all of the records from one enhanced chainstate storage to another (enhancedcs <-> chainstate, see
+ *  -customcsinchainstate) and erases them from the source. Records overwrite the target's, so a move interrupted
+ *  by a crash is completed by the next one. Returns the number of records moved. */
+size_t MoveCustomCSStorage(CStorageLevelDB & from, CStorageLevelDB & to);
+
 #endif // DEFI_MASTERNODES_MASTERNODES_H
@@ -114,114 +114,318 @@ bool HasFoundationAuth(CTransaction const & tx, CCoinsViewCache const & coins, C
     return false;
 }
 
-Res ApplyCustomTx(CCustomCSView & base_mnview, CCoinsViewCache const & coins, CTransaction const & tx, Consensus::Params const & consensusParams, uint32_t height, bool isCheck)
+/*
+ * Stateless decoders of the custom txs. They do only checks which don't need any view, in the same order as before,
+ * so the results (and error messages) stay the same. Deserialization errors are thrown, like it was in Apply*Tx.
+ * Creation of masternodes and tokens also depends on the height, so their decoding is split into the vouts check,
+ * the parsing (cached by the tx, see GetCustomTx) and the completion of the parsed message.
+ */
+static Res CheckCreateMasternodeVouts(CTransaction const & tx, uint32_t height)
 {
-    Res res = Res::Ok();
+    // Check quick conditions first
+    if (tx.vout.size() < 2 ||
+        tx.vout[0].nValue < GetMnCreationFee(height) || tx.vout[0].nTokenId != DCT_ID{0} ||
+        tx.vout[1].nValue != GetMnCollateralAmount() || tx.vout[1].nTokenId != DCT_ID{0}
+        ) {
+        return Res::Err("%s: %s", "Creation of masternode", "malformed tx vouts (wrong creation fee or collateral amount)");
+    }
+    return Res::Ok();
+}
 
-    if ((tx.IsCoinBase() && height > 0) || tx.vout.empty()) { // genesis contains custom coinbase txs
-        return Res::Ok(); // not "custom" tx
+static Res ParseCreateMasternodeMsg(std::vector<unsigned char> const & metadata, CMasternode & node)
+{
+    CDataStream ss(metadata, SER_NETWORK, PROTOCOL_VERSION);
+    ss >> node.operatorType;
+    ss >> node.operatorAuthAddress;
+    if (!ss.empty()) {
+        return Res::Err("%s: deserialization failed: excess %d bytes", "Creation of masternode",  ss.size());
     }
+    return Res::Ok();
+}
 
-    CCustomCSView mnview(base_mnview);
+static Res CompleteCreateMasternodeMsg(CTransaction const & tx, uint32_t height, CMasternode & node)
+{
+    CTxDestination dest;
+    if (ExtractDestination(tx.vout[1].scriptPubKey, dest)) {
+        if (dest.which() == 1) {
+            node.ownerType = 1;
+            node.ownerAuthAddress = CKeyID(*boost::get<PKHash>(&dest));
+        }
+        else if (dest.which() == 4) {
+            node.ownerType = 4;
+            node.ownerAuthAddress = CKeyID(*boost::get<WitnessV0KeyHash>(&dest));
+        }
+    }
+    node.creationHeight = height;
+    return Res::Ok();
+}
+
+static Res DecodeCreateMasternodeMsg(CTransaction const & tx, uint32_t height, std::vector<unsigned char> const & metadata, CMasternode & node)
+{
+    auto res = CheckCreateMasternodeVouts(tx, height);
+    if (res.ok) {
+        res = ParseCreateMasternodeMsg(metadata, node);
+    }
+    return res.ok ? CompleteCreateMasternodeMsg(tx, height, node) : res;
+}
+
+static Res DecodeResignMasternodeMsg(std::vector<unsigned char> const & metadata, CResignMasternodeMessage & msg)
+{
+    if (metadata.size() != sizeof(uint256)) {
+        return Res::Err("%s: metadata must contain 32 bytes", "Resigning of masternode");
+    }
+    msg.nodeId = uint256(metadata);
+    return Res::Ok();
+}
 
+static Res CheckCreateTokenVouts(CTransaction const & tx, uint32_t height)
+{
+    // Check quick conditions first
+    if (tx.vout.size() < 2 ||
+        tx.vout[0].nValue < GetTokenCreationFee(height) || tx.vout[0].nTokenId != DCT_ID{0} ||
+        tx.vout[1].nValue != GetTokenCollateralAmount() || tx.vout[1].nTokenId != DCT_ID{0}
+        ) {
+        return Res::Err("%s: %s", "Token creation", "malformed tx vouts (wrong creation fee or collateral amount)");
+    }
+    return Res::Ok();
+}
+
+static Res ParseCreateTokenMsg(std::vector<unsigned char> const & metadata, CTokenImplementation & token)
+{
+    CDataStream ss(metadata, SER_NETWORK, PROTOCOL_VERSION);
+    ss >> static_cast<CToken &>(token);
+    if (!ss.empty()) {
+        return Res::Err("%s: deserialization failed: excess %d bytes", "Token creation",  ss.size());
+    }
+    return Res::Ok();
+}
+
+static Res CompleteCreateTokenMsg(CTransaction const & tx, uint32_t height, CTokenImplementation & token)
+{
+    token.symbol = trim_ws(token.symbol).substr(0, CToken::MAX_TOKEN_SYMBOL_LENGTH);
+    if (token.symbol.size() == 0 || IsDigit(token.symbol[0])) {
+        return Res::Err("token symbol '%s' should be non-empty and starts with a letter", token.symbol);
+    }
+    token.name = trim_ws(token.name).substr(0, CToken::MAX_TOKEN_NAME_LENGTH);
+
+    token.creationTx = tx.GetHash();
+    token.creationHeight = height;
+    return Res::Ok();
+}
+
+static Res DecodeCreateTokenMsg(CTransaction const & tx, uint32_t height, std::vector<unsigned char> const & metadata, CTokenImplementation & token)
+{
+    auto res = CheckCreateTokenVouts(tx, height);
+    if (res.ok) {
+        res = ParseCreateTokenMsg(metadata, token);
+    }
+    return res.ok ? CompleteCreateTokenMsg(tx, height, token) : res;
+}
+
+static Res DecodeDestroyTokenMsg(std::vector<unsigned char> const & metadata, CDestroyTokenMessage & msg)
+{
+    if (metadata.size() != sizeof(uint256)) {
+        return Res::Err("%s: metadata must contain 32 bytes", "Token destruction");
+    }
+    msg.tokenTx = uint256(metadata);
+    return Res::Ok();
+}
+
+static Res DecodeUpdateTokenMsg(std::vector<unsigned char> const & metadata, CUpdateTokenMessage & msg)
+{
+    CDataStream ss(metadata, SER_NETWORK, PROTOCOL_VERSION);
+    ss >> msg.tokenTx;
+    ss >> msg.isDAT;
+    if (!ss.empty()) {
+        return Res::Err("Token Update: deserialization failed: excess %d bytes", ss.size());
+    }
+    return Res::Ok();
+}
+
+static Res DecodeMintTokenMsg(std::vector<unsigned char> const & metadata, CBalances & minted)
+{
+    CDataStream ss(metadata, SER_NETWORK, PROTOCOL_VERSION);
+    ss >> minted;
+    if (!ss.empty()) {
+        return Res::Err("MintToken tx deserialization failed: excess %d bytes", ss.size());
+    }
+    return Res::Ok();
+}
+
+static Res DecodeUtxosToAccountMsg(CTransaction const & tx, std::vector<unsigned char> const & metadata, CUtxosToAccountMessage & msg)
+{
+    // deserialize
+    CDataStream ss(metadata, SER_NETWORK, PROTOCOL_VERSION);
+    ss >> msg;
+    if (!ss.empty()) {
+        return Res::Err("UtxosToAccount tx deserialization failed: excess %d bytes", ss.size());
+    }
+    const auto base = strprintf("Transfer UtxosToAccount: %s", msg.ToString());
+
+    // check enough tokens are "burnt"
+    const auto burnt = BurntTokens(tx);
+    CBalances mustBeBurnt = SumAllTransfers(msg.to);
+    if (!burnt.ok) {
+        return Res::Err("%s: %s", base, burnt.msg);
+    }
+    if (burnt.val->balances != mustBeBurnt.balances) {
+        return Res::Err("%s: transfer tokens mismatch burnt tokens: (%s) != (%s)", base, mustBeBurnt.ToString(), burnt.val->ToString());
+    }
+    return Res::Ok();
+}
+
+static Res DecodeAccountToUtxosMsg(std::vector<unsigned char> const & metadata, CAccountToUtxosMessage & msg)
+{
+    // deserialize
+    CDataStream ss(metadata, SER_NETWORK, PROTOCOL_VERSION);
+    ss >> msg;
+    if (!ss.empty()) {
+        return Res::Err("AccountToUtxos tx deserialization failed: excess %d bytes", ss.size());
+    }
+    return Res::Ok();
+}
+
+static Res DecodeAccountToAccountMsg(std::vector<unsigned char> const & metadata, CAccountToAccountMessage & msg)
+{
+    // deserialize
+    CDataStream ss(metadata, SER_NETWORK, PROTOCOL_VERSION);
+    ss >> msg;
+    if (!ss.empty()) {
+        return Res::Err("AccountToAccount tx deserialization failed: excess %d bytes", ss.size());
+    }
+    return Res::Ok();
+}
+
+// height-independent part of DecodeCustomTx
+static std::shared_ptr<const CCustomTxParsed> ParseCustomTx(CTransaction const & tx)
+{
+    static const auto notCustom = std::make_shared<const CCustomTxParsed>();
+
+    std::vector<unsigned char> metadata;
+    const auto type = GuessCustomTxType(tx, metadata);
+    if (type == CustomTxType::None) {
+        return notCustom;
+    }
+
+    auto parsed = std::make_shared<CCustomTxParsed>();
+    parsed->type = type;
     try {
-        // Check if it is custom tx with metadata
-        std::vector<unsigned char> metadata;
-        CustomTxType guess = GuessCustomTxType(tx, metadata);
-        switch (guess)
+        auto& msg = parsed->msg;
+        switch (type)
         {
             case CustomTxType::CreateMasternode:
-                res = ApplyCreateMasternodeTx(mnview, tx, height, metadata);
+                msg = CMasternode{};
+                parsed->res = ParseCreateMasternodeMsg(metadata, boost::get<CMasternode>(msg));
                 break;
             case CustomTxType::ResignMasternode:
-                res = ApplyResignMasternodeTx(mnview, coins, tx, height, metadata);
+                msg = CResignMasternodeMessage{};
+                parsed->res = DecodeResignMasternodeMsg(metadata, boost::get<CResignMasternodeMessage>(msg));
                 break;
             case CustomTxType::CreateToken:
-                res = ApplyCreateTokenTx(mnview, coins, tx, height, metadata);
+                msg = CTokenImplementation{};
+                parsed->res = ParseCreateTokenMsg(metadata, boost::get<CTokenImplementation>(msg));
                 break;
             case CustomTxType::DestroyToken:
-                res = ApplyDestroyTokenTx(mnview, coins, tx, height, metadata);
+                msg = CDestroyTokenMessage{};
+                parsed->res = DecodeDestroyTokenMsg(metadata, boost::get<CDestroyTokenMessage>(msg));
                 break;
             case CustomTxType::UpdateToken:
-                res = ApplyUpdateTokenTx(mnview, coins, tx, height, metadata);
+                msg = CUpdateTokenMessage{};
+                parsed->res = DecodeUpdateTokenMsg(metadata, boost::get<CUpdateTokenMessage>(msg));
                 break;
             case CustomTxType::MintToken:
-                res = ApplyMintTokenTx(mnview, coins, tx, metadata);
+                msg = CBalances{};
+                parsed->res = DecodeMintTokenMsg(metadata, boost::get<CBalances>(msg));
                 break;
             case CustomTxType::UtxosToAccount:
-                res = ApplyUtxosToAccountTx(mnview, tx, metadata);
+                msg = CUtxosToAccountMessage{};
+                parsed->res = DecodeUtxosToAccountMsg(tx, metadata, boost::get<CUtxosToAccountMessage>(msg));
                 break;
             case CustomTxType::AccountToUtxos:
-                res = ApplyAccountToUtxosTx(mnview, coins, tx, metadata);
+                msg = CAccountToUtxosMessage{};
+                parsed->res = DecodeAccountToUtxosMsg(metadata, boost::get<CAccountToUtxosMessage>(msg));
                 break;
             case CustomTxType::AccountToAccount:
-                res = ApplyAccountToAccountTx(mnview, coins, tx, metadata);
+                msg = CAccountToAccountMessage{};
+                parsed->res = DecodeAccountToAccountMsg(metadata, boost::get<CAccountToAccountMessage>(msg));
                 break;
             default:
-                return Res::Ok(); // not "custom" tx
-        }
-        // list of transactions which aren't allowed to fail:
-        if (!res.ok && NotAllowedToFail(guess)) {
-            res.code |= CustomTxErrCodes::Fatal;
+                return notCustom;
         }
     } catch (std::exception& e) {
-        res = Res::Err(e.what());
+        parsed->res = Res::Err(e.what());
+        parsed->thrown = true;
     } catch (...) {
-        res = Res::Err("unexpected error");
-    }
-
-    if (!res.ok || isCheck) { // 'isCheck' - don't create undo nor flush to the upper view
-        return res;
+        parsed->res = Res::Err("unexpected error");
+        parsed->thrown = true;
     }
+    return parsed;
+}
 
-    // construct undo
-    auto& flushable = dynamic_cast<CFlushableStorageKV&>(mnview.GetRaw());
-    auto undo = CUndo::Construct(base_mnview.GetRaw(), flushable.GetRaw());
-    // flush changes
-    mnview.Flush();
-    // write undo
-    if (!undo.before.empty()) {
-        base_mnview.SetUndo(UndoKey{height, tx.GetHash()}, undo);
+CCustomTxParsed const & GetCustomTx(CTransaction const & tx)
+{
+    auto parsed = tx.GetCustomTxCache();
+    if (!parsed) {
+        parsed = tx.SetCustomTxCache(ParseCustomTx(tx));
     }
-
-    return res;
+    // the tx keeps it alive
+    return *parsed;
 }
 
-/*
- * Checks if given tx is 'txCreateMasternode'. Creates new MN if all checks are passed
- * Issued by: any
- */
-Res ApplyCreateMasternodeTx(CCustomCSView & mnview, CTransaction const & tx, uint32_t height, std::vector<unsigned char> const & metadata)
+CDecodedCustomTx DecodeCustomTx(CTransaction const & tx, uint32_t height)
 {
-    const std::string base{"Creation of masternode"};
-    // Check quick conditions first
-    if (tx.vout.size() < 2 ||
-        tx.vout[0].nValue < GetMnCreationFee(height) || tx.vout[0].nTokenId != DCT_ID{0} ||
-        tx.vout[1].nValue != GetMnCollateralAmount() || tx.vout[1].nTokenId != DCT_ID{0}
-        ) {
-        return Res::Err("%s: %s", base, "malformed tx vouts (wrong creation fee or collateral amount)");
+    CDecodedCustomTx decoded;
+
+    if ((tx.IsCoinBase() && height > 0) || tx.vout.empty()) { // genesis contains custom coinbase txs
+        return decoded; // not "custom" tx
     }
 
-    CMasternode node;
-    CDataStream ss(metadata, SER_NETWORK, PROTOCOL_VERSION);
-    ss >> node.operatorType;
-    ss >> node.operatorAuthAddress;
-    if (!ss.empty()) {
-        return Res::Err("%s: deserialization failed: excess %d bytes", base,  ss.size());
+    auto const & parsed = GetCustomTx(tx);
+    if (parsed.type == CustomTxType::None) {
+        return decoded; // not "custom" tx
     }
+    decoded.type = parsed.type;
 
-    CTxDestination dest;
-    if (ExtractDestination(tx.vout[1].scriptPubKey, dest)) {
-        if (dest.which() == 1) {
-            node.ownerType = 1;
-            node.ownerAuthAddress = CKeyID(*boost::get<PKHash>(&dest));
+    try {
+        // vouts are checked before the metadata, as it was
+        if (parsed.type == CustomTxType::CreateMasternode) {
+            decoded.res = CheckCreateMasternodeVouts(tx, height);
+        } else if (parsed.type == CustomTxType::CreateToken) {
+            decoded.res = CheckCreateTokenVouts(tx, height);
         }
-        else if (dest.which() == 4) {
-            node.ownerType = 4;
-            node.ownerAuthAddress = CKeyID(*boost::get<WitnessV0KeyHash>(&dest));
+        if (decoded.res.ok && parsed.thrown) {
+            decoded.res = parsed.res;
+            return decoded; // exceptions were never "fatal"
+        }
+        if (decoded.res.ok) {
+            decoded.res = parsed.res;
+        }
+        if (decoded.res.ok) {
+            decoded.msg = parsed.msg;
+            if (parsed.type == CustomTxType::CreateMasternode) {
+                decoded.res = CompleteCreateMasternodeMsg(tx, height, boost::get<CMasternode>(decoded.msg));
+            } else if (parsed.type == CustomTxType::CreateToken) {
+                decoded.res = CompleteCreateTokenMsg(tx, height, boost::get<CTokenImplementation>(decoded.msg));
+            }
+        }
+        // list of transactions which aren't allowed to fail:
+        if (!decoded.res.ok && NotAllowedToFail(decoded.type)) {
+            decoded.res.code |= CustomTxErrCodes::Fatal;
         }
+    } catch (std::exception& e) {
+        decoded.res = Res::Err(e.what());
+    } catch (...) {
+        decoded.res = Res::Err("unexpected error");
     }
-    node.creationHeight = height;
+    return decoded;
+}
+
+/*
+ * Stateful parts of the custom txs, applied to the already decoded (and checked by DecodeCustomTx) messages
+ */
+static Res ApplyCreateMasternode(CCustomCSView & mnview, CTransaction const & tx, CMasternode const & node)
+{
+    const std::string base{"Creation of masternode"};
 
     auto res = mnview.CreateMasternode(tx.GetHash(), node);
     if (!res.ok) {
@@ -230,14 +434,11 @@ Res ApplyCreateMasternodeTx(CCustomCSView & mnview, CTransaction const & tx, uin
     return Res::Ok(base);
 }
 
-Res ApplyResignMasternodeTx(CCustomCSView & mnview, CCoinsViewCache const & coins, CTransaction const & tx, uint32_t height, const std::vector<unsigned char> & metadata)
+static Res ApplyResignMasternode(CCustomCSView & mnview, CCoinsViewCache const & coins, CTransaction const & tx, uint32_t height, CResignMasternodeMessage const & msg)
 {
     const std::string base{"Resigning of masternode"};
 
-    if (metadata.size() != sizeof(uint256)) {
-        return Res::Err("%s: metadata must contain 32 bytes", base);
-    }
-    uint256 nodeId(metadata);
+    uint256 const & nodeId = msg.nodeId;
     auto const node = mnview.GetMasternode(nodeId);
     if (!node) {
         return Res::Err("%s: node %s does not exist", base, nodeId.ToString());
@@ -253,31 +454,9 @@ Res ApplyResignMasternodeTx(CCustomCSView & mnview, CCoinsViewCache const & coin
     return Res::Ok(base);
 }
 
-Res ApplyCreateTokenTx(CCustomCSView & mnview, CCoinsViewCache const & coins, CTransaction const & tx, uint32_t height, std::vector<unsigned char> const & metadata)
+static Res ApplyCreateToken(CCustomCSView & mnview, CCoinsViewCache const & coins, CTransaction const & tx, CTokenImplementation const & token)
 {
     const std::string base{"Token creation"};
-    // Check quick conditions first
-    if (tx.vout.size() < 2 ||
-        tx.vout[0].nValue < GetTokenCreationFee(height) || tx.vout[0].nTokenId != DCT_ID{0} ||
-        tx.vout[1].nValue != GetTokenCollateralAmount() || tx.vout[1].nTokenId != DCT_ID{0}
-        ) {
-        return Res::Err("%s: %s", base, "malformed tx vouts (wrong creation fee or collateral amount)");
-    }
-
-    CTokenImplementation token;
-    CDataStream ss(metadata, SER_NETWORK, PROTOCOL_VERSION);
-    ss >> static_cast<CToken &>(token);
-    if (!ss.empty()) {
-        return Res::Err("%s: deserialization failed: excess %d bytes", base,  ss.size());
-    }
-    token.symbol = trim_ws(token.symbol).substr(0, CToken::MAX_TOKEN_SYMBOL_LENGTH);
-    if (token.symbol.size() == 0 || IsDigit(token.symbol[0])) {
-        return Res::Err("token symbol '%s' should be non-empty and starts with a letter", token.symbol);
-    }
-    token.name = trim_ws(token.name).substr(0, CToken::MAX_TOKEN_NAME_LENGTH);
-
-    token.creationTx = tx.GetHash();
-    token.creationHeight = height;
 
     //check foundation auth
     if((token.flags & (uint8_t)CToken::TokenFlags::isDAT) && !HasFoundationAuth(tx, coins, Params().GetConsensus()))
@@ -293,17 +472,13 @@ Res ApplyCreateTokenTx(CCustomCSView & mnview, CCoinsViewCache const & coins, CT
     return Res::Ok(base);
 }
 
-Res ApplyDestroyTokenTx(CCustomCSView & mnview, CCoinsViewCache const & coins, CTransaction const & tx, uint32_t height, std::vector<unsigned char> const & metadata)
+static Res ApplyDestroyToken(CCustomCSView & mnview, CCoinsViewCache const & coins, CTransaction const & tx, uint32_t height, CDestroyTokenMessage const & msg)
 {
     const std::string base{"Token destruction"};
 
-    if (metadata.size() != sizeof(uint256)) {
-        return Res::Err("%s: metadata must contain 32 bytes", base);
-    }
-    uint256 tokenTx(metadata);
-    auto pair = mnview.GetTokenByCreationTx(tokenTx);
+    auto pair = mnview.GetTokenByCreationTx(msg.tokenTx);
     if (!pair) {
-        return Res::Err("%s: token with creationTx %s does not exist", base, tokenTx.ToString());
+        return Res::Err("%s: token with creationTx %s does not exist", base, msg.tokenTx.ToString());
     }
     CTokenImplementation const & token = pair->second;
     if (!HasCollateralAuth(tx, coins, token.creationTx)) {
@@ -317,22 +492,13 @@ Res ApplyDestroyTokenTx(CCustomCSView & mnview, CCoinsViewCache const & coins, C
     return Res::Ok(base);
 }
 
-Res ApplyUpdateTokenTx(CCustomCSView & mnview, CCoinsViewCache const & coins, CTransaction const & tx, uint32_t height, std::vector<unsigned char> const & metadata)
+static Res ApplyUpdateToken(CCustomCSView & mnview, CCoinsViewCache const & coins, CTransaction const & tx, CUpdateTokenMessage const & msg)
 {
     const std::string base{"Token update"};
 
-    uint256 tokenTx;
-    bool isDAT;
-    CDataStream ss(metadata, SER_NETWORK, PROTOCOL_VERSION);
-    ss >> tokenTx;
-    ss >> isDAT;
-    if (!ss.empty()) {
-        return Res::Err("Token Update: deserialization failed: excess %d bytes", ss.size());
-    }
-
-    auto pair = mnview.GetTokenByCreationTx(tokenTx);
+    auto pair = mnview.GetTokenByCreationTx(msg.tokenTx);
     if (!pair) {
-        return Res::Err("%s: token with creationTx %s does not exist", base, tokenTx.ToString());
+        return Res::Err("%s: token with creationTx %s does not exist", base, msg.tokenTx.ToString());
     }
     CTokenImplementation const & token = pair->second;
 
@@ -341,7 +507,7 @@ Res ApplyUpdateTokenTx(CCustomCSView & mnview, CCoinsViewCache const & coins, CT
         return Res::Err("%s: %s", base, "Is not a foundation owner");
     }
 
-    if((token.flags & (uint8_t)CToken::TokenFlags::isDAT) != isDAT && pair->first.v >= 128)
+    if((token.flags & (uint8_t)CToken::TokenFlags::isDAT) != msg.isDAT && pair->first.v >= 128)
     {
         auto res = mnview.UpdateToken(token.creationTx);
         if (!res.ok) {
@@ -351,17 +517,10 @@ Res ApplyUpdateTokenTx(CCustomCSView & mnview, CCoinsViewCache const & coins, CT
     return Res::Ok(base);
 }
 
-Res ApplyMintTokenTx(CCustomCSView & mnview, CCoinsViewCache const & coins, CTransaction const & tx, std::vector<unsigned char> const & metadata)
+static Res ApplyMintToken(CCustomCSView & mnview, CCoinsViewCache const & coins, CTransaction const & tx, CBalances const & minted)
 {
     const std::string base{"Token minting"};
 
-    CBalances minted;
-    CDataStream ss(metadata, SER_NETWORK, PROTOCOL_VERSION);
-    ss >> minted;
-    if (!ss.empty()) {
-        return Res::Err("MintToken tx deserialization failed: excess %d bytes", ss.size());
-    }
-
     // check auth and increase balance of token's owner
     for (auto const & kv : minted.balances) {
         DCT_ID tokenId = kv.first;
@@ -391,27 +550,10 @@ Res ApplyMintTokenTx(CCustomCSView & mnview, CCoinsViewCache const & coins, CTra
     return Res::Ok(base);
 }
 
-
-Res ApplyUtxosToAccountTx(CCustomCSView & mnview, CTransaction const & tx, std::vector<unsigned char> const & metadata)
+static Res ApplyUtxosToAccount(CCustomCSView & mnview, CUtxosToAccountMessage const & msg)
 {
-    // deserialize
-    CUtxosToAccountMessage msg;
-    CDataStream ss(metadata, SER_NETWORK, PROTOCOL_VERSION);
-    ss >> msg;
-    if (!ss.empty()) {
-        return Res::Err("UtxosToAccount tx deserialization failed: excess %d bytes", ss.size());
-    }
     const auto base = strprintf("Transfer UtxosToAccount: %s", msg.ToString());
 
-    // check enough tokens are "burnt"
-    const auto burnt = BurntTokens(tx);
-    CBalances mustBeBurnt = SumAllTransfers(msg.to);
-    if (!burnt.ok) {
-        return Res::Err("%s: %s", base, burnt.msg);
-    }
-    if (burnt.val->balances != mustBeBurnt.balances) {
-        return Res::Err("%s: transfer tokens mismatch burnt tokens: (%s) != (%s)", base, mustBeBurnt.ToString(), burnt.val->ToString());
-    }
     // transfer
     for (const auto& kv : msg.to) {
         const auto res = mnview.AddBalances(kv.first, kv.second);
@@ -422,15 +564,8 @@ Res ApplyUtxosToAccountTx(CCustomCSView & mnview, CTransaction const & tx, std::
     return Res::Ok(base);
 }
 
-Res ApplyAccountToUtxosTx(CCustomCSView & mnview, CCoinsViewCache const & coins, CTransaction const & tx, std::vector<unsigned char> const & metadata)
+static Res ApplyAccountToUtxos(CCustomCSView & mnview, CCoinsViewCache const & coins, CTransaction const & tx, CAccountToUtxosMessage const & msg)
 {
-    // deserialize
-    CAccountToUtxosMessage msg;
-    CDataStream ss(metadata, SER_NETWORK, PROTOCOL_VERSION);
-    ss >> msg;
-    if (!ss.empty()) {
-        return Res::Err("AccountToUtxos tx deserialization failed: excess %d bytes", ss.size());
-    }
     const auto base = strprintf("Transfer AccountToUtxos: %s", msg.ToString());
 
     // check auth
@@ -453,15 +588,8 @@ Res ApplyAccountToUtxosTx(CCustomCSView & mnview, CCoinsViewCache const & coins,
     return Res::Ok(base);
 }
 
-Res ApplyAccountToAccountTx(CCustomCSView & mnview, CCoinsViewCache const & coins, CTransaction const & tx, std::vector<unsigned char> const & metadata)
+static Res ApplyAccountToAccount(CCustomCSView & mnview, CCoinsViewCache const & coins, CTransaction const & tx, CAccountToAccountMessage const & msg)
 {
-    // deserialize
-    CAccountToAccountMessage msg;
-    CDataStream ss(metadata, SER_NETWORK, PROTOCOL_VERSION);
-    ss >> msg;
-    if (!ss.empty()) {
-        return Res::Err("AccountToAccount tx deserialization failed: excess %d bytes", ss.size());
-    }
     const auto base = strprintf("Transfer AccountToAccount: %s", msg.ToString());
 
     // check auth
@@ -482,12 +610,156 @@ Res ApplyAccountToAccountTx(CCustomCSView & mnview, CCoinsViewCache const & coin
     return Res::Ok(base);
 }
 
+Res ApplyCustomTx(CCustomCSView & base_mnview, CCoinsViewCache const & coins, CTransaction const & tx, Consensus::Params const & consensusParams, uint32_t height, bool isCheck, CDecodedCustomTx const * decoded)
+{
+    CDecodedCustomTx decodedHere;
+    if (!decoded) {
+        decodedHere = DecodeCustomTx(tx, height);
+        decoded = &decodedHere;
+    }
+    if (decoded->type == CustomTxType::None) {
+        return Res::Ok(); // not "custom" tx
+    }
+    if (!decoded->res.ok) {
+        return decoded->res;
+    }
+
+    Res res = Res::Ok();
+    CCustomCSView mnview(base_mnview);
+
+    try {
+        auto const & msg = decoded->msg;
+        switch (decoded->type)
+        {
+            case CustomTxType::CreateMasternode:
+                res = ApplyCreateMasternode(mnview, tx, boost::get<CMasternode>(msg));
+                break;
+            case CustomTxType::ResignMasternode:
+                res = ApplyResignMasternode(mnview, coins, tx, height, boost::get<CResignMasternodeMessage>(msg));
+                break;
+            case CustomTxType::CreateToken:
+                res = ApplyCreateToken(mnview, coins, tx, boost::get<CTokenImplementation>(msg));
+                break;
+            case CustomTxType::DestroyToken:
+                res = ApplyDestroyToken(mnview, coins, tx, height, boost::get<CDestroyTokenMessage>(msg));
+                break;
+            case CustomTxType::UpdateToken:
+                res = ApplyUpdateToken(mnview, coins, tx, boost::get<CUpdateTokenMessage>(msg));
+                break;
+            case CustomTxType::MintToken:
+                res = ApplyMintToken(mnview, coins, tx, boost::get<CBalances>(msg));
+                break;
+            case CustomTxType::UtxosToAccount:
+                res = ApplyUtxosToAccount(mnview, boost::get<CUtxosToAccountMessage>(msg));
+                break;
+            case CustomTxType::AccountToUtxos:
+                res = ApplyAccountToUtxos(mnview, coins, tx, boost::get<CAccountToUtxosMessage>(msg));
+                break;
+            case CustomTxType::AccountToAccount:
+                res = ApplyAccountToAccount(mnview, coins, tx, boost::get<CAccountToAccountMessage>(msg));
+                break;
+            default:
+                return Res::Ok(); // not "custom" tx
+        }
+        // list of transactions which aren't allowed to fail:
+        if (!res.ok && NotAllowedToFail(decoded->type)) {
+            res.code |= CustomTxErrCodes::Fatal;
+        }
+    } catch (std::exception& e) {
+        res = Res::Err(e.what());
+    } catch (...) {
+        res = Res::Err("unexpected error");
+    }
+
+    if (!res.ok || isCheck) { // 'isCheck' - don't create undo nor flush to the upper view
+        return res;
+    }
+
+    // construct undo
+    auto& flushable = dynamic_cast<CFlushableStorageKV&>(mnview.GetRaw());
+    auto undo = CUndo::Construct(base_mnview.GetRaw(), flushable.GetRaw());
+    // flush changes
+    mnview.Flush();
+    // write undo
+    if (!undo.before.empty()) {
+        base_mnview.SetUndo(UndoKey{height, tx.GetHash()}, undo);
+    }
+
+    return res;
+}
+
+/*
+ * Checks if given tx is 'txCreateMasternode'. Creates new MN if all checks are passed
+ * Issued by: any
+ */
+Res ApplyCreateMasternodeTx(CCustomCSView & mnview, CTransaction const & tx, uint32_t height, std::vector<unsigned char> const & metadata)
+{
+    CMasternode node;
+    auto res = DecodeCreateMasternodeMsg(tx, height, metadata, node);
+    return res.ok ? ApplyCreateMasternode(mnview, tx, node) : res;
+}
+
+Res ApplyResignMasternodeTx(CCustomCSView & mnview, CCoinsViewCache const & coins, CTransaction const & tx, uint32_t height, const std::vector<unsigned char> & metadata)
+{
+    CResignMasternodeMessage msg;
+    auto res = DecodeResignMasternodeMsg(metadata, msg);
+    return res.ok ? ApplyResignMasternode(mnview, coins, tx, height, msg) : res;
+}
+
+Res ApplyCreateTokenTx(CCustomCSView & mnview, CCoinsViewCache const & coins, CTransaction const & tx, uint32_t height, std::vector<unsigned char> const & metadata)
+{
+    CTokenImplementation token;
+    auto res = DecodeCreateTokenMsg(tx, height, metadata, token);
+    return res.ok ? ApplyCreateToken(mnview, coins, tx, token) : res;
+}
+
+Res ApplyDestroyTokenTx(CCustomCSView & mnview, CCoinsViewCache const & coins, CTransaction const & tx, uint32_t height, std::vector<unsigned char> const & metadata)
+{
+    CDestroyTokenMessage msg;
+    auto res = DecodeDestroyTokenMsg(metadata, msg);
+    return res.ok ? ApplyDestroyToken(mnview, coins, tx, height, msg) : res;
+}
+
+Res ApplyUpdateTokenTx(CCustomCSView & mnview, CCoinsViewCache const & coins, CTransaction const & tx, uint32_t height, std::vector<unsigned char> const & metadata)
+{
+    CUpdateTokenMessage msg;
+    auto res = DecodeUpdateTokenMsg(metadata, msg);
+    return res.ok ? ApplyUpdateToken(mnview, coins, tx, msg) : res;
+}
+
+Res ApplyMintTokenTx(CCustomCSView & mnview, CCoinsViewCache const & coins, CTransaction const & tx, std::vector<unsigned char> const & metadata)
+{
+    CBalances minted;
+    auto res = DecodeMintTokenMsg(metadata, minted);
+    return res.ok ? ApplyMintToken(mnview, coins, tx, minted) : res;
+}
+
+Res ApplyUtxosToAccountTx(CCustomCSView & mnview, CTransaction const & tx, std::vector<unsigned char> const & metadata)
+{
+    CUtxosToAccountMessage msg;
+    auto res = DecodeUtxosToAccountMsg(tx, metadata, msg);
+    return res.ok ? ApplyUtxosToAccount(mnview, msg) : res;
+}
+
+Res ApplyAccountToUtxosTx(CCustomCSView & mnview, CCoinsViewCache const & coins, CTransaction const & tx, std::vector<unsigned char> const & metadata)
+{
+    CAccountToUtxosMessage msg;
+    auto res = DecodeAccountToUtxosMsg(metadata, msg);
+    return res.ok ? ApplyAccountToUtxos(mnview, coins, tx, msg) : res;
+}
+
+Res ApplyAccountToAccountTx(CCustomCSView & mnview, CCoinsViewCache const & coins, CTransaction const & tx, std::vector<unsigned char> const & metadata)
+{
+    CAccountToAccountMessage msg;
+    auto res = DecodeAccountToAccountMsg(metadata, msg);
+    return res.ok ? ApplyAccountToAccount(mnview, coins, tx, msg) : res;
+}
+
 bool IsMempooledCustomTxCreate(const CTxMemPool & pool, const uint256 & txid)
 {
     CTransactionRef ptx = pool.get(txid);
-    std::vector<unsigned char> dummy;
     if (ptx) {
-        CustomTxType txType = GuessCustomTxType(*ptx, dummy);
+        CustomTxType txType = GetCustomTx(*ptx).type;
         return txType == CustomTxType::CreateMasternode || txType == CustomTxType::CreateToken;
     }
     return false;
@@ -7,9 +7,12 @@
 
 #include <consensus/params.h>
 #include <masternodes/masternodes.h>
+#include <masternodes/balances.h>
 #include <vector>
 #include <cstring>
 
+#include <boost/variant.hpp>
+
 class CBlock;
 class CTransaction;
 class CTxMemPool;
@@ -47,6 +50,22 @@ enum class CustomTxType : unsigned char
     AccountToAccount  = 'B'
 };
 
+inline std::string ToString(CustomTxType type) {
+    switch (type)
+    {
+        case CustomTxType::CreateMasternode:    return "CreateMasternode";
+        case CustomTxType::ResignMasternode:    return "ResignMasternode";
+        case CustomTxType::CreateToken:         return "CreateToken";
+        case CustomTxType::MintToken:           return "MintToken";
+        case CustomTxType::DestroyToken:        return "DestroyToken";
+        case CustomTxType::UpdateToken:         return "UpdateToken";
+        case CustomTxType::UtxosToAccount:      return "UtxosToAccount";
+        case CustomTxType::AccountToUtxos:      return "AccountToUtxos";
+        case CustomTxType::AccountToAccount:    return "AccountToAccount";
+        default:                                return "None";
+    }
+}
+
 inline CustomTxType CustomTxCodeToType(unsigned char ch) {
     char const txtypes[] = "CRTMDNUbB";
     if (memchr(txtypes, ch, strlen(txtypes)))
@@ -73,11 +92,88 @@ inline void Unserialize(Stream& s, CustomTxType & txType) {
     txType = CustomTxCodeToType(ch);
 }
 
+struct CResignMasternodeMessage {
+    uint256 nodeId;
+};
+
+struct CDestroyTokenMessage {
+    uint256 tokenTx;
+};
+
+struct CUpdateTokenMessage {
+    uint256 tokenTx;
+    bool isDAT;
+};
+
+struct CCustomTxMessageNone {};
+
+using CCustomTxMessage = boost::variant<
+    CCustomTxMessageNone,
+    CMasternode,                // CreateMasternode
+    CResignMasternodeMessage,
+    CTokenImplementation,       // CreateToken
+    CDestroyTokenMessage,
+    CUpdateTokenMessage,
+    CBalances,                  // MintToken
+    CUtxosToAccountMessage,
+    CAccountToUtxosMessage,
+    CAccountToAccountMessage
+>;
+
+/*
+ * Type and deserialized message of the custom tx. It depends on the tx only, so it is parsed once and kept by
+ * the transaction itself (next to its hash): mempool, validation and miner don't parse the metadata again.
+ */
+struct CCustomTxParsed {
+    CustomTxType type = CustomTxType::None;
+    CCustomTxMessage msg;
+    Res res = Res::Ok();    // deserialization result
+    bool thrown = false;    // 'res' is an exception caught while deserializing
+};
+
+CCustomTxParsed const & GetCustomTx(CTransaction const & tx);
+
+/*
+ * Stateless part of the custom tx processing: type guess, metadata decoding and the checks which need the tx only.
+ * It doesn't touch any view, so ConnectBlock does it for the whole block ahead, on the script check threads.
+ */
+struct CDecodedCustomTx {
+    CustomTxType type = CustomTxType::None;
+    CCustomTxMessage msg;
+    Res res = Res::Ok(); // if not ok, the tx fails with it (as ApplyCustomTx would)
+};
+
+CDecodedCustomTx DecodeCustomTx(CTransaction const & tx, uint32_t height);
+
+// CCheckQueue job for DecodeCustomTx
+class CCustomTxDecodeCheck {
+public:
+    CCustomTxDecodeCheck() : ptx(nullptr), height(0), result(nullptr) {}
+    CCustomTxDecodeCheck(CTransaction const & tx, uint32_t heightIn, CDecodedCustomTx & resultIn) : ptx(&tx), height(heightIn), result(&resultIn) {}
+
+    bool operator()() {
+        *result = DecodeCustomTx(*ptx, height);
+        return true;
+    }
+
+    void swap(CCustomTxDecodeCheck & check) {
+        std::swap(ptx, check.ptx);
+        std::swap(height, check.height);
+        std::swap(result, check.result);
+    }
+
+private:
+    CTransaction const * ptx;
+    uint32_t height;
+    CDecodedCustomTx * result;
+};
+
 bool HasAuth(CTransaction const & tx, CKeyID const & auth);
 bool HasAuth(CTransaction const & tx, CCoinsViewCache const & coins, CScript const & auth);
 bool HasCollateralAuth(CTransaction const & tx, CCoinsViewCache const & coins, uint256 const & collateralTx);
 
-Res ApplyCustomTx(CCustomCSView & mnview, CCoinsViewCache const & coins, CTransaction const & tx, const Consensus::Params& consensusParams, uint32_t height, bool isCheck = true);
+// 'decoded' is the result of DecodeCustomTx(tx, height) if it was done ahead, otherwise it is done here
+Res ApplyCustomTx(CCustomCSView & mnview, CCoinsViewCache const & coins, CTransaction const & tx, const Consensus::Params& consensusParams, uint32_t height, bool isCheck = true, CDecodedCustomTx const * decoded = nullptr);
 //! Deep check (and write)
 Res ApplyCreateMasternodeTx(CCustomCSView & mnview, CTransaction const & tx, uint32_t height, std::vector<unsigned char> const & metadata);
 Res ApplyResignMasternodeTx(CCustomCSView & mnview, CCoinsViewCache const & coins, CTransaction const & tx, uint32_t height, std::vector<unsigned char> const & metadata);
@@ -142,6 +238,7 @@ inline boost::optional<std::vector<unsigned char>> GetAccountToUtxosMetadata(con
     return {};
 }
 
+// parses the metadata (not cached), for the code which doesn't link the node (wallet)
 inline boost::optional<CAccountToUtxosMessage> GetAccountToUtxosMsg(const CTransaction & tx)
 {
     const auto metadata = GetAccountToUtxosMetadata(tx);
@@ -161,9 +258,9 @@ inline boost::optional<CAccountToUtxosMessage> GetAccountToUtxosMsg(const CTrans
 inline TAmounts GetNonMintedValuesOut(const CTransaction & tx)
 {
     uint32_t mintingOutputsStart = std::numeric_limits<uint32_t>::max();
-    const auto accountToUtxos = GetAccountToUtxosMsg(tx);
-    if (accountToUtxos) {
-        mintingOutputsStart = accountToUtxos->mintingOutputsStart;
+    auto const & parsed = GetCustomTx(tx);
+    if (parsed.type == CustomTxType::AccountToUtxos && !parsed.thrown) { // the same as GetAccountToUtxosMsg(), but parsed once
+        mintingOutputsStart = boost::get<CAccountToUtxosMessage>(parsed.msg).mintingOutputsStart;
     }
     return tx.GetValuesOut(mintingOutputsStart);
 }
@@ -166,6 +166,29 @@ static CWallet* GetWallet(const JSONRPCRequest& request) {
     return pwallet;
 }
 
+// Custom state as of the current tip. cs_main is held only to take it, so listings don't block the chain
+static std::shared_ptr<CCustomCSSnapshot> GetSnapshot() {
+    LOCK(cs_main);
+    auto const tip = ::ChainActive().Tip();
+    return GetCustomCSSnapshot(tip->nHeight, tip->GetBlockHash());
+}
+
+static bool GetWithHeight(UniValue const & paginationObj) {
+    return !paginationObj["with_height"].isNull() && paginationObj["with_height"].getBool();
+}
+
+// wraps listing into {height, hash, items} of the state it reflects, if it was asked for
+static UniValue WithSnapshotHeight(UniValue const & items, CCustomCSSnapshot const & snapshot, bool withHeight) {
+    if (!withHeight) {
+        return items;
+    }
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("height", snapshot.GetHeight());
+    ret.pushKV("hash", snapshot.GetBlockHash().GetHex());
+    ret.pushKV("items", items);
+    return ret;
+}
+
 /*
  *
  *  Issued by: any
@@ -378,6 +401,8 @@ UniValue listmasternodes(const JSONRPCRequest& request) {
                                   "If true, then iterate including starting position. False by default"},
                                  {"limit", RPCArg::Type::NUM, RPCArg::Optional::OMITTED,
                                   "Maximum number of orders to return, 100 by default"},
+                                {"with_height", RPCArg::Type::BOOL, RPCArg::Optional::OMITTED,
+                                 "If true, the result is {\"height\",\"hash\",\"items\"}, where height and hash are of the block the listing reflects. False by default"},
                          },
                         },
                         {"verbose", RPCArg::Type::BOOL, RPCArg::Optional::OMITTED,
@@ -399,10 +424,12 @@ UniValue listmasternodes(const JSONRPCRequest& request) {
     // parse pagination
     size_t limit = 100;
     uint256 start = {};
+    bool withHeight = false;
     {
         if (request.params.size() > 0) {
             bool including_start = false;
             UniValue paginationObj = request.params[0].get_obj();
+            withHeight = GetWithHeight(paginationObj);
             if (!paginationObj["limit"].isNull()) {
                 limit = (size_t) paginationObj["limit"].get_int64();
             }
@@ -423,14 +450,14 @@ UniValue listmasternodes(const JSONRPCRequest& request) {
 
     UniValue ret(UniValue::VOBJ);
 
-    LOCK(cs_main);
-    pcustomcsview->ForEachMasternode([&](uint256 const& nodeId, CMasternode& node) {
+    auto const snapshot = GetSnapshot();
+    snapshot->View().ForEachMasternode([&](uint256 const& nodeId, CMasternode& node) {
         ret.pushKVs(mnToJSON(nodeId, node, verbose));
         limit--;
         return limit != 0;
     }, start);
 
-    return ret;
+    return WithSnapshotHeight(ret, *snapshot, withHeight);
 }
 
 UniValue getmasternode(const JSONRPCRequest& request) {
@@ -458,6 +485,103 @@ UniValue getmasternode(const JSONRPCRequest& request) {
     throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Masternode not found");
 }
 
+UniValue getcustomcscacheinfo(const JSONRPCRequest& request) {
+    RPCHelpMan{"getcustomcscacheinfo",
+               "\nReturns statistics of the decoded masternodes/tokens/balances cache (see -customcsreadcache).\n",
+               {
+               },
+               RPCResult{
+                       "{\n"
+                       "  \"enabled\" : true|false,     (boolean) Whether the cache is attached\n"
+                       "  \"entries\" : n,              (numeric) Current number of cached entries\n"
+                       "  \"maxentries\" : n,           (numeric) Maximum number of cached entries\n"
+                       "  \"hits\" : n,                 (numeric) Lookups served from the cache\n"
+                       "  \"misses\" : n,               (numeric) Lookups that went to the storage\n"
+                       "  \"hitrate\" : x.xxx,          (numeric) hits / (hits + misses)\n"
+                       "  \"invalidations\" : n,        (numeric) Entries dropped due to writes/erasures\n"
+                       "  \"evictions\" : n,            (numeric) Entries dropped due to the size limit\n"
+                       "  \"pendingchanges\" : n,       (numeric) Changes buffered in memory since the last flush to disk\n"
+                       "  \"pendingusage\" : n          (numeric) Bytes held by the buffered changes, counted toward -dbcache\n"
+                       "}\n"
+               },
+               RPCExamples{
+                       HelpExampleCli("getcustomcscacheinfo", "")
+                       + HelpExampleRpc("getcustomcscacheinfo", "")
+               },
+    }.Check(request);
+
+    LOCK(cs_main);
+    auto stats = pcustomcsview->GetReadCacheStats();
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("enabled", static_cast<bool>(stats));
+    if (stats) {
+        uint64_t const lookups = stats->hits + stats->misses;
+        ret.pushKV("entries", (uint64_t) stats->entries);
+        ret.pushKV("maxentries", (uint64_t) stats->maxEntries);
+        ret.pushKV("hits", stats->hits);
+        ret.pushKV("misses", stats->misses);
+        ret.pushKV("hitrate", lookups ? (double) stats->hits / lookups : 0.);
+        ret.pushKV("invalidations", stats->invalidations);
+        ret.pushKV("evictions", stats->evictions);
+    }
+    ret.pushKV("pendingchanges", (uint64_t) pcustomcsview->GetPendingChanges());
+    ret.pushKV("pendingusage", (uint64_t) pcustomcsview->DynamicMemoryUsage());
+    return ret;
+}
+
+UniValue compactcustomundos(const JSONRPCRequest& request) {
+    RPCHelpMan{"compactcustomundos",
+               "\nPrunes undo data of masternodes/tokens/accounts changes deeper than 'depth' blocks below the tip at once,\n"
+               "flushes the state and compacts the undos table on disk. Blocks below the pruned height can't be disconnected.\n",
+               {
+                       {"depth", RPCArg::Type::NUM, RPCArg::Optional::OMITTED,
+                        strprintf("Number of blocks below the tip to keep undos for (default: -customundodepth, or %d if it keeps all)", MIN_BLOCKS_TO_KEEP)},
+               },
+               RPCResult{
+                       "{\n"
+                       "  \"pruned\" : n,          (numeric) Number of erased undo records\n"
+                       "  \"prunedheight\" : n,    (numeric) Blocks below this height can't be disconnected anymore\n"
+                       "  \"size_on_disk\" : n     (numeric) Estimated size of the undos table after compaction\n"
+                       "}\n"
+               },
+               RPCExamples{
+                       HelpExampleCli("compactcustomundos", "1000")
+                       + HelpExampleRpc("compactcustomundos", "1000")
+               },
+    }.Check(request);
+
+    // 0 (keep all) isn't a depth to prune at, default to the minimum one then
+    int depth = nCustomUndoDepth > 0 ? nCustomUndoDepth : (int) MIN_BLOCKS_TO_KEEP;
+    if (!request.params[0].isNull()) {
+        depth = request.params[0].get_int();
+    }
+    if (depth < (int) MIN_BLOCKS_TO_KEEP) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Depth should be at least %d blocks", MIN_BLOCKS_TO_KEEP));
+    }
+
+    size_t pruned = 0;
+    uint32_t prunedHeight = 0;
+    {
+        LOCK(cs_main);
+        int const height = ::ChainActive().Height();
+        if (height > depth) {
+            pruned = pcustomcsview->PruneUndos(height - depth, std::numeric_limits<size_t>::max());
+        }
+        prunedHeight = pcustomcsview->GetUndosPrunedHeight();
+        ::ChainstateActive().ForceFlushStateToDisk();
+    }
+    // compaction may take a while, it doesn't need cs_main
+    auto const range = CUndosView::GetUndosKeyRange();
+    pcustomcsDB->Compact(range.first, range.second);
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("pruned", (uint64_t) pruned);
+    ret.pushKV("prunedheight", (uint64_t) prunedHeight);
+    ret.pushKV("size_on_disk", (uint64_t) pcustomcsDB->EstimateSize(range.first, range.second));
+    return ret;
+}
+
 UniValue listcriminalproofs(const JSONRPCRequest& request) {
     RPCHelpMan{"listcriminalproofs",
                "\nReturns information about criminal proofs (pairs of signed blocks by one MN from different forks).\n",
@@ -903,6 +1027,8 @@ UniValue listtokens(const JSONRPCRequest& request) {
                                   "If true, then iterate including starting position. False by default"},
                                  {"limit", RPCArg::Type::NUM, RPCArg::Optional::OMITTED,
                                   "Maximum number of tokens to return, 100 by default"},
+                                {"with_height", RPCArg::Type::BOOL, RPCArg::Optional::OMITTED,
+                                 "If true, the result is {\"height\",\"hash\",\"items\"}, where height and hash are of the block the listing reflects. False by default"},
                             },
                         },
                         {"verbose", RPCArg::Type::BOOL, RPCArg::Optional::OMITTED,
@@ -925,10 +1051,12 @@ UniValue listtokens(const JSONRPCRequest& request) {
     // parse pagination
     size_t limit = 100;
     DCT_ID start{0};
+    bool withHeight = false;
     {
         if (request.params.size() > 0) {
             bool including_start = false;
             UniValue paginationObj = request.params[0].get_obj();
+            withHeight = GetWithHeight(paginationObj);
             if (!paginationObj["limit"].isNull()) {
                 limit = (size_t) paginationObj["limit"].get_int64();
             }
@@ -947,17 +1075,17 @@ UniValue listtokens(const JSONRPCRequest& request) {
         }
     }
 
-    LOCK(cs_main);
+    auto const snapshot = GetSnapshot();
 
     UniValue ret(UniValue::VOBJ);
-    pcustomcsview->ForEachToken([&](DCT_ID const& id, CToken const& token) {
+    snapshot->View().ForEachToken([&](DCT_ID const& id, CToken const& token) {
         ret.pushKVs(tokenToJSON(id, token, verbose));
 
         limit--;
         return limit != 0;
     }, start);
 
-    return ret;
+    return WithSnapshotHeight(ret, *snapshot, withHeight);
 }
 
 UniValue gettoken(const JSONRPCRequest& request) {
@@ -986,6 +1114,120 @@ UniValue gettoken(const JSONRPCRequest& request) {
     throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Token not found");
 }
 
+UniValue listtokenholders(const JSONRPCRequest& request) {
+    RPCHelpMan{"listtokenholders",
+               "\nReturns accounts holding specified token, with their balances.\n",
+               {
+                       {"key", RPCArg::Type::STR, RPCArg::Optional::NO,
+                        "One of the keys may be specified (id/symbol/creationTx)"},
+                       {"pagination", RPCArg::Type::OBJ, RPCArg::Optional::OMITTED, "",
+                        {
+                                {"start", RPCArg::Type::STR, RPCArg::Optional::OMITTED,
+                                 "Optional first owner to iterate from, in lexicographical order."
+                                 "Typically it's set to last owner from previous request."},
+                                {"including_start", RPCArg::Type::BOOL, RPCArg::Optional::OMITTED,
+                                 "If true, then iterate including starting position. False by default"},
+                                {"limit", RPCArg::Type::NUM, RPCArg::Optional::OMITTED,
+                                 "Maximum number of holders to return, 100 by default"},
+                                {"with_height", RPCArg::Type::BOOL, RPCArg::Optional::OMITTED,
+                                 "If true, the result is {\"height\",\"hash\",\"items\"}, where height and hash are of the block the listing reflects. False by default"},
+                        },
+                       },
+               },
+               RPCResult{
+                       "{owner:amount,...}     (object) Json object with holders' balances\n"
+               },
+               RPCExamples{
+                       HelpExampleCli("listtokenholders", "GOLD")
+                       + HelpExampleRpc("listtokenholders", "GOLD")
+               },
+    }.Check(request);
+
+    // parse pagination
+    size_t limit = 100;
+    CScript start = {};
+    bool including_start = false;
+    bool withHeight = false;
+    {
+        if (request.params.size() > 1) {
+            UniValue paginationObj = request.params[1].get_obj();
+            withHeight = GetWithHeight(paginationObj);
+            if (!paginationObj["limit"].isNull()) {
+                limit = (size_t) paginationObj["limit"].get_int64();
+            }
+            if (!paginationObj["start"].isNull()) {
+                start = DecodeScript(paginationObj["start"].get_str());
+            }
+            if (!paginationObj["including_start"].isNull()) {
+                including_start = paginationObj["including_start"].getBool();
+            }
+        }
+        if (limit == 0) {
+            limit = std::numeric_limits<decltype(limit)>::max();
+        }
+    }
+
+    auto const snapshot = GetSnapshot();
+    auto & view = snapshot->View();
+
+    DCT_ID id;
+    auto token = view.GetTokenGuessId(request.params[0].getValStr(), id);
+    if (!token) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Token not found");
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    view.ForEachTokenHolder(id, [&](CScript const & owner, CAmount amount) {
+        if (!including_start && !start.empty() && owner == start) {
+            return true;
+        }
+        ret.pushKV(ScriptToString(owner), ValueFromAmount(amount));
+
+        limit--;
+        return limit != 0;
+    }, start);
+    return WithSnapshotHeight(ret, *snapshot, withHeight);
+}
+
+UniValue gettokensupply(const JSONRPCRequest& request) {
+    RPCHelpMan{"gettokensupply",
+               "\nReturns number of holders and total amount of the token on accounts.\n",
+               {
+                       {"key", RPCArg::Type::STR, RPCArg::Optional::NO,
+                        "One of the keys may be specified (id/symbol/creationTx)"},
+               },
+               RPCResult{
+                       "{\n"
+                       "  \"id\" : n,         (numeric) Token id\n"
+                       "  \"holders\" : n,    (numeric) Number of accounts with non-zero balance\n"
+                       "  \"supply\" : x.xxx, (numeric) Sum of accounts' balances\n"
+                       "  \"height\" : n      (numeric) Height of the block the numbers are for\n"
+                       "}\n"
+               },
+               RPCExamples{
+                       HelpExampleCli("gettokensupply", "GOLD")
+                       + HelpExampleRpc("gettokensupply", "GOLD")
+               },
+    }.Check(request);
+
+    // point lookup, no need to take the snapshot
+    LOCK(cs_main);
+
+    DCT_ID id;
+    auto token = pcustomcsview->GetTokenGuessId(request.params[0].getValStr(), id);
+    if (!token) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Token not found");
+    }
+    auto const supply = pcustomcsview->GetTokenSupply(id);
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("id", (uint64_t) id.v);
+    ret.pushKV("holders", supply.holders);
+    ret.pushKV("supply", ValueFromAmount(supply.supply));
+    ret.pushKV("height", ::ChainActive().Height());
+    return ret;
+}
+
 UniValue minttokens(const JSONRPCRequest& request) {
     CWallet* const pwallet = GetWallet(request);
 
@@ -1150,6 +1392,8 @@ UniValue listaccounts(const JSONRPCRequest& request) {
                                  "If true, then iterate including starting position. False by default"},
                                 {"limit", RPCArg::Type::NUM, RPCArg::Optional::OMITTED,
                                  "Maximum number of orders to return, 100 by default"},
+                                {"with_height", RPCArg::Type::BOOL, RPCArg::Optional::OMITTED,
+                                 "If true, the result is {\"height\",\"hash\",\"items\"}, where height and hash are of the block the listing reflects. False by default"},
                         },
                        },
                        {"verbose", RPCArg::Type::BOOL, RPCArg::Optional::OMITTED,
@@ -1172,10 +1416,12 @@ UniValue listaccounts(const JSONRPCRequest& request) {
     // parse pagination
     size_t limit = 100;
     BalanceKey start = {};
+    bool withHeight = false;
     {
         if (request.params.size() > 0) {
             bool including_start = false;
             UniValue paginationObj = request.params[0].get_obj();
+            withHeight = GetWithHeight(paginationObj);
             if (!paginationObj["limit"].isNull()) {
                 limit = (size_t) paginationObj["limit"].get_int64();
             }
@@ -1205,15 +1451,15 @@ UniValue listaccounts(const JSONRPCRequest& request) {
 
     UniValue ret(UniValue::VARR);
 
-    LOCK(cs_main);
-    pcustomcsview->ForEachBalance([&](CScript const & owner, CTokenAmount const & balance) {
+    auto const snapshot = GetSnapshot();
+    snapshot->View().ForEachBalance([&](CScript const & owner, CTokenAmount const & balance) {
         ret.push_back(accountToJSON(owner, balance, verbose, indexed_amounts));
 
         limit--;
         return limit != 0;
     }, start);
 
-    return ret;
+    return WithSnapshotHeight(ret, *snapshot, withHeight);
 }
 
 UniValue getaccount(const JSONRPCRequest& request) {
@@ -1231,6 +1477,8 @@ UniValue getaccount(const JSONRPCRequest& request) {
                                  "If true, then iterate including starting position. False by default"},
                                 {"limit", RPCArg::Type::NUM, RPCArg::Optional::OMITTED,
                                  "Maximum number of orders to return, 100 by default"},
+                                {"with_height", RPCArg::Type::BOOL, RPCArg::Optional::OMITTED,
+                                 "If true, the result is {\"height\",\"hash\",\"items\"}, where height and hash are of the block the listing reflects. False by default"},
                         },
                        },
                        {"indexed_amounts", RPCArg::Type::BOOL, RPCArg::Optional::OMITTED,
@@ -1250,10 +1498,12 @@ UniValue getaccount(const JSONRPCRequest& request) {
     // parse pagination
     size_t limit = 100;
     DCT_ID start = {};
+    bool withHeight = false;
     {
         if (request.params.size() > 1) {
             bool including_start = false;
             UniValue paginationObj = request.params[1].get_obj();
+            withHeight = GetWithHeight(paginationObj);
             if (!paginationObj["limit"].isNull()) {
                 limit = (size_t) paginationObj["limit"].get_int64();
             }
@@ -1281,8 +1531,8 @@ UniValue getaccount(const JSONRPCRequest& request) {
         ret.setObject();
     }
 
-    LOCK(cs_main);
-    pcustomcsview->ForEachBalance([&](CScript const & owner, CTokenAmount const & balance) {
+    auto const snapshot = GetSnapshot();
+    snapshot->View().ForEachBalance([&](CScript const & owner, CTokenAmount const & balance) {
         if (owner != reqOwner) {
             return false;
         }
@@ -1295,7 +1545,7 @@ UniValue getaccount(const JSONRPCRequest& request) {
         limit--;
         return limit != 0;
     }, BalanceKey{reqOwner, start});
-    return ret;
+    return WithSnapshotHeight(ret, *snapshot, withHeight);
 }
 
 UniValue utxostoaccount(const JSONRPCRequest& request) {
@@ -1591,12 +1841,16 @@ static const CRPCCommand commands[] =
     {"masternodes", "listmasternodes",    &listmasternodes,    {"pagination", "verbose"}},
     {"masternodes", "getmasternode",      &getmasternode,      {"mn_id"}},
     {"masternodes", "listcriminalproofs", &listcriminalproofs, {}},
+    {"masternodes", "getcustomcscacheinfo", &getcustomcscacheinfo, {}},
+    {"masternodes", "compactcustomundos", &compactcustomundos, {"depth"}},
     {"tokens",      "createtoken",        &createtoken,        {"inputs", "metadata"}},
     {"tokens",      "destroytoken",       &destroytoken,       {"inputs", "token"}},
     {"tokens",      "updatetoken",        &updatetoken,        {"inputs", "metadata"}},
     {"tokens",      "listtokens",         &listtokens,         {"pagination", "verbose"}},
     {"tokens",      "gettoken",           &gettoken,           {"key" }},
     {"tokens",      "minttokens",         &minttokens,         {"inputs", "amounts"}},
+    {"tokens",      "listtokenholders",   &listtokenholders,   {"key", "pagination"}},
+    {"tokens",      "gettokensupply",     &gettokensupply,     {"key"}},
     {"accounts",    "listaccounts",       &listaccounts,       {"pagination", "verbose"}},
     {"accounts",    "getaccount",         &getaccount,         {"owner", "pagination"}},
     {"accounts",    "utxostoaccount",     &utxostoaccount,     {"inputs", "amounts"}},
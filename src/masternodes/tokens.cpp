@@ -30,7 +30,7 @@ std::string trim_ws(std::string const & str)
 
 std::unique_ptr<CToken> CTokensView::GetToken(DCT_ID id) const
 {
-    auto tokenImpl = ReadBy<ID, CTokenImpl>(WrapVarInt(id.v)); // @todo change serialization of DCT_ID to VarInt by default?
+    auto tokenImpl = ReadCachedBy<ID, CTokenImpl>(WrapVarInt(id.v)); // @todo change serialization of DCT_ID to VarInt by default?
     if (tokenImpl)
         return MakeUnique<CTokenImpl>(*tokenImpl);
 
@@ -53,7 +53,7 @@ boost::optional<std::pair<DCT_ID, CTokensView::CTokenImpl> > CTokensView::GetTok
     DCT_ID id;
     auto varint = WrapVarInt(id.v);
     if (ReadBy<CreationTx, uint256>(txid, varint)) {
-        auto tokenImpl = ReadBy<ID, CTokenImpl>(varint);
+        auto tokenImpl = ReadCachedBy<ID, CTokenImpl>(varint);
         if (tokenImpl)
             return { std::make_pair(id, std::move(*tokenImpl))};
     }
@@ -28,10 +28,10 @@ struct UndoKey {
 struct CUndo {
     std::map<TBytes, boost::optional<TBytes>> before;
 
-    static CUndo Construct(CStorageKV const & before, MapKV const & diff) {
+    static CUndo Construct(CStorageKV const & before, CKVWriteBuffer const & diff) {
         CUndo result;
         for (const auto & kv : diff) {
-            const auto& beforeKey = kv.first;
+            const TBytes beforeKey(kv.first.begin(), kv.first.end());
             TBytes beforeVal;
             if (before.Read(beforeKey, beforeVal)) {
                 result.before[beforeKey] = std::move(beforeVal);
@@ -7,6 +7,8 @@
 /// @attention make sure that it does not overlap with those in masternodes.cpp/tokens.cpp/undos.cpp/accounts.cpp !!!
 const unsigned char CUndosView::ByUndoKey::prefix = 'u';
 
+const unsigned char DB_UNDOS_PRUNED_HEIGHT = 'P'; // single record
+
 void CUndosView::ForEachUndo(std::function<bool(UndoKey key, CUndo const & Undo)> callback, UndoKey start) const
 {
     ForEach<ByUndoKey, UndoKey, CUndo>([&callback] (UndoKey const & key, CUndo const & val) {
@@ -35,3 +37,45 @@ boost::optional<CUndo> CUndosView::GetUndo(UndoKey key) const
     }
     return {};
 }
+
+size_t CUndosView::PruneUndos(uint32_t belowHeight, size_t limit)
+{
+    // keys only, undos themselves are not decoded
+    std::vector<TBytes> keys;
+    // start past the erased ones, seeking over their tombstones gets slower with every prune until compaction.
+    // the height below the pruned one may be erased partially (the batch may stop in the middle of the height)
+    uint32_t const prunedHeight = GetUndosPrunedHeight();
+    auto key = std::make_pair(ByUndoKey::prefix, UndoKey{prunedHeight > 0 ? prunedHeight - 1 : 0, uint256()});
+    auto it = DB().NewIterator();
+    for (it->Seek(DbTypeToBytes(key)); it->Valid() && keys.size() < limit; it->Next()) {
+        SliceToDbType(it->KeySlice(), key);
+        if (key.first != ByUndoKey::prefix || key.second.height >= belowHeight) {
+            break;
+        }
+        keys.push_back(it->Key());
+    }
+    if (keys.empty()) {
+        return 0;
+    }
+    for (auto const & undoKey : keys) {
+        DB().Erase(undoKey);
+    }
+    // iteration is in height order, so all the undos below the last erased height are gone
+    BytesToDbType(keys.back(), key);
+    if (key.second.height + 1 > prunedHeight) {
+        Write(DB_UNDOS_PRUNED_HEIGHT, key.second.height + 1);
+    }
+    return keys.size();
+}
+
+std::pair<TBytes, TBytes> CUndosView::GetUndosKeyRange()
+{
+    return {TBytes{ByUndoKey::prefix}, TBytes{static_cast<unsigned char>(ByUndoKey::prefix + 1)}};
+}
+
+uint32_t CUndosView::GetUndosPrunedHeight() const
+{
+    uint32_t result = 0;
+    Read(DB_UNDOS_PRUNED_HEIGHT, result);
+    return result;
+}
@@ -17,6 +17,13 @@ public:
     Res SetUndo(UndoKey key, CUndo const & undo);
     Res DelUndo(UndoKey key);
 
+    // erases up to 'limit' oldest undos of heights below 'belowHeight', returns number of erased records
+    size_t PruneUndos(uint32_t belowHeight, size_t limit);
+    // blocks below this height have (partially) pruned undos and can't be disconnected
+    uint32_t GetUndosPrunedHeight() const;
+    // [begin, end) raw keys range of the undos table, for size estimation and compaction
+    static std::pair<TBytes, TBytes> GetUndosKeyRange();
+
     // tags
     struct ByUndoKey { static const unsigned char prefix; };
 };
@@ -89,12 +89,15 @@ void BlockAssembler::resetBlock()
     // These counters do not include coinbase tx
     nBlockTx = 0;
     nFees = 0;
+    customTxsFailed.clear();
 }
 
 Optional<int64_t> BlockAssembler::m_last_block_num_txs{nullopt};
 Optional<int64_t> BlockAssembler::m_last_block_weight{nullopt};
+Optional<int64_t> BlockAssembler::m_last_block_build_time{nullopt};
+std::map<CustomTxType, int64_t> BlockAssembler::m_last_block_skipped_custom_txs;
 
-std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& scriptPubKeyIn)
+std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& scriptPubKeyIn, const CKeyID& minterOperator)
 {
     int64_t nTimeStart = GetTimeMicros();
 
@@ -113,7 +116,12 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
 
     LOCK2(cs_main, mempool.cs);
     // in fact, this may be redundant cause it was checked upthere in the miner
-    auto myIDs = pcustomcsview->AmIOperator();
+    boost::optional<std::pair<CKeyID, uint256>> myIDs;
+    if (minterOperator.IsNull()) {
+        myIDs = pcustomcsview->AmIOperator();
+    } else if (auto nodeId = pcustomcsview->GetMasternodeIdByOperator(minterOperator)) {
+        myIDs = std::make_pair(minterOperator, *nodeId);
+    }
     if (!myIDs)
         return nullptr;
     auto nodePtr = pcustomcsview->GetMasternode(myIDs->second);
@@ -224,12 +232,22 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
 
     int nPackagesSelected = 0;
     int nDescendantsUpdated = 0;
-    addPackageTxs(nPackagesSelected, nDescendantsUpdated);
+    {
+        // custom txs are applied in the block order as they are selected, to the scratch view which is dropped then
+        CCustomCSView mnview(*pcustomcsview);
+        addPackageTxs(nPackagesSelected, nDescendantsUpdated, mnview);
+    }
 
     int64_t nTime1 = GetTimeMicros();
 
     m_last_block_num_txs = nBlockTx;
     m_last_block_weight = nBlockWeight;
+    m_last_block_skipped_custom_txs.clear();
+    for (CTxMemPool::txiter it : customTxsFailed) {
+        if (!inBlock.count(it)) {
+            ++m_last_block_skipped_custom_txs[GetCustomTx(it->GetTx()).type];
+        }
+    }
 
     // Create coinbase transaction.
     CMutableTransaction coinbaseTx;
@@ -273,6 +291,7 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
         throw std::runtime_error(strprintf("%s: TestBlockValidity failed: %s", __func__, FormatStateMessage(state)));
     }
     int64_t nTime2 = GetTimeMicros();
+    m_last_block_build_time = nTime2 - nTimeStart;
 
     LogPrint(BCLog::BENCH, "CreateNewBlock() packages: %.2fms (%d packages, %d updated descendants), validity: %.2fms (total %.2fms)\n", 0.001 * (nTime1 - nTimeStart), nPackagesSelected, nDescendantsUpdated, 0.001 * (nTime2 - nTime1), 0.001 * (nTime2 - nTimeStart));
 
@@ -317,6 +336,25 @@ bool BlockAssembler::TestPackageTransactions(const CTxMemPool::setEntries& packa
     return true;
 }
 
+bool BlockAssembler::TestPackageCustomTxs(const std::vector<CTxMemPool::txiter>& sortedEntries, CCustomCSView& mnview, const CCoinsViewCache& coins)
+{
+    CCustomCSView packageView(mnview);
+    for (CTxMemPool::txiter it : sortedEntries) {
+        const CTransaction& tx = it->GetTx();
+        if (GetCustomTx(tx).type == CustomTxType::None) {
+            continue;
+        }
+        const auto res = ApplyCustomTx(packageView, coins, tx, chainparams.GetConsensus(), nHeight, false);
+        if (!res.ok) {
+            LogPrint(BCLog::MEMPOOL, "%s: skipping custom tx %s: %s\n", __func__, tx.GetHash().ToString(), res.msg);
+            customTxsFailed.insert(it);
+            return false;
+        }
+    }
+    packageView.Flush();
+    return true;
+}
+
 void BlockAssembler::AddToBlock(CTxMemPool::txiter iter)
 {
     pblock->vtx.emplace_back(iter->GetSharedTx());
@@ -399,8 +437,12 @@ void BlockAssembler::SortForBlock(const CTxMemPool::setEntries& package, std::ve
 // Each time through the loop, we compare the best transaction in
 // mapModifiedTxs with the next transaction in the mempool to decide what
 // transaction package to work on next.
-void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpdated)
+void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpdated, CCustomCSView &mnview)
 {
+    // inputs of the custom txs (for auth) may come from the mempool parents
+    CCoinsViewMemPool viewMemPool(&::ChainstateActive().CoinsTip(), mempool);
+    CCoinsViewCache coins(&viewMemPool);
+
     // mapModifiedTx will store sorted packages after they are modified
     // because some of their txs are already in the block
     indexed_modified_transaction_set mapModifiedTx;
@@ -509,12 +551,22 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
             continue;
         }
 
+        // Sort the entries in a valid order, custom txs are applied in it
+        std::vector<CTxMemPool::txiter> sortedEntries;
+        SortForBlock(ancestors, sortedEntries);
+
+        if (!TestPackageCustomTxs(sortedEntries, mnview, coins)) {
+            if (fUsingModified) {
+                mapModifiedTx.get<ancestor_score>().erase(modit);
+                failedTx.insert(iter);
+            }
+            continue;
+        }
+
         // This transaction will make it in; reset the failed counter.
         nConsecutiveFailed = 0;
 
-        // Package can be added. Sort the entries in a valid order.
-        std::vector<CTxMemPool::txiter> sortedEntries;
-        SortForBlock(ancestors, sortedEntries);
+        // Package can be added.
 
         for (size_t i=0; i<sortedEntries.size(); ++i) {
             AddToBlock(sortedEntries[i]);
@@ -549,6 +601,46 @@ void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned
 }
 
 namespace pos {
+    CStakingStats stakingStats;
+
+    void CStakingStats::AddAttempts(uint256 const & masternodeID, uint64_t attempts, int64_t time) {
+        LOCK(cs);
+        auto& s = stats[masternodeID];
+        s.attempts += attempts;
+        s.lastAttemptTime = time;
+    }
+
+    void CStakingStats::AddKernel(uint256 const & masternodeID) {
+        LOCK(cs);
+        ++stats[masternodeID].kernels;
+    }
+
+    void CStakingStats::AddMinted(uint256 const & masternodeID) {
+        LOCK(cs);
+        ++stats[masternodeID].minted;
+    }
+
+    void CStakingStats::AddCriminalWait(uint256 const & masternodeID) {
+        LOCK(cs);
+        ++stats[masternodeID].criminalWaits;
+    }
+
+    void CStakingStats::AddSearch(uint64_t evaluations, int64_t micros) {
+        LOCK(cs);
+        searchEvaluations += evaluations;
+        searchMicros += micros;
+    }
+
+    double CStakingStats::GetKernelRate() const {
+        LOCK(cs);
+        return searchMicros > 0 ? searchEvaluations * 1000000.0 / searchMicros : 0.0;
+    }
+
+    std::map<uint256, StakingStats> CStakingStats::Get() const {
+        LOCK(cs);
+        return stats;
+    }
+
     Staker::Status Staker::stake(CChainParams chainparams, const ThreadStaker::Args& args) {
         if (!chainparams.GetConsensus().pos.allowMintingWithoutPeers) {
             if(!g_connman)
@@ -578,40 +670,99 @@ namespace pos {
         bool minted = false;
         bool potentialCriminalBlock = false;
 
-        CBlockIndex* tip = getTip();
+        // masternodes which are able to stake on top of this tip
+        struct Candidate {
+            ThreadStaker::MasternodeArgs const * mn;
+            CKeyID operatorID;
+            uint32_t mintedBlocks;
+            uint256 stakeModifier;
+            pos::CKernelSearch kernel;
+            uint64_t attempts;
+        };
+        std::vector<Candidate> candidates;
+        CBlockIndex* tip;
+        uint32_t nBits;
 
         // this part of code stay valid until tip got changed
-        /// @todo is 'tip' can be changed here? is it possible to pull 'getTip()' and mnview access to the upper (calling 'stake()') block?
-        uint32_t mintedBlocks(0);
         {
             LOCK(cs_main);
-            auto nodePtr = pcustomcsview->GetMasternode(args.masternodeID);
-            if (!nodePtr || !nodePtr->IsActive(tip->height)) /// @todo miner: height+1 or nHeight+1 ???
-            {
-                /// @todo may be new status for not activated (or already resigned) MN??
-                return Status::initWaiting;
-            }
-            mintedBlocks = nodePtr->mintedBlocks;
-        }
+            tip = ::ChainActive().Tip();
 
-        withSearchInterval([&](int64_t coinstakeTime, int64_t nSearchInterval) {
-            if (fCriminals) {
-                std::map <uint256, CBlockHeader> blockHeaders{};
+            // the same work as CreateNewBlock will require, so the template is built only when a kernel is found
+            CBlockHeader header;
+            header.nTime = std::max(tip->GetMedianTimePast() + 1, GetAdjustedTime());
+            nBits = pos::GetNextWorkRequired(tip, &header, chainparams.GetConsensus().pos);
+
+            for (auto const & mn : args.masternodes) {
+                auto nodePtr = pcustomcsview->GetMasternode(mn.masternodeID);
+                if (!nodePtr || !nodePtr->IsActive(tip->height)) /// @todo miner: height+1 or nHeight+1 ???
                 {
-                    LOCK(cs_main);
-                    pcriminals->FetchMintedHeaders(args.masternodeID, mintedBlocks + 1, blockHeaders, fIsFakeNet);
+                    /// @todo may be new status for not activated (or already resigned) MN??
+                    continue;
                 }
-                for (std::pair <uint256, CBlockHeader> const & blockHeader : blockHeaders) {
-                    if (IsDoubleSignRestricted(blockHeader.second.height, tip->nHeight + (uint64_t)1)) {
+                if (fCriminals) {
+                    std::map <uint256, CBlockHeader> blockHeaders{};
+                    pcriminals->FetchMintedHeaders(mn.masternodeID, nodePtr->mintedBlocks + 1, blockHeaders, fIsFakeNet);
+                    bool restricted = false;
+                    for (auto const & blockHeader : blockHeaders) {
+                        if (IsDoubleSignRestricted(blockHeader.second.height, tip->nHeight + (uint64_t)1)) {
+                            restricted = true;
+                            break;
+                        }
+                    }
+                    if (restricted) {
                         potentialCriminalBlock = true;
-                        return;
+                        stakingStats.AddCriminalWait(mn.masternodeID);
+                        continue;
+                    }
+                }
+                CKeyID const operatorID = mn.minterKey.GetPubKey().GetID();
+                uint256 const stakeModifier = pos::ComputeStakeModifier(tip->stakeModifier, operatorID);
+                candidates.push_back({&mn, operatorID, nodePtr->mintedBlocks, stakeModifier, pos::CKernelSearch(stakeModifier, nBits, mn.masternodeID), 0});
+            }
+        }
+
+        if (candidates.empty()) {
+            return potentialCriminalBlock ? Status::criminalWaiting : Status::initWaiting;
+        }
+
+        withSearchInterval([&](int64_t coinstakeTime, int64_t nSearchInterval) {
+            //
+            // Find matching hash: all masternodes against each timestamp of the window, latest first
+            //
+            Candidate* found = nullptr;
+            uint32_t foundTime = 0;
+            uint64_t evaluated = 0;
+            int64_t const searchStart = GetTimeMicros();
+            for (uint32_t t = 0; t < nSearchInterval && !found; t++) {
+                boost::this_thread::interruption_point();
+
+                uint32_t const nTime = ((uint32_t)coinstakeTime - t);
+                for (auto& candidate : candidates) {
+                    ++candidate.attempts;
+                    ++evaluated;
+                    if (candidate.kernel.Check((int64_t) nTime)) {
+                        found = &candidate;
+                        foundTime = nTime;
+                        break;
                     }
                 }
             }
+
+            stakingStats.AddSearch(evaluated, GetTimeMicros() - searchStart);
+            for (auto const & candidate : candidates) {
+                stakingStats.AddAttempts(candidate.mn->masternodeID, candidate.attempts, coinstakeTime);
+            }
+            if (!found) {
+                return;
+            }
+            LogPrint(BCLog::STAKING, "MakeStake: kernel found for masternode %s\n", found->mn->masternodeID.GetHex());
+            stakingStats.AddKernel(found->mn->masternodeID);
+
             //
             // Create block template
             //
-            std::unique_ptr<CBlockTemplate> pblocktemplate(BlockAssembler(chainparams).CreateNewBlock(args.coinbaseScript));
+            std::unique_ptr<CBlockTemplate> pblocktemplate(BlockAssembler(chainparams).CreateNewBlock(found->mn->coinbaseScript, found->operatorID));
             if (!pblocktemplate.get()) {
                 throw std::runtime_error("Error in WalletStaker: Keypool ran out, please call keypoolrefill before restarting the staking thread");
             }
@@ -620,33 +771,21 @@ namespace pos {
             LogPrint(BCLog::STAKING, "Running Staker with %u common transactions in block (%u bytes)\n", pblock->vtx.size() - 1,
                      ::GetSerializeSize(*pblock, PROTOCOL_VERSION));
 
-            // find matching Hash
             pblock->height = tip->nHeight + 1;
-            pblock->mintedBlocks = mintedBlocks + 1;
-            pblock->stakeModifier = pos::ComputeStakeModifier(tip->stakeModifier, args.minterKey.GetPubKey().GetID());
+            pblock->mintedBlocks = found->mintedBlocks + 1;
+            pblock->stakeModifier = found->stakeModifier;
+            pblock->nTime = foundTime;
 
-            bool found = false;
-            for (uint32_t t = 0; t < nSearchInterval; t++) {
-                boost::this_thread::interruption_point();
-
-                pblock->nTime = ((uint32_t)coinstakeTime - t);
-
-                if (pos::CheckKernelHash(pblock->stakeModifier, pblock->nBits,  (int64_t) pblock->nTime, chainparams.GetConsensus(), args.masternodeID).hashOk) {
-                    LogPrint(BCLog::STAKING, "MakeStake: kernel found\n");
-
-                    found = true;
-                    break;
-                }
-            }
-
-            if (!found) {
+            // template's target may differ if the tip was changed meanwhile
+            if (pblock->hashPrevBlock != tip->GetBlockHash() ||
+                !pos::CheckKernelHash(pblock->stakeModifier, pblock->nBits, (int64_t) pblock->nTime, chainparams.GetConsensus(), found->mn->masternodeID).hashOk) {
                 return;
             }
 
             //
             // Trying to sign a block
             //
-            auto err = pos::SignPosBlock(pblock, args.minterKey);
+            auto err = pos::SignPosBlock(pblock, found->mn->minterKey);
             if (err) {
                 LogPrint(BCLog::STAKING, "SignPosBlock(): %s \n", *err);
                 return;
@@ -669,17 +808,13 @@ namespace pos {
                 return;
             }
 
+            stakingStats.AddMinted(found->mn->masternodeID);
             minted = true;
         });
 
         return minted ? Status::minted : (potentialCriminalBlock? Status::criminalWaiting : Status::stakeWaiting);
     }
 
-    CBlockIndex* Staker::getTip() {
-        LOCK(cs_main);
-        return ::ChainActive().Tip();
-    }
-
     template <typename F>
     bool Staker::withSearchInterval(F&& f) {
         const int64_t nTime = GetAdjustedTime(); // TODO: SS GetAdjustedTime() + period minting block
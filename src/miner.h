@@ -13,8 +13,10 @@
 #include <txmempool.h>
 #include <validation.h>
 
+#include <map>
 #include <memory>
 #include <stdint.h>
+#include <vector>
 
 #include <boost/multi_index_container.hpp>
 #include <boost/multi_index/ordered_index.hpp>
@@ -23,6 +25,9 @@ class CBlockIndex;
 class CChainParams;
 class CScript;
 class CAnchor;
+class CCoinsViewCache;
+class CCustomCSView;
+enum class CustomTxType : unsigned char;
 
 namespace Consensus { struct Params; };
 
@@ -147,6 +152,8 @@ private:
     uint64_t nBlockSigOpsCost;
     CAmount nFees;
     CTxMemPool::setEntries inBlock;
+    // custom txs which didn't apply to the block's custom state (while selected)
+    CTxMemPool::setEntries customTxsFailed;
 
     // Chain context for the block
     int nHeight;
@@ -163,11 +170,14 @@ public:
     explicit BlockAssembler(const CChainParams& params);
     BlockAssembler(const CChainParams& params, const Options& options);
 
-    /** Construct a new block template with coinbase to scriptPubKeyIn */
-    std::unique_ptr<CBlockTemplate> CreateNewBlock(const CScript& scriptPubKeyIn);
+    /** Construct a new block template with coinbase to scriptPubKeyIn, minted by the given (or the first configured) operator */
+    std::unique_ptr<CBlockTemplate> CreateNewBlock(const CScript& scriptPubKeyIn, const CKeyID& minterOperator = CKeyID());
 
     static Optional<int64_t> m_last_block_num_txs;
     static Optional<int64_t> m_last_block_weight;
+    static Optional<int64_t> m_last_block_build_time;
+    // custom txs of the mempool left out of the last block template as they don't apply, by type
+    static std::map<CustomTxType, int64_t> m_last_block_skipped_custom_txs;
 
 private:
     // utility functions
@@ -180,7 +190,7 @@ private:
     /** Add transactions based on feerate including unconfirmed ancestors
       * Increments nPackagesSelected / nDescendantsUpdated with corresponding
       * statistics from the package selection (for logging statistics). */
-    void addPackageTxs(int &nPackagesSelected, int &nDescendantsUpdated) EXCLUSIVE_LOCKS_REQUIRED(mempool.cs);
+    void addPackageTxs(int &nPackagesSelected, int &nDescendantsUpdated, CCustomCSView &mnview) EXCLUSIVE_LOCKS_REQUIRED(mempool.cs);
 
     // helper functions for addPackageTxs()
     /** Remove confirmed (inBlock) entries from given set */
@@ -192,6 +202,9 @@ private:
       * These checks should always succeed, and they're here
       * only as an extra check in case of suboptimal node configuration */
     bool TestPackageTransactions(const CTxMemPool::setEntries& package);
+    /** Apply the custom txs of the (sorted) package to the scratch custom state of the block,
+      * all or nothing: fails if any of them doesn't apply (it would be skipped or invalidate the block) */
+    bool TestPackageCustomTxs(const std::vector<CTxMemPool::txiter>& sortedEntries, CCustomCSView& mnview, const CCoinsViewCache& coins);
     /** Return true if given transaction from mapTx has already been evaluated,
       * or if the transaction's cached data in mapTx is incorrect. */
     bool SkipMapTxEntry(CTxMemPool::txiter it, indexed_modified_transaction_set &mapModifiedTx, CTxMemPool::setEntries &failedTx) EXCLUSIVE_LOCKS_REQUIRED(mempool.cs);
@@ -214,19 +227,53 @@ namespace pos {
     class ThreadStaker {
     public:
 
-        struct Args {
-            int32_t nMint = -1;
-            int64_t nMaxTries = -1;
+        struct MasternodeArgs {
             CScript coinbaseScript = CScript();
             CKey minterKey = CKey();
             uint256 masternodeID = uint256();
         };
 
+        struct Args {
+            int32_t nMint = -1;
+            int64_t nMaxTries = -1;
+            std::vector<MasternodeArgs> masternodes; // all local masternodes are staked in one pass
+        };
+
         /// always forward by value to avoid dangling pointers
         /// @return number of minted blocks
         int32_t operator()(Args stakerParams, CChainParams chainparams);
     };
 
+    struct StakingStats {
+        uint64_t attempts = 0;          // kernel hashes evaluated
+        uint64_t kernels = 0;           // kernels found
+        uint64_t minted = 0;            // blocks accepted by ProcessNewBlock
+        uint64_t criminalWaits = 0;     // passes skipped to avoid double signing
+        int64_t lastAttemptTime = 0;
+    };
+
+    // Per-masternode counters of all stakers of this node (getstakingstats)
+    class CStakingStats {
+    public:
+        void AddAttempts(uint256 const & masternodeID, uint64_t attempts, int64_t time);
+        void AddKernel(uint256 const & masternodeID);
+        void AddMinted(uint256 const & masternodeID);
+        void AddCriminalWait(uint256 const & masternodeID);
+        // kernel hashes evaluated by one search pass (all masternodes) and its duration
+        void AddSearch(uint64_t evaluations, int64_t micros);
+        std::map<uint256, StakingStats> Get() const;
+        // kernel hashes evaluated per second of the search
+        double GetKernelRate() const;
+
+    private:
+        mutable CCriticalSection cs;
+        std::map<uint256, StakingStats> stats GUARDED_BY(cs);
+        uint64_t searchEvaluations GUARDED_BY(cs) = 0;
+        int64_t searchMicros GUARDED_BY(cs) = 0;
+    };
+
+    extern CStakingStats stakingStats;
+
     class Staker {
     private:
         std::chrono::system_clock::time_point nLastSystemTime;
@@ -245,7 +292,6 @@ namespace pos {
 
         Staker::Status stake(CChainParams chainparams, const ThreadStaker::Args& args);
     private:
-        CBlockIndex* getTip();
         template <typename F>
         bool withSearchInterval(F&& f);
     };
@@ -13,6 +13,7 @@
 #include <consensus/validation.h>
 #include <hash.h>
 #include <validation.h>
+#include <masternodes/anchor_queue.h>
 #include <masternodes/anchors.h>
 #include <masternodes/masternodes.h>
 #include <merkleblock.h>
@@ -2407,29 +2408,9 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         CAnchorAuthMessage auth;
         vRecv >> auth;
 
-        // don't check spv here, but only our anchor index!
-        {
-            LOCK(cs_main);
-            if (panchorauths->GetAuth(auth.GetHash())) {
-                // reject ? or just skip&
-                return false;
-            }
-            if (panchorauths->GetVote(auth.GetSignHash(), auth.GetSigner())) {
-                // disconnect immidiately! possible even ban here, but only if sender peer is an author itself
-                pfrom->fDisconnect = true;
-                return false;
-            }
-
-            LogPrintf("Got anchor auth, hash %s, blockheight: %d\n", auth.GetHash().ToString(), auth.height);
-
-            // if valid, add and rebroadcast
-            if (panchorauths->ValidateAuth(auth)) {
-                panchorauths->AddAuth(auth);
-                RelayAnchorAuths({CInv(MSG_ANCHOR_AUTH, auth.GetHash())}, *connman, pfrom);
-                return true;
-            }
-        }
-        return false;
+        // don't check spv here, but only our anchor index! (verified, added and relayed by the anchor message queue)
+        g_anchorMessageQueue.AddAuth(auth, pfrom->GetId());
+        return true;
     }
 
     if (strCommand == NetMsgType::ANCHORCONFIRM) {
@@ -2441,16 +2422,8 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         CAnchorConfirmMessage confirmMessage;
         vRecv >> confirmMessage;
 
-        LOCK(cs_main);
-
-        if (!panchorAwaitingConfirms->GetConfirm(confirmMessage.GetHash())) {
-            LogPrintf("Got anchor confirm, hash %s, Anchor Message hash: %d\n", confirmMessage.GetHash().ToString(), confirmMessage.btcTxHash.ToString());
-            // if valid, AND UNIQUE AGAINST VOTER (this is encapsulated in the index itself) - add and rebroadcast
-            if (panchorAwaitingConfirms->Validate(confirmMessage) && panchorAwaitingConfirms->Add(confirmMessage)) {
-                RelayAnchorConfirm(confirmMessage.GetHash(), *connman, pfrom);
-            }
-        }
-
+        // verified, added and relayed by the anchor message queue
+        g_anchorMessageQueue.AddConfirm(confirmMessage, pfrom->GetId());
         return true;
     }
 
@@ -2650,8 +2623,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         }
 
         // walking from tip down to the topAnchor or requested block (depends on which is higher)
-        // sending all existing auths that belongs to active chain
-        // possible optimization: stops when first quorum reached (irl, no need to walk deeper)
+        // sending all existing auths that belongs to active chain, stops when first quorum reached (irl, no need to walk deeper)
         auto topAnchor = panchors->GetActiveAnchor();
         // limit requested by the top anchor, if any
         if (topAnchor && topAnchor->anchor.height > pLowRequested->height && topAnchor->anchor.height <= (uint64_t) ::ChainActive().Height()) {
@@ -2665,18 +2637,12 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
 
         LogPrint(BCLog::NET, "getauths down from %d to %d for peer=%d\n", pHighRequested->nHeight, pLowRequested->nHeight, pfrom->GetId());
         std::vector<CInv> vInv;
-        panchorauths->ForEachAnchorAuthByHeight([pLowRequested, pHighRequested, &vInv](const CAnchorAuthIndex::Auth & auth) {
-            if ((int)auth.height > pHighRequested->nHeight)
-                return true; // continue
-            if ((int)auth.height < pLowRequested->nHeight)
-                return false; // break
-
-            CBlockIndex const * pindex = LookupBlockIndex(auth.blockHash);
-            if (pindex && ::ChainActive().Contains(pindex)) {
-                vInv.push_back(CInv(MSG_ANCHOR_AUTH, auth.GetHash()));
+        if (pHighRequested->nHeight >= pLowRequested->nHeight) {
+            uint32_t const quorum = GetMinAnchorQuorum(panchors->GetCurrentTeam(topAnchor));
+            for (auto const & hash : panchorauths->GetActiveAuths(pLowRequested->nHeight, pHighRequested->nHeight, quorum)) {
+                vInv.push_back(CInv(MSG_ANCHOR_AUTH, hash));
             }
-            return true;
-        });
+        }
         if (vInv.size() > 0) {
             LogPrint(BCLog::NET, "getauths: send auths invs: %d to peer=%d\n", vInv.size(), pfrom->GetId());
             connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::INV, vInv));
@@ -1,6 +1,8 @@
 #include <pos_kernel.h>
 #include <amount.h>
 #include <arith_uint256.h>
+#include <crypto/common.h>
+#include <hash.h>
 #include <key.h>
 
 extern CAmount GetMnCollateralAmount(); // from masternodes.h
@@ -30,6 +32,32 @@ namespace pos {
         return {true, hashProofOfStake};
     }
 
+    CKernelSearch::CKernelSearch(uint256 const & stakeModifier, uint32_t nBits, uint256 const & masternodeID) {
+        CDataStream ss(SER_GETHASH, 0);
+        ss << stakeModifier << int64_t(0) << GetMnCollateralAmount() << masternodeID;
+        assert(ss.size() == PREIMAGE_SIZE);
+        memcpy(preimage, ss.data(), PREIMAGE_SIZE);
+
+        // hash / collateral > target  <=>  hash >= (target + 1) * collateral
+        arith_uint256 targetProofOfStake;
+        targetProofOfStake.SetCompact(nBits);
+        arith_uint256 const collateral(static_cast<uint64_t>(GetMnCollateralAmount()));
+        arith_uint256 const next = targetProofOfStake + 1;
+        bound = next * collateral;
+        anyHash = next == 0 || bound / collateral != next;
+    }
+
+    uint256 CKernelSearch::Hash(int64_t coinstakeTime) {
+        WriteLE64(preimage + TIME_OFFSET, static_cast<uint64_t>(coinstakeTime));
+        uint256 hash;
+        CHash256().Write(preimage, PREIMAGE_SIZE).Finalize(hash.begin());
+        return hash;
+    }
+
+    bool CKernelSearch::Check(int64_t coinstakeTime) {
+        return anyHash || UintToArith256(Hash(coinstakeTime)) < bound;
+    }
+
     uint256 ComputeStakeModifier(uint256 prevStakeModifier, const CKeyID& key) {
         // Calculate hash
         CDataStream ss(SER_GETHASH, 0);
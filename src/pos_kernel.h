@@ -37,6 +37,25 @@ namespace pos {
     CheckKernelHashRes
     CheckKernelHash(uint256 stakeModifier, uint32_t nBits, int64_t coinstakeTime, const Consensus::Params& params, uint256 masternodeID);
 
+/// Kernel search of one masternode over the coinstake times (staker), same result as CheckKernelHash(...).hashOk.
+/// The preimage is serialized once per tip, only the coinstake time is patched in per attempt, and the target is
+/// turned into a bound of the hash, so no stream allocation and no 256-bit division per attempt.
+    class CKernelSearch {
+    public:
+        CKernelSearch(uint256 const & stakeModifier, uint32_t nBits, uint256 const & masternodeID);
+
+        uint256 Hash(int64_t coinstakeTime);
+        bool Check(int64_t coinstakeTime);
+
+    private:
+        static const size_t TIME_OFFSET = 32;
+        static const size_t PREIMAGE_SIZE = 32 + 8 + 8 + 32;
+
+        unsigned char preimage[PREIMAGE_SIZE];
+        arith_uint256 bound;    // hash is ok if below the bound
+        bool anyHash;           // bound overflows, any hash is ok
+    };
+
 /// Stake Modifier (hash modifier of proof-of-stake)
     uint256 ComputeStakeModifier(uint256 prevStakeModifier, const CKeyID& key);
 }
@@ -13,6 +13,8 @@
 #include <streams.h>
 #include <uint256.h>
 
+#include <memory>
+
 static const int SERIALIZE_TRANSACTION_NO_WITNESS = 0x40000000;
 static const int SERIALIZE_TRANSACTION_NO_TOKENS = 0x20000000;
 
@@ -207,6 +209,8 @@ inline void SerializeTransaction(const TxType& tx, Stream& s);
 /** The basic transaction that is broadcasted on the network and contained in
  * blocks.  A transaction can contain multiple inputs and outputs.
  */
+struct CCustomTxParsed;
+
 class CTransaction
 {
 public:
@@ -235,6 +239,8 @@ private:
     /** Memory only. */
     const uint256 hash;
     const uint256 m_witness_hash;
+    /** Memory only. Type and message of the custom tx, see GetCustomTx() in masternodes/mn_checks.h */
+    mutable std::shared_ptr<const CCustomTxParsed> m_custom_tx;
 
     uint256 ComputeHash() const;
     uint256 ComputeWitnessHash() const;
@@ -264,6 +270,16 @@ public:
     const uint256& GetHash() const { return hash; }
     const uint256& GetWitnessHash() const { return m_witness_hash; }
 
+    std::shared_ptr<const CCustomTxParsed> GetCustomTxCache() const { return std::atomic_load(&m_custom_tx); }
+    /** Stores the parsed custom tx once, returns the stored one (the first of concurrent callers wins) */
+    std::shared_ptr<const CCustomTxParsed> SetCustomTxCache(std::shared_ptr<const CCustomTxParsed> parsed) const {
+        std::shared_ptr<const CCustomTxParsed> expected;
+        if (std::atomic_compare_exchange_strong(&m_custom_tx, &expected, parsed)) {
+            return parsed;
+        }
+        return expected;
+    }
+
     // Return sum of txouts. (extended version: for the given token). Doesn't count minted outputs.
     CAmount GetValueOut(uint32_t mintingOutputsStart = std::numeric_limits<uint32_t>::max(), DCT_ID nTokenId = DCT_ID{0}) const;
     // GetValueIn() is a method on CCoinsViewCache, because
@@ -15,6 +15,7 @@
 #include <core_io.h>
 #include <hash.h>
 #include <index/blockfilterindex.h>
+#include <masternodes/masternodes.h>
 #include <policy/feerate.h>
 #include <policy/policy.h>
 #include <policy/rbf.h>
@@ -1212,6 +1213,11 @@ UniValue getblockchaininfo(const JSONRPCRequest& request)
             "  \"pruneheight\": xxxxxx,        (numeric) lowest-height complete block stored (only present if pruning is enabled)\n"
             "  \"automatic_pruning\": xx,      (boolean) whether automatic pruning is enabled (only present if pruning is enabled)\n"
             "  \"prune_target_size\": xxxxxx,  (numeric) the target size used by pruning (only present if automatic pruning is enabled)\n"
+            "  \"customundos\": {              (object) undo data of masternodes/tokens/accounts changes\n"
+            "     \"size_on_disk\": xxxxxx,    (numeric) the estimated size of the undos table on disk\n"
+            "     \"depth\": xxxxxx,           (numeric) undos deeper than this are pruned (0 = keep all, see -customundodepth)\n"
+            "     \"prunedheight\": xxxxxx     (numeric) blocks below this height can't be disconnected\n"
+            "  },\n"
             "  \"softforks\": {                (object) status of softforks\n"
             "     \"xxxx\" : {                 (string) name of the softfork\n"
             "        \"type\": \"xxxx\",         (string) one of \"buried\", \"bip9\"\n"
@@ -1274,6 +1280,13 @@ UniValue getblockchaininfo(const JSONRPCRequest& request)
         }
     }
 
+    UniValue customundos(UniValue::VOBJ);
+    auto const undosRange = CUndosView::GetUndosKeyRange();
+    customundos.pushKV("size_on_disk",  (uint64_t) pcustomcsDB->EstimateSize(undosRange.first, undosRange.second));
+    customundos.pushKV("depth",         nCustomUndoDepth);
+    customundos.pushKV("prunedheight",  (uint64_t) pcustomcsview->GetUndosPrunedHeight());
+    obj.pushKV("customundos",           customundos);
+
     const Consensus::Params& consensusParams = Params().GetConsensus();
     UniValue softforks(UniValue::VOBJ);
     BuriedForkDescPushBack(softforks, "bip34", consensusParams.BIP34Height);
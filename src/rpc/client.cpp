@@ -187,6 +187,10 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "gettoken", 0, "key" },
     { "minttokens", 0, "inputs" },
     { "minttokens", 1, "amounts" },
+    { "compactcustomundos", 0, "depth" },
+    { "listtokenholders", 0, "key" },
+    { "listtokenholders", 1, "pagination" },
+    { "gettokensupply", 0, "key" },
     { "utxostoaccount", 0, "inputs" },
     { "utxostoaccount", 1, "amounts" },
     { "listaccounts", 0, "pagination" },
@@ -11,6 +11,7 @@
 #include <consensus/validation.h>
 #include <core_io.h>
 #include <masternodes/masternodes.h>
+#include <masternodes/mn_checks.h>
 #include <miner.h>
 #include <net.h>
 #include <policy/fees.h>
@@ -111,9 +112,11 @@ static UniValue generateBlocks(const CScript& coinbase_script, const CKey minter
     ThreadStaker::Args stakerParams{};
     stakerParams.nMint = nGenerate;
     stakerParams.nMaxTries = nMaxTries;
-    stakerParams.coinbaseScript = coinbase_script;
-    stakerParams.minterKey = minterKey;
-    stakerParams.masternodeID = masternodeID;
+    ThreadStaker::MasternodeArgs mnArgs;
+    mnArgs.coinbaseScript = coinbase_script;
+    mnArgs.minterKey = minterKey;
+    mnArgs.masternodeID = masternodeID;
+    stakerParams.masternodes.push_back(mnArgs);
 
     pos::Staker staker{};
     int32_t nMinted = 0;
@@ -227,9 +230,15 @@ static UniValue getmintinginfo(const JSONRPCRequest& request)
                     "  \"blocks\": nnn,             (numeric) The current block\n"
                     "  \"currentblockweight\": nnn, (numeric, optional) The block weight of the last assembled block (only present if a block was ever assembled)\n"
                     "  \"currentblocktx\": nnn,     (numeric, optional) The number of block transactions of the last assembled block (only present if a block was ever assembled)\n"
+                    "  \"currentblockbuildtime\": xxx.xx, (numeric, optional) The time in milliseconds spent to assemble the last block (only present if a block was ever assembled)\n"
+                    "  \"currentblockskippedtxs\": {  (json object, optional) The custom transactions of the mempool left out of the last assembled block as they don't apply, by type (only present if a block was ever assembled)\n"
+                    "      \"type\": n,             (numeric) The number of the skipped transactions of the type\n"
+                    "      ...\n"
+                    "  },\n"
                     "  \"generate\": true|false     (boolean) If the generation is on or off (see getgenerate or setgenerate calls)\n"
                     "  \"difficulty\": xxx.xxxxx    (numeric) The current difficulty\n"
                     "  \"networkhashps\": nnn,      (numeric) The network hashes per second\n"
+                    "  \"kernelrate\": xxx.xx       (numeric) The kernel hashes evaluated per second of the search by the stakers of this node\n"
                     "  \"pooledtx\": n              (numeric) The size of the mempool\n"
                     "  \"chain\": \"xxxx\",           (string) current network name as defined in BIP70 (main, test, regtest)\n"
                     "  \"warnings\": \"...\"          (string) any network and blockchain warnings\n"
@@ -247,6 +256,14 @@ static UniValue getmintinginfo(const JSONRPCRequest& request)
     obj.pushKV("blocks",           (int)::ChainActive().Height());
     if (BlockAssembler::m_last_block_weight) obj.pushKV("currentblockweight", *BlockAssembler::m_last_block_weight);
     if (BlockAssembler::m_last_block_num_txs) obj.pushKV("currentblocktx", *BlockAssembler::m_last_block_num_txs);
+    if (BlockAssembler::m_last_block_build_time) {
+        obj.pushKV("currentblockbuildtime", 0.001 * *BlockAssembler::m_last_block_build_time);
+        UniValue skipped(UniValue::VOBJ);
+        for (auto const & kv : BlockAssembler::m_last_block_skipped_custom_txs) {
+            skipped.pushKV(ToString(kv.first), kv.second);
+        }
+        obj.pushKV("currentblockskippedtxs", skipped);
+    }
     obj.pushKV("difficulty",       (double)GetDifficulty(::ChainActive().Tip()));
 
     auto mnIds = pcustomcsview->AmIOperator();
@@ -261,12 +278,49 @@ static UniValue getmintinginfo(const JSONRPCRequest& request)
         obj.pushKV("mintedblocks", (uint64_t)node.mintedBlocks);
     }
     obj.pushKV("networkhashps",    getnetworkhashps(request));
+    obj.pushKV("kernelrate",       pos::stakingStats.GetKernelRate());
     obj.pushKV("pooledtx",         (uint64_t)mempool.size());
     obj.pushKV("chain",            Params().NetworkIDString());
     obj.pushKV("warnings",         GetWarnings("statusbar"));
     return obj;
 }
 
+static UniValue getstakingstats(const JSONRPCRequest& request)
+{
+            RPCHelpMan{"getstakingstats",
+                "\nReturns per-masternode statistics of the stakers running on this node.",
+                {},
+                RPCResult{
+                    "[                              (json array of objects)\n"
+                    "  {\n"
+                    "    \"masternodeid\": \"hex\",      (string) The masternode id\n"
+                    "    \"attempts\": n,              (numeric) Number of kernel hashes evaluated\n"
+                    "    \"kernels\": n,               (numeric) Number of kernels found\n"
+                    "    \"minted\": n,                (numeric) Number of blocks minted and accepted\n"
+                    "    \"criminalwaits\": n,         (numeric) Number of staking passes skipped to avoid double signing\n"
+                    "    \"lastattempttime\": xxx      (numeric) The time of the last kernel search in seconds since epoch (Jan 1 1970 GMT)\n"
+                    "  }, ...\n"
+                    "]\n"
+                },
+                RPCExamples{
+                    HelpExampleCli("getstakingstats", "")
+            + HelpExampleRpc("getstakingstats", "")
+                },
+            }.Check(request);
+
+    UniValue result(UniValue::VARR);
+    for (auto const & kv : pos::stakingStats.Get()) {
+        UniValue obj(UniValue::VOBJ);
+        obj.pushKV("masternodeid", kv.first.GetHex());
+        obj.pushKV("attempts", kv.second.attempts);
+        obj.pushKV("kernels", kv.second.kernels);
+        obj.pushKV("minted", kv.second.minted);
+        obj.pushKV("criminalwaits", kv.second.criminalWaits);
+        obj.pushKV("lastattempttime", kv.second.lastAttemptTime);
+        result.push_back(obj);
+    }
+    return result;
+}
 
 // NOTE: Unlike wallet RPC (which use DFI values), mining RPCs follow GBT (BIP 22) in using satoshi amounts
 static UniValue prioritisetransaction(const JSONRPCRequest& request)
@@ -1007,6 +1061,7 @@ static const CRPCCommand commands[] =
   //  --------------------- ------------------------  -----------------------  ----------
     { "mining",             "getnetworkhashps",       &getnetworkhashps,       {"nblocks","height"} },
     { "mining",             "getmintinginfo",         &getmintinginfo,         {} },
+    { "mining",             "getstakingstats",        &getstakingstats,        {} },
     { "mining",             "prioritisetransaction",  &prioritisetransaction,  {"txid","dummy","fee_delta"} },
     { "mining",             "getblocktemplate",       &getblocktemplate,       {"template_request"} },
     { "mining",             "submitblock",            &submitblock,            {"hexdata","dummy"} },
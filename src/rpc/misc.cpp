@@ -5,6 +5,7 @@
 
 #include <chainparams.h>
 #include <crypto/ripemd160.h>
+#include <dbwrapper.h>
 #include <httpserver.h>
 #include <outputtype.h>
 #include <rpc/blockchain.h>
@@ -449,6 +450,48 @@ static UniValue getmemoryinfo(const JSONRPCRequest& request)
     }
 }
 
+static UniValue getdbcacheinfo(const JSONRPCRequest& request)
+{
+            RPCHelpMan{"getdbcacheinfo",
+                "Returns the block cache statistics of the open databases (see -dbcache and its shares).\n",
+                {},
+                RPCResult{
+            "[\n"
+            "  {\n"
+            "    \"name\": \"name\",          (string) Database (directory) name\n"
+            "    \"size\": n,               (numeric) Size of the block cache, bytes\n"
+            "    \"usage\": n,              (numeric) Bytes held by the block cache\n"
+            "    \"hits\": n,               (numeric) Block lookups served by the cache, since the database was opened\n"
+            "    \"misses\": n,             (numeric) Block lookups read from the table files (memory mapped ones are not cached)\n"
+            "    \"hitrate\": x.xxx,        (numeric) hits / (hits + misses)\n"
+            "    \"writebuffer\": n         (numeric) Size of the write buffer, bytes\n"
+            "  },\n"
+            "  ...\n"
+            "]\n"
+                },
+                RPCExamples{
+                    HelpExampleCli("getdbcacheinfo", "")
+            + HelpExampleRpc("getdbcacheinfo", "")
+                },
+            }.Check(request);
+
+    UniValue ret(UniValue::VARR);
+    for (auto const & db : GetDBCacheStats()) {
+        auto const & stats = db.second;
+        uint64_t const lookups = stats.hits + stats.misses;
+        UniValue obj(UniValue::VOBJ);
+        obj.pushKV("name", db.first);
+        obj.pushKV("size", (uint64_t) stats.capacity);
+        obj.pushKV("usage", (uint64_t) stats.usage);
+        obj.pushKV("hits", stats.hits);
+        obj.pushKV("misses", stats.misses);
+        obj.pushKV("hitrate", lookups ? (double) stats.hits / lookups : 0.0);
+        obj.pushKV("writebuffer", (uint64_t) stats.writeBuffer);
+        ret.push_back(obj);
+    }
+    return ret;
+}
+
 static void EnableOrDisableLogCategories(UniValue cats, bool enable) {
     cats = cats.get_array();
     for (unsigned int i = 0; i < cats.size(); ++i) {
@@ -557,6 +600,7 @@ static const CRPCCommand commands[] =
 { //  category              name                      actor (function)         argNames
   //  --------------------- ------------------------  -----------------------  ----------
     { "control",            "getmemoryinfo",          &getmemoryinfo,          {"mode"} },
+    { "control",            "getdbcacheinfo",         &getdbcacheinfo,         {} },
     { "control",            "logging",                &logging,                {"include", "exclude"}},
     { "util",               "validateaddress",        &validateaddress,        {"address"} },
     { "util",               "createmultisig",         &createmultisig,         {"nrequired","keys","address_type"} },
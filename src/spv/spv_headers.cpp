@@ -0,0 +1,220 @@
+// Copyright (c) 2020 The DeFi Blockchain Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <spv/spv_headers.h>
+
+#include <clientversion.h>
+#include <tinyformat.h>
+#include <util/system.h>
+
+#include <cstdio>
+#include <stdexcept>
+
+namespace spv
+{
+
+static FILE* OpenHeadersFile(fs::path const & path, bool fMemory, bool fWipe)
+{
+    if (fMemory) {
+        return std::tmpfile();
+    }
+    FILE* file = fWipe ? nullptr : fsbridge::fopen(path, "rb+");
+    if (!file) {
+        file = fsbridge::fopen(path, "wb+");
+    }
+    if (!file) {
+        throw std::runtime_error(strprintf("Unable to open spv headers file %s", path.string()));
+    }
+    return file;
+}
+
+static uint64_t FileSize(FILE* file)
+{
+    if (fseek(file, 0, SEEK_END) != 0) {
+        throw std::ios_base::failure("spv headers: fseek failed");
+    }
+    long const size = ftell(file);
+    if (size < 0) {
+        throw std::ios_base::failure("spv headers: ftell failed");
+    }
+    return static_cast<uint64_t>(size);
+}
+
+static void Seek(FILE* file, uint64_t pos)
+{
+    if (fseek(file, static_cast<long>(pos), SEEK_SET) != 0) {
+        throw std::ios_base::failure("spv headers: fseek failed");
+    }
+}
+
+CSpvHeaderStore::CSpvHeaderStore(fs::path const & dataPath, fs::path const & indexPath, bool fMemory, bool fWipe)
+    : dataFile(OpenHeadersFile(dataPath, fMemory, fWipe), SER_DISK, CLIENT_VERSION)
+    , indexFile(OpenHeadersFile(indexPath, fMemory, fWipe), SER_DISK, CLIENT_VERSION)
+{
+    if (dataFile.IsNull() || indexFile.IsNull()) {
+        throw std::runtime_error("Unable to create spv headers store");
+    }
+    Recover();
+}
+
+// drops the partially written tail (index entry w/o data, or data w/o index entry)
+void CSpvHeaderStore::Recover()
+{
+    uint64_t const indexSize = FileSize(indexFile.Get());
+    dataSize = FileSize(dataFile.Get());
+
+    count = indexSize / ENTRY_SIZE;
+    while (count) {
+        last = ReadEntry(count - 1);
+        if (last.offset + last.size <= dataSize) {
+            break;
+        }
+        --count;
+    }
+    uint64_t const end = count ? last.offset + last.size : 0;
+    if (!count) {
+        last = Entry{};
+    }
+    if (indexSize != count * ENTRY_SIZE || end != dataSize) {
+        LogPrintf("spv: headers store recovered, %d records (%d bytes of the unfinished tail dropped)\n", count, dataSize - end);
+        if (!TruncateFile(indexFile.Get(), count * ENTRY_SIZE) || !TruncateFile(dataFile.Get(), end)) {
+            throw std::runtime_error("Unable to truncate spv headers store");
+        }
+        dataSize = end;
+    }
+}
+
+CSpvHeaderStore::Entry CSpvHeaderStore::ReadEntry(size_t pos) const
+{
+    Entry entry;
+    Seek(indexFile.Get(), pos * ENTRY_SIZE);
+    indexFile >> entry;
+    return entry;
+}
+
+size_t CSpvHeaderStore::LowerBound(uint32_t height) const
+{
+    if (!count || last.height < height) {
+        return count;
+    }
+    size_t lo = 0, hi = count - 1;
+    while (lo < hi) {
+        size_t const mid = lo + (hi - lo) / 2;
+        if (ReadEntry(mid).height < height) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+bool CSpvHeaderStore::Write(uint32_t height, uint256 const & hash, TBytes const & block)
+{
+    if (count && last.height >= height && !Truncate(height)) {
+        return false;
+    }
+    try {
+        Entry entry;
+        entry.height = height;
+        entry.size = static_cast<uint32_t>(block.size());
+        entry.offset = dataSize;
+        entry.hash = hash;
+
+        // data first, so the index never points past it
+        Seek(dataFile.Get(), dataSize);
+        dataFile.write(reinterpret_cast<char const *>(block.data()), block.size());
+        Seek(indexFile.Get(), count * ENTRY_SIZE);
+        indexFile << entry;
+
+        ++count;
+        dataSize += entry.size;
+        last = entry;
+    } catch (std::exception const & e) {
+        return error("%s: %s", __func__, e.what());
+    }
+    return true;
+}
+
+bool CSpvHeaderStore::Truncate(uint32_t height)
+{
+    try {
+        size_t const pos = LowerBound(height);
+        if (pos == count) {
+            return true;
+        }
+        uint64_t const newDataSize = ReadEntry(pos).offset;
+        if (fflush(indexFile.Get()) != 0 || fflush(dataFile.Get()) != 0 ||
+            !TruncateFile(indexFile.Get(), pos * ENTRY_SIZE) || !TruncateFile(dataFile.Get(), newDataSize)) {
+            return error("%s: unable to truncate spv headers at height %d", __func__, height);
+        }
+        count = pos;
+        dataSize = newDataSize;
+        last = count ? ReadEntry(count - 1) : Entry{};
+    } catch (std::exception const & e) {
+        return error("%s: %s", __func__, e.what());
+    }
+    return true;
+}
+
+size_t CSpvHeaderStore::CountStored(std::vector<std::pair<uint32_t, uint256>> const & headers) const
+{
+    size_t matched = 0;
+    try {
+        if (headers.empty()) {
+            return 0;
+        }
+        size_t pos = LowerBound(headers.front().first);
+        if (pos == count) {
+            return 0;
+        }
+        Seek(indexFile.Get(), pos * ENTRY_SIZE);
+        for (; matched < headers.size() && pos < count; ++matched, ++pos) {
+            Entry entry;
+            indexFile >> entry;
+            if (entry.height != headers[matched].first || entry.hash != headers[matched].second) {
+                break;
+            }
+        }
+    } catch (std::exception const & e) {
+        error("%s: %s", __func__, e.what());
+    }
+    return matched;
+}
+
+size_t CSpvHeaderStore::Load(uint32_t fromHeight, std::function<void(uint32_t height, TBytes & block)> callback) const
+{
+    size_t loaded = 0;
+    try {
+        size_t const pos = LowerBound(fromHeight);
+        if (pos == count) {
+            return 0;
+        }
+        std::vector<Entry> entries(count - pos);
+        Seek(indexFile.Get(), pos * ENTRY_SIZE);
+        for (auto & entry : entries) {
+            indexFile >> entry;
+        }
+        // records are contiguous, read them in one pass
+        Seek(dataFile.Get(), entries.front().offset);
+        TBytes block;
+        for (auto const & entry : entries) {
+            block.resize(entry.size);
+            dataFile.read(reinterpret_cast<char *>(block.data()), block.size());
+            callback(entry.height, block);
+            ++loaded;
+        }
+    } catch (std::exception const & e) {
+        error("%s: %s", __func__, e.what());
+    }
+    return loaded;
+}
+
+bool CSpvHeaderStore::Flush()
+{
+    // data first: an index entry w/o its data is dropped on open (see Recover)
+    return FileCommit(dataFile.Get()) && FileCommit(indexFile.Get());
+}
+
+}
@@ -0,0 +1,82 @@
+// Copyright (c) 2020 The DeFi Blockchain Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef DEFI_SPV_SPV_HEADERS_H
+#define DEFI_SPV_SPV_HEADERS_H
+
+#include <fs.h>
+#include <serialize.h>
+#include <streams.h>
+#include <uint256.h>
+
+#include <functional>
+#include <utility>
+#include <vector>
+
+namespace spv
+{
+
+/**
+ * Flat store of the spv block headers (serialized merkle blocks), ordered by height.
+ * Records are appended to the data file, the index file keeps a fixed size entry per record, so the records are
+ * binary searchable by height w/o reading the whole store. Writing at the height that is stored already truncates
+ * both files there (reorg), instead of rewriting the whole set. In-memory mode uses anonymous temporary files.
+ */
+class CSpvHeaderStore
+{
+public:
+    using TBytes = std::vector<uint8_t>;
+
+    CSpvHeaderStore(fs::path const & dataPath, fs::path const & indexPath, bool fMemory = false, bool fWipe = false);
+
+    size_t Size() const { return count; }
+    uint64_t DataSize() const { return dataSize; }
+    // height of the last record, 0 if empty
+    uint32_t TipHeight() const { return count ? last.height : 0; }
+
+    // appends the record, truncates the store at its height first (if needed)
+    bool Write(uint32_t height, uint256 const & hash, TBytes const & block);
+    // removes all of the records at and above the height
+    bool Truncate(uint32_t height);
+    // number of the leading headers (sorted by height) which are stored already, with the same hashes
+    size_t CountStored(std::vector<std::pair<uint32_t, uint256>> const & headers) const;
+    // reads all of the records at and above the height, returns the number of records read
+    size_t Load(uint32_t fromHeight, std::function<void(uint32_t height, TBytes & block)> callback) const;
+    // commits both files to the disk (data file first)
+    bool Flush();
+
+private:
+    struct Entry {
+        uint32_t height = 0;
+        uint32_t size = 0;
+        uint64_t offset = 0;
+        uint256 hash;
+
+        ADD_SERIALIZE_METHODS;
+
+        template <typename Stream, typename Operation>
+        inline void SerializationOp(Stream& s, Operation ser_action) {
+            READWRITE(height);
+            READWRITE(size);
+            READWRITE(offset);
+            READWRITE(hash);
+        }
+    };
+    static const size_t ENTRY_SIZE = 4 + 4 + 8 + 32;
+
+    // position of the first entry at or above the height
+    size_t LowerBound(uint32_t height) const;
+    Entry ReadEntry(size_t pos) const;
+    void Recover();
+
+    mutable CAutoFile dataFile;
+    mutable CAutoFile indexFile;
+    size_t count = 0;
+    uint64_t dataSize = 0;
+    Entry last;
+};
+
+}
+
+#endif // DEFI_SPV_SPV_HEADERS_H
@@ -19,6 +19,9 @@
 #include <sync.h>
 
 #include <util/strencodings.h>
+#include <util/time.h>
+
+#include <algorithm>
 #include <string.h>
 #include <inttypes.h>
 //#include <errno.h>
@@ -35,9 +38,11 @@ std::unique_ptr<CSpvWrapper> pspv;
 using namespace std;
 
 // Prefixes to the masternodes database (masternodes/)
-static const char DB_SPVBLOCKS = 'B';     // spv "blocks" table
+static const char DB_SPVBLOCKS = 'B';     // spv "blocks" table (legacy, moved to the headers store)
 static const char DB_SPVPEERS  = 'P';     // spv "peers" table
-static const char DB_SPVTXS    = 'T';     // spv "tx2msg" table
+static const char DB_SPVTXS    = 'T';     // spv "tx2msg" table (legacy, split into bodies and metas)
+static const char DB_SPVTXBODIES = 'X';   // spv tx bodies, written once
+static const char DB_SPVTXMETAS  = 'M';   // spv tx confirmations (blockHeight, timeStamp), updated in place
 
 uint64_t const DEFAULT_BTC_FEERATE = TX_FEE_PER_KB;
 
@@ -195,7 +200,11 @@ static void SetCheckpoints()
 
 CSpvWrapper::CSpvWrapper(bool isMainnet, size_t nCacheSize, bool fMemory, bool fWipe)
     : db(new CDBWrapper(GetDataDir() / (isMainnet ?  "spv" : "spv_testnet"), nCacheSize, fMemory, fWipe))
+    , headers(GetDataDir() / (isMainnet ?  "spv" : "spv_testnet") / "headers.dat",
+              GetDataDir() / (isMainnet ?  "spv" : "spv_testnet") / "headers.idx", fMemory, fWipe)
 {
+    int64_t const nStart = GetTimeMillis();
+
     SetCheckpoints();
 
     // Configuring spv logs:
@@ -215,11 +224,26 @@ CSpvWrapper::CSpvWrapper(bool isMainnet, size_t nCacheSize, bool fMemory, bool f
 
     std::vector<BRTransaction *> txs;
     // load txs
+    int64_t nTime = GetTimeMillis();
+    MigrateTxs();
     {
-        std::function<void (uint256 const &, db_tx_rec &)> onLoadTx = [&txs, this] (uint256 const & hash, db_tx_rec & rec) {
-            BRTransaction *tx = BRTransactionParse(rec.first.data(), rec.first.size());
-            tx->blockHeight = rec.second.first;
-            tx->timestamp = rec.second.second;
+        std::map<uint256, db_tx_meta> metas;
+        std::function<void (uint256 const &, db_tx_meta &)> onLoadMeta = [&metas] (uint256 const & hash, db_tx_meta & meta) {
+            metas.emplace(hash, meta);
+        };
+        IterateTable(DB_SPVTXMETAS, onLoadMeta);
+
+        std::function<void (uint256 const &, TBytes &)> onLoadTx = [&txs, &metas, this] (uint256 const & hash, TBytes & body) {
+            BRTransaction *tx = BRTransactionParse(body.data(), body.size());
+            if (!tx) {
+                LogPrintf("spv: unable to parse tx: %s\n", hash.ToString());
+                return;
+            }
+            auto it = metas.find(hash);
+            if (it != metas.end()) {
+                tx->blockHeight = it->second.first;
+                tx->timestamp = it->second.second;
+            }
             txs.push_back(tx);
 
             LogPrintf("spv: load tx: %s, height: %d\n", to_uint256(tx->txHash).ToString(), tx->blockHeight);
@@ -230,27 +254,40 @@ CSpvWrapper::CSpvWrapper(bool isMainnet, size_t nCacheSize, bool fMemory, bool f
             }
         };
         // can't deduce lambda here:
-        IterateTable(DB_SPVTXS, onLoadTx);
+        IterateTable(DB_SPVTXBODIES, onLoadTx);
     }
 
     wallet = BRWalletNew(txs.data(), txs.size(), mpk, 0);
     BRWalletSetCallbacks(wallet, this, balanceChanged, txAdded, txUpdated, txDeleted);
     LogPrintf("spv: wallet created with first receive address: %s\n", BRWalletLegacyAddress(wallet).s);
+    LogPrintf("spv: %d txs loaded, wallet created in %dms\n", txs.size(), GetTimeMillis() - nTime);
+
+    MigrateBlocks();
 
-    std::vector<BRMerkleBlock *> blocks;
     // load blocks
-    {
-        std::function<void (uint256 const &, db_block_rec &)> onLoadBlock = [&blocks] (uint256 const & hash, db_block_rec & rec) {
-            BRMerkleBlock *block = BRMerkleBlockParse (rec.first.data(), rec.first.size());
-            block->height = rec.second;
-            blocks.push_back(block);
-        };
-        // can't deduce lambda here:
-        IterateTable(DB_SPVBLOCKS, onLoadBlock);
+    // only the headers of the last difficulty intervals (and above the last checkpoint) are needed by the peer manager:
+    // it takes the last transition block and chains the rest to it, the older ones are never used
+    nTime = GetTimeMillis();
+    BRChainParams const * params = BRGetChainParams();
+    uint32_t const tipHeight = headers.TipHeight();
+    uint32_t loadFrom = params->checkpoints[params->checkpointsCount - 1].height;
+    if (tipHeight >= loadFrom + 2 * BLOCK_DIFFICULTY_INTERVAL) {
+        loadFrom = tipHeight - tipHeight % BLOCK_DIFFICULTY_INTERVAL - BLOCK_DIFFICULTY_INTERVAL;
     }
+    std::vector<BRMerkleBlock *> blocks;
+    headers.Load(loadFrom, [&blocks] (uint32_t height, TBytes & buf) {
+        BRMerkleBlock *block = BRMerkleBlockParse(buf.data(), buf.size());
+        if (block) {
+            block->height = height;
+            blocks.push_back(block);
+        }
+    });
+    LogPrintf("spv: %d of %d headers loaded (from height %d, tip %d) in %dms\n", blocks.size(), headers.Size(), loadFrom, tipHeight, GetTimeMillis() - nTime);
 
     // no need to load|keep peers!!!
-    manager = BRPeerManagerNew(BRGetChainParams(), wallet, 1588291200, blocks.data(), blocks.size(), NULL, 0); // date is 1 May 2020
+    nTime = GetTimeMillis();
+    manager = BRPeerManagerNew(params, wallet, 1588291200, blocks.data(), blocks.size(), NULL, 0); // date is 1 May 2020
+    LogPrintf("spv: peer manager created in %dms, startup took %dms\n", GetTimeMillis() - nTime, GetTimeMillis() - nStart);
 
     // can't wrap member function as static "C" function here:
     BRPeerManagerSetCallbacks(manager, this, syncStarted, syncStopped, txStatusUpdate,
@@ -361,6 +398,7 @@ void CSpvWrapper::OnTxAdded(BRTransaction * tx)
     /// @attention called under spv manager lock!!!
     uint256 const txHash{to_uint256(tx->txHash)};
     WriteTx(tx);
+    CommitBatch();
     LogPrintf("spv: tx added %s, at block %d, timestamp %d\n", txHash.ToString(), tx->blockHeight, tx->timestamp);
 
     CAnchor anchor;
@@ -386,13 +424,19 @@ void CSpvWrapper::OnTxAdded(BRTransaction * tx)
 void CSpvWrapper::OnTxUpdated(const UInt256 txHashes[], size_t txCount, uint32_t blockHeight, uint32_t timestamp)
 {
     /// @attention called under spv manager lock!!!
+    int64_t const nTime = GetTimeMicros();
+    std::vector<uint256> hashes;
+    hashes.reserve(txCount);
     for (size_t i = 0; i < txCount; ++i) {
-        uint256 const txHash{to_uint256(txHashes[i])};
-        UpdateTx(txHash, blockHeight, timestamp);
-        LogPrintf("spv: tx updated, hash: %s, blockHeight: %d, timestamp: %d\n", txHash.ToString(), blockHeight, timestamp);
-
-        LOCK(cs_main);
+        hashes.push_back(to_uint256(txHashes[i]));
+        UpdateTx(hashes.back(), blockHeight, timestamp);
+        LogPrintf("spv: tx updated, hash: %s, blockHeight: %d, timestamp: %d\n", hashes.back().ToString(), blockHeight, timestamp);
+    }
+    CommitBatch();
+    LogPrintf("spv: %d txs updated in %.2fms\n", txCount, 0.001 * (GetTimeMicros() - nTime));
 
+    LOCK(cs_main);
+    for (auto const & txHash : hashes) {
         // update index. no any checks nor validations
         auto exist = panchors->GetAnchorByBtcTx(txHash);
         if (exist) {
@@ -410,6 +454,7 @@ void CSpvWrapper::OnTxDeleted(UInt256 txHash, int notifyUser, int recommendResca
     /// @attention called under spv manager lock!!!
     uint256 const hash(to_uint256(txHash));
     EraseTx(hash);
+    CommitBatch();
 
     LOCK(cs_main);
     panchors->DeleteAnchorByBtcTx(hash);
@@ -437,16 +482,35 @@ void CSpvWrapper::OnTxStatusUpdate()
 void CSpvWrapper::OnSaveBlocks(int replace, BRMerkleBlock * blocks[], size_t blocksCount)
 {
     /// @attention called under spv manager lock!!!
+    std::vector<BRMerkleBlock *> sorted(blocks, blocks + blocksCount);
+    std::sort(sorted.begin(), sorted.end(), [] (BRMerkleBlock const * a, BRMerkleBlock const * b) {
+        return a->height < b->height;
+    });
+
+    // 'replace' set is the whole chain from the last transition block, mostly stored already.
+    // skip the same headers, the store is truncated at the first different one (or at the first block being appended)
+    size_t first = 0;
     if (replace)
     {
-        LogPrintf("spv: BLOCK: 'replace' requested, deleting...\n");
-        DeleteTable<uint256>(DB_SPVBLOCKS);
+        std::vector<std::pair<uint32_t, uint256>> hashes;
+        hashes.reserve(sorted.size());
+        for (auto const block : sorted) {
+            hashes.emplace_back(block->height, to_uint256(block->blockHash));
+        }
+        first = headers.CountStored(hashes);
+        LogPrintf("spv: BLOCK: 'replace' requested, %d of %d blocks stored already\n", first, sorted.size());
     }
-    for (size_t i = 0; i < blocksCount; ++i) {
-        WriteBlock(blocks[i]);
-        LogPrintf("spv: BLOCK: %u, %s saved\n", blocks[i]->height, to_uint256(blocks[i]->blockHash).ToString());
+    for (size_t i = first; i < sorted.size(); ++i) {
+        if (!WriteBlock(sorted[i])) {
+            break;
+        }
+        LogPrintf("spv: BLOCK: %u, %s saved\n", sorted[i]->height, to_uint256(sorted[i]->blockHash).ToString());
     }
-    CommitBatch();
+    if (replace && !sorted.empty()) {
+        // nothing above the new tip
+        headers.Truncate(sorted.back()->height + 1);
+    }
+    headers.Flush();
 
     /// @attention don't call ANYTHING that could call back to spv here! cause OnSaveBlocks works under spv lock!!!
 //    CAnchorIndex::CheckActiveAnchor();
@@ -470,38 +534,88 @@ void CSpvWrapper::CommitBatch()
     }
 }
 
+// batched! need to commit
 void CSpvWrapper::WriteTx(const BRTransaction *tx)
 {
-    static TBytes buf;
-    buf.resize(BRTransactionSerialize(tx, NULL, 0));
+    TBytes buf(BRTransactionSerialize(tx, NULL, 0));
     BRTransactionSerialize(tx, buf.data(), buf.size());
-    db->Write(make_pair(DB_SPVTXS, to_uint256(tx->txHash)), std::make_pair(buf, std::make_pair(tx->blockHeight, tx->timestamp)) );
+    uint256 const hash{to_uint256(tx->txHash)};
+    BatchWrite(make_pair(DB_SPVTXBODIES, hash), buf);
+    BatchWrite(make_pair(DB_SPVTXMETAS, hash), db_tx_meta{tx->blockHeight, tx->timestamp});
 }
 
+// batched! need to commit. the body is immutable, so just overwrite the confirmation (of the known txs only)
 void CSpvWrapper::UpdateTx(uint256 const & hash, uint32_t blockHeight, uint32_t timestamp)
 {
-    std::pair<char, uint256> const key{std::make_pair(DB_SPVTXS, hash)};
-    std::pair<TBytes, std::pair<uint32_t, uint32_t> > txrec;
-    if (db->Read(key, txrec)) {
-        txrec.second.first = blockHeight;
-        txrec.second.second = timestamp;
-        db->Write(key, txrec);
+    std::pair<char, uint256> const key{make_pair(DB_SPVTXMETAS, hash)};
+    if (db->Exists(key)) {
+        BatchWrite(key, db_tx_meta{blockHeight, timestamp});
     }
 }
 
+// batched! need to commit
 void CSpvWrapper::EraseTx(uint256 const & hash)
 {
-    db->Erase(make_pair(DB_SPVTXS, hash));
+    BatchErase(make_pair(DB_SPVTXBODIES, hash));
+    BatchErase(make_pair(DB_SPVTXMETAS, hash));
+}
+
+// splits the records of the legacy "tx2msg" table into bodies and metas
+void CSpvWrapper::MigrateTxs()
+{
+    size_t count = 0;
+    std::function<void (uint256 const &, db_tx_rec &)> onLoadTx = [&count, this] (uint256 const & hash, db_tx_rec & rec) {
+        BatchWrite(make_pair(DB_SPVTXBODIES, hash), rec.first);
+        BatchWrite(make_pair(DB_SPVTXMETAS, hash), rec.second);
+        BatchErase(make_pair(DB_SPVTXS, hash));
+        ++count;
+    };
+    IterateTable(DB_SPVTXS, onLoadTx);
+    if (count) {
+        CommitBatch();
+        LogPrintf("spv: %d txs moved to the bodies/metas tables\n", count);
+    }
 }
 
-void CSpvWrapper::WriteBlock(const BRMerkleBlock * block)
+bool CSpvWrapper::WriteBlock(const BRMerkleBlock * block)
 {
     static TBytes buf;
     size_t blockSize = BRMerkleBlockSerialize(block, NULL, 0);
     buf.resize(blockSize);
     BRMerkleBlockSerialize(block, buf.data(), blockSize);
 
-    BatchWrite(make_pair(DB_SPVBLOCKS, to_uint256(block->blockHash)), make_pair(buf, block->height));
+    return headers.Write(block->height, to_uint256(block->blockHash), buf);
+}
+
+// moves the blocks of the legacy 'blocks' table to the headers store
+void CSpvWrapper::MigrateBlocks()
+{
+    std::vector<std::pair<uint32_t, db_block_rec>> recs;
+    std::function<void (uint256 const &, db_block_rec &)> onLoadBlock = [&recs] (uint256 const & hash, db_block_rec & rec) {
+        recs.emplace_back(rec.second, std::move(rec));
+    };
+    IterateTable(DB_SPVBLOCKS, onLoadBlock);
+    if (recs.empty()) {
+        return;
+    }
+
+    std::sort(recs.begin(), recs.end(), [] (std::pair<uint32_t, db_block_rec> const & a, std::pair<uint32_t, db_block_rec> const & b) {
+        return a.first < b.first;
+    });
+    for (auto & rec : recs) {
+        BRMerkleBlock *block = BRMerkleBlockParse(rec.second.first.data(), rec.second.first.size());
+        if (!block) {
+            continue;
+        }
+        block->height = rec.first;
+        WriteBlock(block);
+        BRMerkleBlockFree(block);
+    }
+    headers.Flush();
+
+    DeleteTable<uint256>(DB_SPVBLOCKS);
+    CommitBatch();
+    LogPrintf("spv: %d blocks moved to the headers store\n", recs.size());
 }
 
 void publishedTxCallback(void *info, int error)
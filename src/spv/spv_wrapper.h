@@ -7,6 +7,7 @@
 
 #include <dbwrapper.h>
 #include <shutdown.h>
+#include <spv/spv_headers.h>
 #include <uint256.h>
 
 #include <spv/support/BRLargeInt.h>
@@ -61,13 +62,15 @@ class CSpvWrapper
 private:
     boost::shared_ptr<CDBWrapper> db;
     boost::scoped_ptr<CDBBatch> batch;
+    CSpvHeaderStore headers;
 
     BRWallet *wallet = nullptr;
     BRPeerManager *manager = nullptr;
     std::string spv_internal_logfilename;
 
-    using db_tx_rec    = std::pair<TBytes, std::pair<uint32_t, uint32_t>>;  // serialized tx, blockHeight, timeStamp
-    using db_block_rec = std::pair<TBytes, uint32_t>;                       // serialized block, blockHeight
+    using db_tx_rec    = std::pair<TBytes, std::pair<uint32_t, uint32_t>>;  // serialized tx, blockHeight, timeStamp (legacy "tx2msg" table)
+    using db_tx_meta   = std::pair<uint32_t, uint32_t>;                     // blockHeight, timeStamp
+    using db_block_rec = std::pair<TBytes, uint32_t>;                       // serialized block, blockHeight (legacy 'blocks' table)
 
     bool initialSync = true;
 
@@ -181,10 +184,12 @@ private:
 protected:
     void CommitBatch();
 
-    void WriteBlock(BRMerkleBlock const * block);
+    bool WriteBlock(BRMerkleBlock const * block);
+    void MigrateBlocks();
     void WriteTx(BRTransaction const * tx);
     void UpdateTx(uint256 const & hash, uint32_t blockHeight, uint32_t timestamp);
     void EraseTx(uint256 const & hash);
+    void MigrateTxs();
 };
 
 // fake spv for testing (activate it with 'fakespv=1' on regtest net)
@@ -1,7 +1,10 @@
 #include <chainparams.h>
+#include <key.h>
+#include <masternodes/anchor_queue.h>
 #include <masternodes/anchors.h>
 #include <masternodes/masternodes.h>
 #include <spv/spv_wrapper.h>
+#include <streams.h>
 #include <validation.h>
 
 #include <test/setup_common.h>
@@ -163,4 +166,215 @@ BOOST_AUTO_TEST_CASE(best_anchor_activation_logic)
 }
 
 
+BOOST_AUTO_TEST_CASE(unrewarded_anchors)
+{
+    spv::CFakeSpvWrapper * fspv = static_cast<spv::CFakeSpvWrapper *>(spv::pspv.get());
+
+    LOCK(cs_main);
+
+    auto team0 = panchors->GetCurrentTeam(panchors->GetActiveAnchor());
+    uint256 prev;
+    for (THeight btcHeight = 1; btcHeight <= 3; ++btcHeight) {
+        CAnchorAuthMessage auth(prev, 15 * btcHeight, uint256S("def" + std::to_string(btcHeight)), team0);
+        CAnchor anc = CAnchor::Create({ auth }, CTxDestination(PKHash()));
+        prev = uint256S("bc" + std::to_string(btcHeight));
+        BOOST_CHECK(panchors->AddAnchor(anc, prev, btcHeight));
+    }
+    // active, but not confirmed enough for reward
+    fspv->lastBlockHeight = 3; panchors->UpdateLastHeight(fspv->GetLastBlockHeight());
+    BOOST_CHECK(panchors->ActivateBestAnchor(true));
+    BOOST_CHECK(panchors->GetActiveAnchor()->txHash == uint256S("bc3"));
+    BOOST_CHECK(panchors->GetUnrewarded().empty());
+
+    fspv->lastBlockHeight = 7; panchors->UpdateLastHeight(fspv->GetLastBlockHeight());
+    BOOST_CHECK(panchors->GetUnrewarded() == (CAnchorIndex::UnrewardedResult{uint256S("bc1"), uint256S("bc2")}));
+
+    // rewarded on the tip, then the newly confirmed anchors are checked against the rewards too
+    pcustomcsview->AddRewardForAnchor(uint256S("bc1"), uint256S("aa1"));
+    panchors->OnRewardConnected(uint256S("bc1"));
+    pcustomcsview->AddRewardForAnchor(uint256S("bc3"), uint256S("aa3"));
+    fspv->lastBlockHeight = 8; panchors->UpdateLastHeight(fspv->GetLastBlockHeight());
+    BOOST_CHECK(panchors->GetUnrewarded() == (CAnchorIndex::UnrewardedResult{uint256S("bc2")}));
+
+    pcustomcsview->RemoveRewardForAnchor(uint256S("bc1"));
+    panchors->OnRewardDisconnected(uint256S("bc1"));
+    BOOST_CHECK(panchors->GetUnrewarded() == (CAnchorIndex::UnrewardedResult{uint256S("bc1"), uint256S("bc2")}));
+
+    // rollback of the spv chain
+    fspv->lastBlockHeight = 6; panchors->UpdateLastHeight(fspv->GetLastBlockHeight());
+    BOOST_CHECK(panchors->GetUnrewarded() == (CAnchorIndex::UnrewardedResult{uint256S("bc1")}));
+    panchors->OnRewardDisconnected(uint256S("bc3")); // not confirmed, ignored
+    BOOST_CHECK(panchors->GetUnrewarded() == (CAnchorIndex::UnrewardedResult{uint256S("bc1")}));
+    BOOST_CHECK(panchors->DeleteAnchorByBtcTx(uint256S("bc1")));
+    BOOST_CHECK(panchors->GetUnrewarded().empty());
+}
+
+BOOST_AUTO_TEST_CASE(anchor_message_queue)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CAnchorAuthMessage auth(uint256(), 1000, uint256S("def1000"), {key.GetPubKey().GetID()});
+    BOOST_CHECK(auth.SignWithKey(key));
+    auto confirm = CAnchorConfirmMessage::Create(CAnchor::Create({ auth }, CTxDestination(PKHash())), 0, uint256S("bc1"), key);
+
+    // deduplicated by hash
+    BOOST_CHECK(g_anchorMessageQueue.AddAuth(auth, 1));
+    BOOST_CHECK(!g_anchorMessageQueue.AddAuth(auth, 2));
+    BOOST_CHECK(g_anchorMessageQueue.AddConfirm(confirm, 1));
+    BOOST_CHECK(!g_anchorMessageQueue.AddConfirm(confirm, 2));
+    BOOST_CHECK(g_anchorMessageQueue.Size() == 2);
+
+    // no block at the auth's height, signer isn't a masternode - both rejected
+    BOOST_CHECK(g_anchorMessageQueue.ProcessPending() == 2);
+    BOOST_CHECK(g_anchorMessageQueue.Size() == 0);
+    BOOST_CHECK(g_anchorMessageQueue.ProcessPending() == 0);
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(panchorauths->GetAuth(auth.GetHash()) == nullptr);
+        BOOST_CHECK(panchorAwaitingConfirms->GetConfirm(confirm.GetHash()) == nullptr);
+    }
+    // may come again after processing
+    BOOST_CHECK(g_anchorMessageQueue.AddAuth(auth, 1));
+}
+
+BOOST_AUTO_TEST_CASE(anchor_message_signers)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CKey otherKey;
+    otherKey.MakeNewKey(true);
+
+    CAnchorAuthMessage auth(uint256(), 15, uint256S("def15"), {key.GetPubKey().GetID()});
+    BOOST_CHECK(auth.GetSigner().IsNull()); // not signed yet
+    BOOST_CHECK(auth.SignWithKey(key));
+    BOOST_CHECK(auth.GetSigner() == key.GetPubKey().GetID());
+
+    // received copy
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << auth;
+    CAnchorAuthMessage received;
+    received.GetSignHash(); // cached values of the empty message are dropped on deserialization
+    ss >> received;
+    BOOST_CHECK(received.GetSignHash() == auth.GetSignHash());
+    BOOST_CHECK(received.GetSigner() == key.GetPubKey().GetID());
+
+    // the same sigs of the anchor are checked against the shared cache
+    CAnchor anchor = CAnchor::Create({ auth }, CTxDestination(PKHash()));
+    BOOST_CHECK(anchor.CheckAuthSigs({key.GetPubKey().GetID()}));
+    BOOST_CHECK(!anchor.CheckAuthSigs({otherKey.GetPubKey().GetID()}));
+
+    // confirms of a disconnected anchor are restored with sigs of the different signers
+    auto confirm = CAnchorConfirmMessage::Create(anchor, 0, uint256S("bc1"), key);
+    BOOST_CHECK(confirm.GetSigner() == key.GetPubKey().GetID());
+    BOOST_CHECK(otherKey.SignCompact(confirm.GetSignHash(), confirm.signature));
+    BOOST_CHECK(confirm.GetSigner() == otherKey.GetPubKey().GetID());
+    confirm.signature.clear();
+    BOOST_CHECK(confirm.GetSigner().IsNull());
+    BOOST_CHECK(RecoverAnchorSigner(confirm.GetSignHash(), {1, 2, 3}).IsNull());
+}
+
+BOOST_FIXTURE_TEST_CASE(anchor_auths_range, TestChain100Setup)
+{
+    LOCK(cs_main);
+    std::vector<CKey> keys(3);
+    for (auto & key : keys) {
+        key.MakeNewKey(true);
+    }
+    auto activeHash = [] (int height) { return ::ChainActive()[height]->GetBlockHash(); };
+    CAnchorAuthIndex index;
+    auto addAuth = [&index, &keys] (int height, uint256 const & blockHash, CKey const & key) {
+        CAnchorAuthIndex::Auth auth(uint256(), height, blockHash, {keys[0].GetPubKey().GetID()});
+        BOOST_REQUIRE(auth.SignWithKey(key));
+        BOOST_REQUIRE(index.AddAuth(auth));
+        return auth.GetHash();
+    };
+    auto const a90 = addAuth(90, activeHash(90), keys[0]);
+    auto const b90 = addAuth(90, activeHash(90), keys[1]);
+    auto const a95 = addAuth(95, activeHash(95), keys[0]);
+    addAuth(95, uint256S("f95"), keys[1]); // fork
+    auto const a99 = addAuth(99, activeHash(99), keys[0]);
+    addAuth(110, uint256S("f110"), keys[0]); // above the tip
+
+    // from the top down to the first quorum (inclusive)
+    auto result = index.GetActiveAuths(80, 120, 2);
+    BOOST_CHECK_EQUAL(result.size(), 4);
+    BOOST_CHECK(result[0] == a99 && result[1] == a95);
+    BOOST_CHECK(std::set<uint256>(result.begin() + 2, result.end()) == (std::set<uint256>{a90, b90}));
+    BOOST_CHECK(index.GetActiveAuths(80, 120, 1) == std::vector<uint256>{a99});
+    BOOST_CHECK(index.GetActiveAuths(91, 96, 2) == std::vector<uint256>{a95});
+    BOOST_CHECK(index.GetActiveAuths(96, 91, 2).empty());
+    BOOST_CHECK(index.GetActiveAuths(100, 120, 1).empty());
+    // repeated request is served from the summaries
+    BOOST_CHECK(index.GetActiveAuths(80, 120, 2) == result);
+
+    // new auths reset the summary of their height
+    auto const a92 = addAuth(92, activeHash(92), keys[0]);
+    auto const b92 = addAuth(92, activeHash(92), keys[2]);
+    result = index.GetActiveAuths(80, 120, 2);
+    BOOST_CHECK_EQUAL(result.size(), 4);
+    BOOST_CHECK(std::set<uint256>(result.begin() + 2, result.end()) == (std::set<uint256>{a92, b92}));
+
+    index.PruneOlderThan(93);
+    BOOST_CHECK(index.GetActiveAuths(0, 120, 5) == (std::vector<uint256>{a99, a95}));
+}
+
+BOOST_AUTO_TEST_CASE(anchor_message_journal)
+{
+    LOCK(cs_main);
+    CKey key;
+    key.MakeNewKey(true);
+    CAnchorAuthMessage auth10(uint256(), 10, uint256S("def10"), {key.GetPubKey().GetID()});
+    CAnchorAuthMessage auth20(uint256(), 20, uint256S("def20"), {key.GetPubKey().GetID()});
+    BOOST_REQUIRE(auth10.SignWithKey(key) && auth20.SignWithKey(key));
+    auto anchor = CAnchor::Create({ auth20 }, CTxDestination(PKHash()));
+    auto confirm1 = CAnchorConfirmMessage::Create(anchor, 0, uint256S("bc1"), key);
+    auto confirm2 = CAnchorConfirmMessage::Create(anchor, 0, uint256S("bc2"), key);
+
+    panchorjournal = MakeUnique<CAnchorMessageJournal>(1 << 20, true, true);
+    BOOST_CHECK(panchorauths->AddAuth(auth10));
+    BOOST_CHECK(panchorauths->AddAuth(auth20));
+    BOOST_CHECK(panchorAwaitingConfirms->Add(confirm1));
+    BOOST_CHECK(panchorAwaitingConfirms->Add(confirm2));
+    // journal follows the prunes of the indexes
+    panchorauths->PruneOlderThan(15);
+    BOOST_CHECK(panchorAwaitingConfirms->EraseAnchor(uint256S("bc1")));
+
+    CAnchorAuthIndex auths;
+    CAnchorAwaitingConfirms confirms;
+    auto journal = std::move(panchorjournal);
+    BOOST_CHECK(journal->Load(auths, confirms));
+    BOOST_CHECK(auths.GetAuth(auth10.GetHash()) == nullptr);
+    BOOST_CHECK(auths.GetAuth(auth20.GetHash()) != nullptr);
+    BOOST_CHECK(auths.GetVote(auth20.GetSignHash(), key.GetPubKey().GetID()) != nullptr);
+    BOOST_CHECK(confirms.GetConfirm(confirm1.GetHash()) == nullptr);
+    BOOST_CHECK(confirms.GetConfirm(confirm2.GetHash()) != nullptr);
+
+    // loaded w/o writing back to the journal
+    CAnchorAuthIndex reloaded;
+    CAnchorAwaitingConfirms reloadedConfirms;
+    BOOST_CHECK(journal->Load(reloaded, reloadedConfirms));
+    BOOST_CHECK(reloaded.GetAuth(auth20.GetHash()) != nullptr);
+
+    // prunes continue from the pruned height
+    journal->PruneAuths(25);
+    journal->PruneAuths(10);
+    CAnchorAuthIndex pruned;
+    CAnchorAwaitingConfirms prunedConfirms;
+    BOOST_CHECK(journal->Load(pruned, prunedConfirms));
+    BOOST_CHECK(pruned.GetAuth(auth20.GetHash()) == nullptr);
+    BOOST_CHECK(prunedConfirms.GetConfirm(confirm2.GetHash()) != nullptr);
+
+    // late auth below the pruned height is pruned by the next prune
+    journal->WriteAuth(auth10);
+    CAnchorAuthIndex late;
+    CAnchorAwaitingConfirms lateConfirms;
+    BOOST_CHECK(journal->Load(late, lateConfirms));
+    BOOST_CHECK(late.GetAuth(auth10.GetHash()) != nullptr);
+    journal->PruneAuths(25);
+    CAnchorAuthIndex prunedLate;
+    CAnchorAwaitingConfirms prunedLateConfirms;
+    BOOST_CHECK(journal->Load(prunedLate, prunedLateConfirms));
+    BOOST_CHECK(prunedLate.GetAuth(auth10.GetHash()) == nullptr);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
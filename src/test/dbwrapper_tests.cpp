@@ -79,6 +79,33 @@ BOOST_AUTO_TEST_CASE(dbwrapper_batch)
     }
 }
 
+BOOST_AUTO_TEST_CASE(dbwrapper_cache_stats)
+{
+    auto find = [](const std::string& name) {
+        auto const all = GetDBCacheStats();
+        return std::find_if(all.begin(), all.end(), [&](const std::pair<std::string, CDBWrapper::CacheStats>& db) {
+            return db.first == name;
+        }) != all.end();
+    };
+    {
+        CDBWrapper dbw(GetDataDir() / "dbwrapper_cache_stats", 1 << 20, false, true);
+        BOOST_CHECK(find("dbwrapper_cache_stats"));
+        for (uint32_t i = 0; i < 100; ++i) {
+            BOOST_CHECK(dbw.Write(i, InsecureRand256()));
+        }
+        dbw.CompactRange(uint32_t{0}, uint32_t{100}); // to the table files, reads go through the block cache
+        uint256 res;
+        for (uint32_t i = 0; i < 100; ++i) {
+            BOOST_CHECK(dbw.Read(i, res));
+        }
+        auto const stats = dbw.GetCacheStats();
+        BOOST_CHECK_EQUAL(stats.capacity, (1 << 20) / 2);
+        BOOST_CHECK(stats.hits + stats.misses >= 100);
+        BOOST_CHECK_EQUAL(stats.writeBuffer, (1 << 20) / 4);
+    }
+    BOOST_CHECK(!find("dbwrapper_cache_stats"));
+}
+
 BOOST_AUTO_TEST_CASE(dbwrapper_iterator)
 {
     // Perform tests both obfuscated and non-obfuscated.
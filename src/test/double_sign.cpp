@@ -92,6 +92,49 @@ BOOST_AUTO_TEST_CASE(check_doublesign)
     BOOST_CHECK(blockHeaders.size() == 2);
 }
 
+BOOST_AUTO_TEST_CASE(minted_headers_pruning)
+{
+    uint256 const masternodeID = uint256S("0x1");
+    CBlockHeader header;
+    for (uint64_t height = 1; height <= 4; ++height) {
+        header.height = height;
+        header.mintedBlocks = height;
+        pcriminals->WriteMintedBlockHeader(masternodeID, height, header.GetHash(), header, false);
+        header.nTime = 1; // second header of the same height
+        pcriminals->WriteMintedBlockHeader(masternodeID, height, header.GetHash(), header, false);
+        header.nTime = 0;
+    }
+    auto countHeaders = [&] (uint64_t mintedBlocks) {
+        std::map<uint256, CBlockHeader> blockHeaders;
+        pcriminals->FetchMintedHeaders(masternodeID, mintedBlocks, blockHeaders, false);
+        return blockHeaders.size();
+    };
+
+    BOOST_CHECK(pcriminals->PruneMintedHeaders(3, 100) == 4);
+    BOOST_CHECK(countHeaders(2) == 0);
+    BOOST_CHECK(countHeaders(3) == 2);
+    // limited batch, the lowest first
+    BOOST_CHECK(pcriminals->PruneMintedHeaders(5, 3) == 3);
+    BOOST_CHECK(countHeaders(3) == 0);
+    BOOST_CHECK(countHeaders(4) == 1);
+
+    // explicitly erased headers leave the heights index too
+    std::map<uint256, CBlockHeader> blockHeaders;
+    BOOST_CHECK(pcriminals->FetchMintedHeaders(masternodeID, 4, blockHeaders, false));
+    BOOST_REQUIRE(blockHeaders.size() == 1);
+    header = blockHeaders.begin()->second;
+    pcriminals->EraseMintedBlockHeader(masternodeID, 4, blockHeaders.begin()->first);
+    BOOST_CHECK(countHeaders(4) == 0);
+    BOOST_CHECK(pcriminals->PruneMintedHeaders(5, 100) == 0);
+
+    // survives the flush to the db
+    pcriminals->WriteMintedBlockHeader(masternodeID, 5, header.GetHash(), header, false);
+    BOOST_CHECK(pcriminals->Flush() && pcriminalsDB->Flush());
+    BOOST_CHECK(countHeaders(5) == 1);
+    BOOST_CHECK(pcriminals->PruneMintedHeaders(5, 100) == 1);
+    BOOST_CHECK(countHeaders(5) == 0);
+}
+
 BOOST_AUTO_TEST_CASE(check_criminal_entities)
 {
     uint256 masternodeID = testMasternodeKeys.begin()->first;
@@ -144,4 +187,50 @@ BOOST_AUTO_TEST_CASE(check_blocking_criminal_coins)
    // BOOST_CHECK(penhancedview->FindBlockedCriminalCoins(masternodeID, 0, false));
 }
 
+BOOST_AUTO_TEST_CASE(punished_criminals)
+{
+    uint256 masternodeID = testMasternodeKeys.begin()->first;
+    CKey minterKey = testMasternodeKeys.begin()->second.operatorKey;
+    uint64_t mintedBlocks = 0;
+    std::vector<CBlockHeader> headers = GenerateTwoCriminalsHeaders(minterKey, mintedBlocks, masternodeID);
+
+    LOCK(cs_main);
+    pcriminals->AddCriminalProof(masternodeID, headers[0], headers[1]);
+    BOOST_CHECK(pcriminals->GetUnpunishedCriminals().size() == 1);
+
+    // criminal tx connected: the proof is dropped, the new ones are ignored
+    pcriminals->MarkCriminalPunished(masternodeID);
+    BOOST_CHECK(pcriminals->IsCriminalPunished(masternodeID));
+    BOOST_CHECK(pcriminals->GetUnpunishedCriminals().empty());
+    pcriminals->AddCriminalProof(masternodeID, headers[0], headers[1]);
+    BOOST_CHECK(pcriminals->GetUnpunishedCriminals().empty());
+
+    // disconnected
+    pcriminals->UnmarkCriminalPunished(masternodeID);
+    pcriminals->AddCriminalProof(masternodeID, headers[0], headers[1]);
+    BOOST_CHECK(pcriminals->GetUnpunishedCriminals().size() == 1);
+
+    // the flag is ahead of the chainstate (no ban on chain): dropped on startup, the new proofs are accepted again
+    pcriminals->MarkCriminalPunished(masternodeID);
+    BOOST_CHECK(pcriminals->ReconcilePunishedCriminals(*pcustomcsview) == 1);
+    BOOST_CHECK(!pcriminals->IsCriminalPunished(masternodeID));
+    pcriminals->AddCriminalProof(masternodeID, headers[0], headers[1]);
+    BOOST_CHECK(pcriminals->GetUnpunishedCriminals().size() == 1);
+
+    // the flags of the older db are built from the banned masternodes
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << headers[0] << headers[1] << masternodeID;
+    std::vector<unsigned char> metadata(ss.begin(), ss.end());
+    BOOST_REQUIRE(pcustomcsview->BanCriminal(uint256S("ba"), metadata, 1));
+    BOOST_CHECK(pcriminals->ReconcilePunishedCriminals(*pcustomcsview) == 1);
+    BOOST_CHECK(pcriminals->ReconcilePunishedCriminals(*pcustomcsview) == 0);
+    BOOST_CHECK(pcriminals->IsCriminalPunished(masternodeID));
+    BOOST_CHECK(pcriminals->GetUnpunishedCriminals().empty());
+
+    // the flag is lost (criminals db behind the chainstate after a crash), the ban on chain still counts
+    pcriminals->UnmarkCriminalPunished(masternodeID);
+    pcriminals->AddCriminalProof(masternodeID, headers[0], headers[1]);
+    BOOST_CHECK(pcriminals->GetUnpunishedCriminals().empty());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
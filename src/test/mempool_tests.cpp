@@ -2,6 +2,8 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <masternodes/masternodes.h>
+#include <masternodes/mn_checks.h>
 #include <policy/policy.h>
 #include <txmempool.h>
 #include <util/system.h>
@@ -751,4 +753,63 @@ BOOST_AUTO_TEST_CASE(MempoolAncestryTests)
     BOOST_CHECK_EQUAL(descendants, 6ULL);
 }
 
+static CTransactionRef MakeAccountToAccountTx(CScript const & from, CScript const & to, CAmount amount, COutPoint const & auth)
+{
+    CDataStream metadata(DfTxMarker, SER_NETWORK, PROTOCOL_VERSION);
+    metadata << static_cast<unsigned char>(CustomTxType::AccountToAccount)
+             << CAccountToAccountMessage{from, {{to, CBalances{{{DCT_ID{0}, amount}}}}}};
+
+    CMutableTransaction mtx;
+    mtx.vin.emplace_back(auth);
+    mtx.vout.emplace_back(0, CScript() << OP_RETURN << ToByteVector(metadata));
+    mtx.vout.emplace_back(COIN / 2, from);
+    return MakeTransactionRef(std::move(mtx));
+}
+
+BOOST_AUTO_TEST_CASE(MempoolPendingCustomView)
+{
+    CTxMemPool pool;
+    TestMemPoolEntryHelper entry;
+    uint32_t const height = 1;
+
+    CScript const owner = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 1) << OP_EQUALVERIFY << OP_CHECKSIG;
+    CScript const other = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 2) << OP_EQUALVERIFY << OP_CHECKSIG;
+    BOOST_REQUIRE(pcustomcsview->AddBalance(owner, CTokenAmount{DCT_ID{0}, 100 * COIN}).ok);
+
+    // auth inputs of the owner
+    CCoinsView dummy;
+    CCoinsViewCache coins(&dummy);
+    COutPoint const auth1(uint256S("01"), 0), auth2(uint256S("02"), 0);
+    coins.AddCoin(auth1, Coin(CTxOut(COIN, owner), 1, false), false);
+    coins.AddCoin(auth2, Coin(CTxOut(COIN, owner), 1, false), false);
+
+    // both transfers apply to the confirmed state, but not together
+    auto tx1 = MakeAccountToAccountTx(owner, other, 60 * COIN, auth1);
+    auto tx2 = MakeAccountToAccountTx(owner, other, 60 * COIN, auth2);
+
+    LOCK2(cs_main, pool.cs);
+    pool.UpdatePendingCustomView(coins, height);
+    BOOST_CHECK(pool.CheckPendingCustomTx(coins, *tx1, height).ok);
+    BOOST_CHECK(pool.CheckPendingCustomTx(coins, *tx2, height).ok);
+
+    pool.AddPendingCustomTx(coins, *tx1, height);
+    pool.addUnchecked(entry.FromTx(tx1));
+    BOOST_CHECK(!pool.CheckPendingCustomTx(coins, *tx2, height).ok);
+    // confirmed state is untouched
+    BOOST_CHECK_EQUAL(pcustomcsview->GetBalance(owner, DCT_ID{0}).nValue, 100 * COIN);
+
+    // removal of the pending transfer releases its balance
+    pool.removeRecursive(*tx1, REMOVAL_REASON_DUMMY);
+    pool.UpdatePendingCustomView(coins, height);
+    BOOST_CHECK(pool.CheckPendingCustomTx(coins, *tx2, height).ok);
+
+    // pending transfer which doesn't apply to the new confirmed state is removed by rebuild
+    pool.AddPendingCustomTx(coins, *tx2, height);
+    pool.addUnchecked(entry.FromTx(tx2));
+    BOOST_REQUIRE(pcustomcsview->SubBalance(owner, CTokenAmount{DCT_ID{0}, 50 * COIN}).ok);
+    pool.RebuildPendingCustomView(coins, height + 1);
+    BOOST_CHECK(!pool.exists(tx2->GetHash()));
+    BOOST_CHECK(pool.CheckPendingCustomTx(coins, *MakeAccountToAccountTx(owner, other, 50 * COIN, auth1), height + 1).ok);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
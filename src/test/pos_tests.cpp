@@ -80,6 +80,21 @@ BOOST_AUTO_TEST_CASE(calc_kernel)
 //    BOOST_CHECK(pos::ComputeStakeModifier(prevStakeModifier, keyID) == targetStakeModifier);
 }
 
+BOOST_AUTO_TEST_CASE(kernel_search)
+{
+    uint256 stakeModifier = uint256S("1234567890abcdef1234567890abcdef1234567890abcdef1234567890abcdef");
+    uint256 mnID = uint256S("fedcba0987654321fedcba0987654321fedcba0987654321fedcba0987654321");
+
+    // each of the targets is met by the part of the hashes, plus the unattainable and the overflowing ones
+    for (uint32_t nBits : {0x00ffffffu, 0x1d00ffffu, 0x1e7fffffu, 0x1effffffu, 0x1f00ffffu, 0x207fffffu}) {
+        pos::CKernelSearch kernel(stakeModifier, nBits, mnID);
+        for (int64_t coinstakeTime = 10000000; coinstakeTime < 10000000 + 500; ++coinstakeTime) {
+            BOOST_CHECK(kernel.Hash(coinstakeTime) == pos::CalcKernelHash(stakeModifier, coinstakeTime, mnID, Params().GetConsensus()));
+            BOOST_CHECK_EQUAL(kernel.Check(coinstakeTime), pos::CheckKernelHash(stakeModifier, nBits, coinstakeTime, Params().GetConsensus(), mnID).hashOk);
+        }
+    }
+}
+
 BOOST_AUTO_TEST_CASE(check_stake_modifier)
 {
     uint256 masternodeID = testMasternodeKeys.begin()->first;
@@ -11,6 +11,7 @@
 #include <consensus/validation.h>
 #include <crypto/sha256.h>
 #include <init.h>
+#include <masternodes/anchor_queue.h>
 #include <masternodes/anchors.h>
 #include <masternodes/criminals.h>
 #include <miner.h>
@@ -115,8 +116,11 @@ TestingSetup::TestingSetup(const std::string& chainName) : BasicTestingSetup(cha
         LOCK(cs_main);
 
         pcriminals.reset();
-        pcriminals = MakeUnique<CCriminalsView>(GetDataDir() / "criminals", nMinDbCache << 20, true, true);
+        pcriminalsDB.reset();
+        pcriminalsDB = MakeUnique<CStorageLevelDB>(GetDataDir() / "criminals", nMinDbCache << 20, true, true);
+        pcriminals = MakeUnique<CCriminalsView>(*pcriminalsDB.get());
 
+        ReleaseCustomCSSnapshot();
         pcustomcsDB.reset();
         pcustomcsDB = MakeUnique<CStorageLevelDB>(GetDataDir() / "enhancedcs", nMinDbCache << 20, true, true);
         pcustomcsview = MakeUnique<CCustomCSView>(*pcustomcsDB.get());
@@ -142,6 +146,8 @@ TestingSetup::TestingSetup(const std::string& chainName) : BasicTestingSetup(cha
     nScriptCheckThreads = 3;
     for (int i = 0; i < nScriptCheckThreads - 1; i++)
         threadGroup.create_thread([i]() { return ThreadScriptCheck(i); });
+    for (int i = 0; i < GetAuxCheckThreads() - 1; i++)
+        threadGroup.create_thread([i]() { return ThreadAuxCheck(i); });
 
     g_banman = MakeUnique<BanMan>(GetDataDir() / "banlist.dat", nullptr, DEFAULT_MISBEHAVING_BANTIME);
     g_connman = MakeUnique<CConnman>(0x1337, 0x1337); // Deterministic randomness for tests.
@@ -158,12 +164,15 @@ TestingSetup::~TestingSetup()
     UnloadBlockIndex();
     g_chainstate.reset();
 
+    g_anchorMessageQueue.Clear();
     panchors.reset();
     panchorAwaitingConfirms.reset();
     panchorauths.reset();
+    ReleaseCustomCSSnapshot();
     pcustomcsview.reset();
     pcustomcsDB.reset();
     pcriminals.reset();
+    pcriminalsDB.reset();
 
     pblocktree.reset();
 }
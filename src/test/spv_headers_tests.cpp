@@ -0,0 +1,89 @@
+// Copyright (c) 2020 The DeFi Blockchain Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <spv/spv_headers.h>
+#include <tinyformat.h>
+#include <util/system.h>
+
+#include <test/setup_common.h>
+
+#include <cstdio>
+#include <utility>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(spv_headers_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(spv_headers_store)
+{
+    fs::path const dir = GetDataDir() / "spv_headers_test";
+    fs::create_directories(dir);
+    auto header = [] (uint32_t height, char fork) {
+        return std::vector<uint8_t>(80 + height % 7, static_cast<uint8_t>(fork));
+    };
+    auto hash = [] (uint32_t height, char fork) {
+        return uint256S(strprintf("%c%x", fork, height));
+    };
+    {
+        spv::CSpvHeaderStore store(dir / "headers.dat", dir / "headers.idx");
+        // transition blocks, then the continuous chain
+        BOOST_CHECK(store.Write(0, hash(0, 'a'), header(0, 'a')));
+        BOOST_CHECK(store.Write(2016, hash(2016, 'a'), header(2016, 'a')));
+        for (uint32_t height = 4032; height < 4100; ++height) {
+            BOOST_CHECK(store.Write(height, hash(height, 'a'), header(height, 'a')));
+        }
+        BOOST_CHECK(store.Size() == 70);
+        BOOST_CHECK(store.TipHeight() == 4099);
+
+        // reorg: rewriting at the stored height truncates the tail
+        BOOST_CHECK(store.Write(4090, hash(4090, 'b'), header(4090, 'b')));
+        BOOST_CHECK(store.Size() == 61);
+        BOOST_CHECK(store.TipHeight() == 4090);
+
+        std::vector<std::pair<uint32_t, uint256>> hashes{{4088, hash(4088, 'a')}, {4089, hash(4089, 'a')}, {4090, hash(4090, 'a')}};
+        BOOST_CHECK(store.CountStored(hashes) == 2);
+        hashes[2].second = hash(4090, 'b');
+        BOOST_CHECK(store.CountStored(hashes) == 3);
+        BOOST_CHECK(store.CountStored({{3000, hash(3000, 'a')}}) == 0);
+        BOOST_CHECK(store.Flush());
+    }
+    {
+        // reopened, binary searched by height
+        spv::CSpvHeaderStore store(dir / "headers.dat", dir / "headers.idx");
+        BOOST_CHECK(store.Size() == 61);
+        std::vector<uint32_t> heights;
+        BOOST_CHECK(store.Load(3000, [&] (uint32_t height, std::vector<uint8_t> & block) {
+            BOOST_CHECK(block == header(height, height == 4090 ? 'b' : 'a'));
+            heights.push_back(height);
+        }) == 59);
+        BOOST_CHECK(heights.front() == 4032 && heights.back() == 4090);
+        BOOST_CHECK(store.Load(5000, [] (uint32_t, std::vector<uint8_t> &) {}) == 0);
+
+        BOOST_CHECK(store.Truncate(2017));
+        BOOST_CHECK(store.Size() == 2);
+        BOOST_CHECK(store.TipHeight() == 2016);
+    }
+    {
+        // unfinished tail (index entry w/o data) is dropped on open
+        FILE* file = fsbridge::fopen(dir / "headers.idx", "ab");
+        std::vector<uint8_t> const garbage(48, 1);
+        fwrite(garbage.data(), 1, garbage.size(), file);
+        fclose(file);
+        spv::CSpvHeaderStore store(dir / "headers.dat", dir / "headers.idx");
+        BOOST_CHECK(store.Size() == 2);
+        BOOST_CHECK(store.TipHeight() == 2016);
+    }
+    {
+        spv::CSpvHeaderStore wiped(dir / "headers.dat", dir / "headers.idx", false, true);
+        BOOST_CHECK(wiped.Size() == 0);
+        spv::CSpvHeaderStore memory(dir / "unused.dat", dir / "unused.idx", true);
+        BOOST_CHECK(memory.Write(1, hash(1, 'a'), header(1, 'a')));
+        BOOST_CHECK(memory.Load(0, [] (uint32_t, std::vector<uint8_t> &) {}) == 1);
+        BOOST_CHECK(!fs::exists(dir / "unused.dat"));
+    }
+    fs::remove_all(dir);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -2,11 +2,14 @@
 #include <rpc/client.h>
 #include <rpc/util.h>
 
+#include <arith_uint256.h>
+#include <chainparams.h>
 #include <interfaces/chain.h>
 #include <key_io.h>
 #include <masternodes/masternodes.h>
 #include <rpc/rawtransaction_util.h>
 #include <test/setup_common.h>
+#include <txdb.h>
 
 #include <boost/algorithm/string.hpp>
 #include <boost/test/unit_test.hpp>
@@ -118,6 +121,483 @@ BOOST_AUTO_TEST_CASE(undo)
     BOOST_CHECK(snapStart == TakeSnapshot(base_raw));
 }
 
+BOOST_AUTO_TEST_CASE(undos_pruning)
+{
+    auto countUndos = [] () {
+        size_t count = 0;
+        pcustomcsview->ForEachUndo([&] (UndoKey, CUndo const &) {
+            ++count;
+            return true;
+        }, UndoKey{0, uint256()});
+        return count;
+    };
+    CUndo undo;
+    undo.before[ToBytes("testkey")] = ToBytes("value");
+    for (uint32_t height = 1; height <= 5; ++height) {
+        pcustomcsview->SetUndo(UndoKey{height, uint256()}, undo); // "zero hash"
+        pcustomcsview->SetUndo(UndoKey{height, uint256S("0x1")}, undo);
+    }
+    BOOST_CHECK(countUndos() == 10);
+    BOOST_CHECK(pcustomcsview->GetUndosPrunedHeight() == 0);
+
+    BOOST_CHECK(pcustomcsview->PruneUndos(3, 100) == 4);
+    BOOST_CHECK(countUndos() == 6);
+    BOOST_CHECK(!pcustomcsview->GetUndo(UndoKey{2, uint256S("0x1")}));
+    BOOST_CHECK(pcustomcsview->GetUndo(UndoKey{3, uint256()}));
+    BOOST_CHECK(pcustomcsview->GetUndosPrunedHeight() == 3);
+
+    // batch stops in the middle of the height, which makes the whole height unusable
+    BOOST_CHECK(pcustomcsview->PruneUndos(5, 1) == 1);
+    BOOST_CHECK(pcustomcsview->GetUndosPrunedHeight() == 4);
+    BOOST_CHECK(pcustomcsview->PruneUndos(5, 100) == 3);
+    BOOST_CHECK(pcustomcsview->PruneUndos(5, 100) == 0);
+    BOOST_CHECK(countUndos() == 2);
+    BOOST_CHECK(pcustomcsview->GetUndosPrunedHeight() == 5);
+
+    // the next prunes start from the pruned height, nothing below is visited again
+    pcustomcsview->SetUndo(UndoKey{1, uint256()}, undo);
+    BOOST_CHECK(pcustomcsview->PruneUndos(6, 100) == 2);
+    BOOST_CHECK(pcustomcsview->GetUndo(UndoKey{1, uint256()}));
+    BOOST_CHECK(pcustomcsview->GetUndosPrunedHeight() == 6);
+}
+
+BOOST_AUTO_TEST_CASE(write_buffer)
+{
+    CStorageKV & base_raw = pcustomcsview->GetRaw();
+    pcustomcsview->Write("testkey1", "value0");
+    pcustomcsview->Write("testkey3", "value3");
+
+    CCustomCSView mnview(*pcustomcsview);
+    auto& flushable = dynamic_cast<CFlushableStorageKV&>(mnview.GetRaw());
+    BOOST_CHECK(mnview.Write("testkey2", "value2")); // insert
+    BOOST_CHECK(mnview.Write("testkey1", "longer value1")); // modify, grows
+    BOOST_CHECK(mnview.Write("testkey1", "value1")); // modify, in place
+    BOOST_CHECK(mnview.Erase("testkey3"));
+    BOOST_CHECK(flushable.GetRaw().size() == 3);
+    size_t const usage = mnview.DynamicMemoryUsage();
+    BOOST_CHECK(mnview.GetPendingChanges() == 3 && usage >= flushable.GetRaw().GetArena().AllocatedBytes());
+
+    TBytes val;
+    BOOST_CHECK(flushable.Read(ToBytes("testkey1"), val) && val == ToBytes("value1"));
+    BOOST_CHECK(!mnview.Exists("testkey3"));
+    BOOST_CHECK(pcustomcsview->Exists("testkey3")); // untouched until flush
+
+    // tombstone hides the underlying record, buffer entries are merged in key order
+    auto snap = TakeSnapshot(flushable);
+    BOOST_CHECK(snap.count(ToBytes("testkey3")) == 0);
+    BOOST_CHECK(snap.at(ToBytes("testkey1")) == ToBytes("value1"));
+    BOOST_CHECK(snap.at(ToBytes("testkey2")) == ToBytes("value2"));
+
+    // erased and rewritten
+    BOOST_CHECK(mnview.Erase("testkey2"));
+    BOOST_CHECK(!mnview.Exists("testkey2"));
+    BOOST_CHECK(mnview.Write("testkey2", "value22"));
+    BOOST_CHECK(flushable.Read(ToBytes("testkey2"), val) && val == ToBytes("value22"));
+
+    mnview.Flush();
+    BOOST_CHECK(flushable.GetRaw().empty());
+    BOOST_CHECK(mnview.GetPendingChanges() == 0 && mnview.DynamicMemoryUsage() <= usage); // the last chunk is kept
+    BOOST_CHECK(TakeSnapshot(base_raw) == TakeSnapshot(flushable));
+    BOOST_CHECK(!pcustomcsview->Exists("testkey3"));
+    BOOST_CHECK(base_raw.Read(ToBytes("testkey2"), val) && val == ToBytes("value22"));
+}
+
+struct ByTestKey { static const unsigned char prefix; };
+const unsigned char ByTestKey::prefix = 'z';
+
+BOOST_AUTO_TEST_CASE(for_each_layers)
+{
+    // three layers: leveldb, the buffer of pcustomcsview and the buffer of mnview
+    for (uint8_t i = 1; i <= 5; ++i) {
+        pcustomcsview->WriteBy<ByTestKey>(i, int32_t{i});
+    }
+    pcustomcsview->Write(std::make_pair('y', uint8_t{9}), int32_t{-1}); // neighbour prefixes
+    pcustomcsview->Write(std::make_pair('{', uint8_t{0}), int32_t{-1});
+    pcustomcsview->Flush();
+    pcustomcsview->WriteBy<ByTestKey>(uint8_t{6}, int32_t{6});
+
+    CCustomCSView mnview(*pcustomcsview);
+    mnview.WriteBy<ByTestKey>(uint8_t{2}, int32_t{20}); // shadows
+    mnview.EraseBy<ByTestKey>(uint8_t{3});               // hides
+    mnview.WriteBy<ByTestKey>(uint8_t{0}, int32_t{100});
+    mnview.WriteBy<ByTestKey>(uint8_t{7}, int32_t{7});
+
+    auto collect = [&] (uint8_t start, size_t limit) {
+        std::vector<std::pair<uint8_t, int32_t>> result;
+        mnview.ForEach<ByTestKey, uint8_t, int32_t>([&] (uint8_t const & key, int32_t & value) {
+            result.emplace_back(key, value);
+            return result.size() < limit;
+        }, start);
+        return result;
+    };
+    using Entries = std::vector<std::pair<uint8_t, int32_t>>;
+    BOOST_CHECK(collect(0, 100) == (Entries{{0, 100}, {1, 1}, {2, 20}, {4, 4}, {5, 5}, {6, 6}, {7, 7}}));
+    BOOST_CHECK(collect(3, 100) == (Entries{{4, 4}, {5, 5}, {6, 6}, {7, 7}}));
+    BOOST_CHECK(collect(2, 2) == (Entries{{2, 20}, {4, 4}}));
+    BOOST_CHECK(collect(8, 100).empty());
+}
+
+BOOST_AUTO_TEST_CASE(custom_snapshot)
+{
+    pcustomcsview->WriteBy<ByTestKey>(uint8_t{1}, int32_t{1});
+    pcustomcsview->Flush();
+    pcustomcsDB->Flush();
+    pcustomcsview->WriteBy<ByTestKey>(uint8_t{2}, int32_t{2}); // pending, not in the db yet
+
+    CCustomCSSnapshot snapshot(*pcustomcsDB, *pcustomcsview, 10, uint256S("0x10"));
+
+    // later blocks: changes in the view and in the db don't reach the snapshot
+    pcustomcsview->WriteBy<ByTestKey>(uint8_t{1}, int32_t{10});
+    pcustomcsview->EraseBy<ByTestKey>(uint8_t{2});
+    pcustomcsview->WriteBy<ByTestKey>(uint8_t{3}, int32_t{3});
+    int32_t pending{0};
+    BOOST_CHECK(pcustomcsview->ReadBy<ByTestKey>(uint8_t{1}, pending) && pending == 10);
+    BOOST_CHECK(!pcustomcsview->ExistsBy<ByTestKey>(uint8_t{2}));
+    pcustomcsview->Flush();
+    pcustomcsDB->Flush();
+
+    std::vector<std::pair<uint8_t, int32_t>> entries;
+    snapshot.View().ForEach<ByTestKey, uint8_t, int32_t>([&] (uint8_t const & key, int32_t & value) {
+        entries.emplace_back(key, value);
+        return true;
+    });
+    BOOST_CHECK(entries == (std::vector<std::pair<uint8_t, int32_t>>{{1, 1}, {2, 2}}));
+    int32_t value{0};
+    BOOST_CHECK(snapshot.View().ReadBy<ByTestKey>(uint8_t{1}, value) && value == 1);
+    BOOST_CHECK(!snapshot.View().ExistsBy<ByTestKey>(uint8_t{3}));
+    BOOST_CHECK(snapshot.GetHeight() == 10);
+
+    // shared while the tip is the same
+    LOCK(cs_main);
+    auto first = GetCustomCSSnapshot(10, uint256S("0x10"));
+    BOOST_CHECK(first == GetCustomCSSnapshot(10, uint256S("0x10")));
+    BOOST_CHECK(first != GetCustomCSSnapshot(11, uint256S("0x11")));
+    ReleaseCustomCSSnapshot();
+}
+
+BOOST_AUTO_TEST_CASE(frozen_layers)
+{
+    CFlushableStorageKV storage(*pcustomcsDB);
+    std::vector<CFlushableStorageKV::TLayers> frozen;
+    for (unsigned char i = 0; i < 64; i++) {
+        storage.Write({i}, {i});
+        frozen.push_back(storage.Freeze());
+        BOOST_CHECK(storage.FrozenLayers() <= 7);
+    }
+    BOOST_CHECK(storage.PendingChanges() >= 64);
+
+    // later changes don't reach the frozen layers
+    storage.Write({0}, {100});
+    storage.Erase({1});
+    CFlushableStorageKV tenth(*pcustomcsDB, frozen[9]);
+    TBytes value;
+    BOOST_CHECK(tenth.Read({0}, value) && value == TBytes{0});
+    BOOST_CHECK(tenth.Exists({1}) && tenth.Exists({9}) && !tenth.Exists({10}));
+    BOOST_CHECK(storage.Read({0}, value) && value == TBytes{100});
+    BOOST_CHECK(!storage.Exists({1}) && storage.Exists({63}));
+
+    size_t count = 0;
+    auto it = tenth.NewIterator();
+    for (it->Seek({}); it->Valid() && it->KeySlice()[0] < 64; it->Next()) {
+        count += it->KeySlice().size() == 1;
+    }
+    BOOST_CHECK(count == 10);
+
+    BOOST_CHECK(storage.Flush());
+    BOOST_CHECK(storage.FrozenLayers() == 0 && storage.PendingChanges() == 0);
+    BOOST_CHECK(pcustomcsDB->Read({0}, value) && value == TBytes{100});
+    BOOST_CHECK(!pcustomcsDB->Exists({1}) && pcustomcsDB->Exists({63}));
+}
+
+BOOST_AUTO_TEST_CASE(hosted_in_chainstate)
+{
+    CCoinsViewDB coinsdb(GetDataDir() / "test_chainstate", 1 << 20, true, true);
+    CStorageLevelDB hosted(coinsdb.GetDB(), coinsdb.GetHostedBatch(), CCoinsViewDB::DB_CUSTOM_STATE);
+    CCustomCSView view(hosted);
+    for (uint8_t i = 1; i <= 3; ++i) {
+        view.WriteBy<ByTestKey>(i, int32_t{i});
+    }
+    BOOST_CHECK(view.Flush());
+    BOOST_CHECK(!view.ExistsBy<ByTestKey>(uint8_t{1})); // staged, committed with the coins
+
+    CCoinsMap coins;
+    BOOST_CHECK(coinsdb.BatchWrite(coins, uint256S("0x01")));
+    BOOST_CHECK(coinsdb.GetBestBlock() == uint256S("0x01"));
+    int32_t value{0};
+    BOOST_CHECK(view.ReadBy<ByTestKey>(uint8_t{2}, value) && value == 2);
+    BOOST_CHECK(coinsdb.GetHostedBatch().SizeEstimate() == 0);
+
+    // own keyspace: the coins records are not visible
+    size_t count = 0;
+    view.ForEach<ByTestKey, uint8_t, int32_t>([&] (uint8_t const & key, int32_t & val) {
+        ++count;
+        return key == val;
+    });
+    BOOST_CHECK(count == 3);
+    auto it = hosted.NewIterator();
+    it->Seek({});
+    BOOST_CHECK(it->Valid() && it->KeySlice()[0] == ByTestKey::prefix);
+
+    // flushed alone (out of the state flush)
+    view.EraseBy<ByTestKey>(uint8_t{3});
+    BOOST_CHECK(view.Flush() && hosted.Flush());
+    BOOST_CHECK(!view.ExistsBy<ByTestKey>(uint8_t{3}));
+
+    // switching -customcsinchainstate back and forth
+    CStorageLevelDB separate(GetDataDir() / "test_enhancedcs", 1 << 20, true, true);
+    BOOST_CHECK(MoveCustomCSStorage(hosted, separate) == 2);
+    BOOST_CHECK(!view.ExistsBy<ByTestKey>(uint8_t{1}));
+    BOOST_CHECK(coinsdb.GetBestBlock() == uint256S("0x01"));
+    BOOST_CHECK(CCustomCSView(separate).ReadBy<ByTestKey>(uint8_t{1}, value) && value == 1);
+    BOOST_CHECK(MoveCustomCSStorage(separate, hosted) == 2);
+    BOOST_CHECK(MoveCustomCSStorage(separate, hosted) == 0);
+    BOOST_CHECK(view.ReadBy<ByTestKey>(uint8_t{2}, value) && value == 2);
+}
+
+BOOST_AUTO_TEST_CASE(read_cache)
+{
+    pcustomcsview->EnableReadCache(100);
+    CScript const owner = CScript(OP_TRUE);
+    DCT_ID const token{1};
+    auto hits = [] () { return pcustomcsview->GetReadCacheStats()->hits; };
+
+    BOOST_CHECK(pcustomcsview->GetBalance(owner, token).nValue == 0);
+    BOOST_CHECK(pcustomcsview->GetBalance(owner, token).nValue == 0); // absent key is cached too
+    BOOST_CHECK(hits() == 1);
+
+    // write to the cached view invalidates
+    BOOST_CHECK(pcustomcsview->AddBalance(owner, CTokenAmount{token, 10}).ok);
+    BOOST_CHECK(pcustomcsview->GetBalance(owner, token).nValue == 10);
+    BOOST_CHECK(pcustomcsview->GetBalance(owner, token).nValue == 10);
+
+    // nested view sees its own changes, cache of the parent is not affected until flush
+    {
+        CCustomCSView mnview(*pcustomcsview);
+        BOOST_CHECK(mnview.GetBalance(owner, token).nValue == 10);
+        BOOST_CHECK(mnview.AddBalance(owner, CTokenAmount{token, 5}).ok);
+        auto const hitsBefore = hits();
+        BOOST_CHECK(mnview.GetBalance(owner, token).nValue == 15);
+        BOOST_CHECK(hits() == hitsBefore);
+        BOOST_CHECK(pcustomcsview->GetBalance(owner, token).nValue == 10);
+
+        // undo data of the nested changes, then flush
+        auto undo = CUndo::Construct(pcustomcsview->GetRaw(), dynamic_cast<CFlushableStorageKV&>(mnview.GetRaw()).GetRaw());
+        mnview.Flush();
+        pcustomcsview->SetUndo(UndoKey{1, uint256S("0x1")}, undo);
+    }
+    BOOST_CHECK(pcustomcsview->GetBalance(owner, token).nValue == 15);
+
+    // flush to the db keeps cached values
+    pcustomcsview->Flush();
+    auto const hitsBefore = hits();
+    BOOST_CHECK(pcustomcsview->GetBalance(owner, token).nValue == 15);
+    BOOST_CHECK(hits() == hitsBefore + 1);
+
+    pcustomcsview->OnUndoTx(uint256S("0x1"), 1);
+    BOOST_CHECK(pcustomcsview->GetBalance(owner, token).nValue == 10);
+
+    BOOST_CHECK(pcustomcsview->SubBalance(owner, CTokenAmount{token, 10}).ok);
+    BOOST_CHECK(pcustomcsview->GetBalance(owner, token).nValue == 0);
+    BOOST_CHECK(pcustomcsview->GetReadCacheStats()->invalidations > 0);
+}
+
+BOOST_AUTO_TEST_CASE(token_holders)
+{
+    CScript const owner1 = CScript(OP_TRUE);
+    CScript const owner2 = CScript(OP_FALSE);
+    DCT_ID const token{1};
+    auto holders = [&] (CCustomCSView const & view) {
+        std::map<CScript, CAmount> result;
+        view.ForEachTokenHolder(token, [&] (CScript const & owner, CAmount amount) {
+            result.emplace(owner, amount);
+            return true;
+        });
+        return result;
+    };
+
+    BOOST_CHECK(pcustomcsview->AddBalance(owner1, CTokenAmount{token, 10}).ok);
+    BOOST_CHECK(pcustomcsview->AddBalance(owner1, CTokenAmount{DCT_ID{2}, 7}).ok); // another token
+    auto const snapStart = TakeSnapshot(pcustomcsview->GetRaw());
+
+    CCustomCSView mnview(*pcustomcsview);
+    BOOST_CHECK(mnview.AddBalance(owner2, CTokenAmount{token, 5}).ok);
+    BOOST_CHECK(mnview.SubBalance(owner1, CTokenAmount{token, 10}).ok);
+    BOOST_CHECK(mnview.GetTokenSupply(token).holders == 1);
+    BOOST_CHECK(mnview.GetTokenSupply(token).supply == 5);
+    BOOST_CHECK(holders(mnview) == (std::map<CScript, CAmount>{{owner2, 5}}));
+
+    auto undo = CUndo::Construct(pcustomcsview->GetRaw(), dynamic_cast<CFlushableStorageKV&>(mnview.GetRaw()).GetRaw());
+    mnview.Flush();
+    BOOST_CHECK(pcustomcsview->GetTokenSupply(token).supply == 5);
+
+    // index and supply are reverted together with balances
+    CUndo::Revert(pcustomcsview->GetRaw(), undo);
+    BOOST_CHECK(snapStart == TakeSnapshot(pcustomcsview->GetRaw()));
+    BOOST_CHECK(pcustomcsview->GetTokenSupply(token).holders == 1);
+    BOOST_CHECK(pcustomcsview->GetTokenSupply(token).supply == 10);
+    BOOST_CHECK(holders(*pcustomcsview) == (std::map<CScript, CAmount>{{owner1, 10}}));
+    BOOST_CHECK(pcustomcsview->GetTokenSupply(DCT_ID{2}).supply == 7);
+
+    // full rebuild gives the same records
+    pcustomcsview->ReindexTokenHolders(1);
+    BOOST_CHECK(pcustomcsview->HasTokenHoldersIndex());
+    BOOST_CHECK(pcustomcsview->GetTokenHoldersIndexHeight() == 1);
+    auto snapReindexed = TakeSnapshot(pcustomcsview->GetRaw());
+    snapReindexed.erase(TBytes{'I'});
+    BOOST_CHECK(snapStart == snapReindexed);
+
+    // the undos written before the index revert the balances only, the rebuild drops the stale records
+    CCustomCSView mnview2(*pcustomcsview);
+    BOOST_CHECK(mnview2.AddBalance(owner2, CTokenAmount{token, 5}).ok);
+    auto legacyUndo = CUndo::Construct(pcustomcsview->GetRaw(), dynamic_cast<CFlushableStorageKV&>(mnview2.GetRaw()).GetRaw());
+    for (auto it = legacyUndo.before.begin(); it != legacyUndo.before.end(); ) {
+        it = it->first[0] == CAccountsView::ByBalanceKey::prefix ? std::next(it) : legacyUndo.before.erase(it);
+    }
+    mnview2.Flush();
+    CUndo::Revert(pcustomcsview->GetRaw(), legacyUndo);
+    BOOST_CHECK(holders(*pcustomcsview).size() == 2);
+    pcustomcsview->ReindexTokenHolders(0);
+    snapReindexed = TakeSnapshot(pcustomcsview->GetRaw());
+    snapReindexed.erase(TBytes{'I'});
+    BOOST_CHECK(snapStart == snapReindexed);
+}
+
+BOOST_AUTO_TEST_CASE(active_masternodes)
+{
+    // the previous implementation: scan of the whole masternodes table
+    auto scanTeam = [] (CCustomCSView & view, uint256 const & stakeModifier, int height) {
+        std::map<arith_uint256, CKeyID> priorityMN;
+        view.ForEachMasternode([&] (uint256 const & id, CMasternode & node) {
+            if (node.IsActive(height)) {
+                CDataStream ss{SER_GETHASH, PROTOCOL_VERSION};
+                ss << id << stakeModifier;
+                priorityMN.emplace(UintToArith256(Hash(ss.begin(), ss.end())), node.operatorAuthAddress);
+            }
+            return true;
+        });
+        CTeamView::CTeam team;
+        for (auto it = priorityMN.begin(); it != priorityMN.end() && team.size() < (size_t) Params().GetConsensus().mn.anchoringTeamSize; ++it) {
+            team.insert(it->second);
+        }
+        return team;
+    };
+    int const height = 10 + GetMnActivationDelay();
+    auto const snapStart = TakeSnapshot(pcustomcsview->GetRaw());
+
+    CCustomCSView mnview(*pcustomcsview);
+    std::vector<uint256> ids;
+    for (int i = 0; i < 20; ++i) {
+        CMasternode node;
+        node.operatorType = node.ownerType = 1;
+        node.operatorAuthAddress = CKeyID(uint160(std::vector<unsigned char>(20, 2 * i + 1)));
+        node.ownerAuthAddress = CKeyID(uint160(std::vector<unsigned char>(20, 2 * i + 2)));
+        node.creationHeight = i < 15 ? 10 : height; // last ones are not active yet
+        ids.push_back(ArithToUint256(arith_uint256(1000 + i)));
+        BOOST_REQUIRE(mnview.CreateMasternode(ids.back(), node).ok);
+    }
+    BOOST_CHECK(mnview.ResignMasternode(ids[0], uint256S("01"), height).ok); // still active
+    BOOST_CHECK(mnview.ResignMasternode(ids[1], uint256S("02"), height - GetMnResignDelay()).ok); // not active
+
+    for (int i = 0; i < 10; ++i) {
+        auto const stakeModifier = ArithToUint256(arith_uint256(i));
+        BOOST_CHECK(mnview.CalcNextTeam(stakeModifier, height) == scanTeam(mnview, stakeModifier, height));
+        BOOST_CHECK(mnview.CalcNextTeam(stakeModifier, height) == scanTeam(mnview, stakeModifier, height)); // memoized
+        BOOST_CHECK(mnview.CalcNextTeam(stakeModifier, height + GetMnResignDelay()) == scanTeam(mnview, stakeModifier, height + GetMnResignDelay()));
+    }
+    BOOST_CHECK(mnview.GetActiveSetVersion() != pcustomcsview->GetActiveSetVersion());
+
+    // index is reverted together with masternodes, so is the version (and the memoized teams)
+    auto undo = CUndo::Construct(pcustomcsview->GetRaw(), dynamic_cast<CFlushableStorageKV&>(mnview.GetRaw()).GetRaw());
+    mnview.Flush();
+    CUndo::Revert(pcustomcsview->GetRaw(), undo);
+    BOOST_CHECK(snapStart == TakeSnapshot(pcustomcsview->GetRaw()));
+    BOOST_CHECK(pcustomcsview->CalcNextTeam(uint256(), height) == scanTeam(*pcustomcsview, uint256(), height));
+
+    // full rebuild gives the same index records
+    auto activities = [] (CCustomCSView & view) {
+        std::map<uint256, TBytes> result;
+        view.ForEachMasternodeActivity([&] (uint256 const & id, CMasternodeActivity const & activity) {
+            CDataStream ss{SER_DISK, CLIENT_VERSION};
+            ss << activity;
+            result.emplace(id, TBytes(ss.begin(), ss.end()));
+            return true;
+        });
+        return result;
+    };
+    auto const before = activities(*pcustomcsview);
+    pcustomcsview->ReindexActiveMasternodes(0);
+    BOOST_CHECK(pcustomcsview->HasActiveMasternodesIndex());
+    BOOST_CHECK(before == activities(*pcustomcsview));
+}
+
+BOOST_AUTO_TEST_CASE(indexes_rebuilt_on_undo)
+{
+    CScript const owner = CScript(OP_TRUE);
+    DCT_ID const token{1};
+    uint256 const nodeId = uint256S("0x1000");
+    uint256 const txid = uint256S("0x1");
+    auto activitiesCount = [] (CCustomCSView & view) {
+        size_t count = 0;
+        view.ForEachMasternodeActivity([&] (uint256 const &, CMasternodeActivity const &) {
+            ++count;
+            return true;
+        });
+        return count;
+    };
+    auto const snapStart = TakeSnapshot(pcustomcsview->GetRaw());
+
+    // block 2 is connected before the indexes are built, so its undo has no index records
+    CCustomCSView block(*pcustomcsview);
+    CMasternode node;
+    node.operatorType = node.ownerType = 1;
+    node.operatorAuthAddress = CKeyID(uint160(std::vector<unsigned char>(20, 1)));
+    node.ownerAuthAddress = CKeyID(uint160(std::vector<unsigned char>(20, 2)));
+    node.creationHeight = 2;
+    BOOST_REQUIRE(block.CreateMasternode(nodeId, node).ok);
+    BOOST_REQUIRE(block.AddBalance(owner, CTokenAmount{token, 10}).ok);
+    auto legacyUndo = CUndo::Construct(pcustomcsview->GetRaw(), dynamic_cast<CFlushableStorageKV&>(block.GetRaw()).GetRaw());
+    for (auto it = legacyUndo.before.begin(); it != legacyUndo.before.end(); ) {
+        auto const prefix = it->first[0];
+        bool const indexRecord = prefix == 'A' || prefix == 'V' || prefix == 'b' || prefix == 's';
+        it = indexRecord ? legacyUndo.before.erase(it) : std::next(it);
+    }
+    block.SetUndo(UndoKey{2, txid}, legacyUndo);
+    block.SetLastHeight(2);
+    block.Flush();
+    pcustomcsview->ReindexTokenHolders(2);
+    pcustomcsview->ReindexActiveMasternodes(2);
+    BOOST_CHECK(activitiesCount(*pcustomcsview) == 1);
+
+    // reorg across the build height
+    CCustomCSView disconnect(*pcustomcsview);
+    disconnect.OnUndoTx(txid, 2);
+    BOOST_CHECK(!disconnect.GetMasternode(nodeId));
+    BOOST_CHECK(activitiesCount(disconnect) == 1); // stale
+    BOOST_CHECK(disconnect.GetTokenSupply(token).supply == 10); // stale
+    disconnect.OnUndoBlock(2);
+    BOOST_CHECK(activitiesCount(disconnect) == 0);
+    BOOST_CHECK(disconnect.GetTokenSupply(token).holders == 0);
+    BOOST_CHECK(disconnect.GetActiveMasternodesIndexHeight() == 1);
+    BOOST_CHECK(disconnect.GetTokenHoldersIndexHeight() == 1);
+    BOOST_CHECK(disconnect.CalcNextTeam(uint256(), 2 + GetMnActivationDelay()).empty());
+
+    // the blocks connected after the build have complete undos, nothing is rebuilt for them
+    disconnect.OnUndoBlock(3);
+    BOOST_CHECK(disconnect.GetActiveMasternodesIndexHeight() == 1);
+
+    disconnect.SetLastHeight(0);
+    disconnect.Flush();
+    auto snapDisconnected = TakeSnapshot(pcustomcsview->GetRaw());
+    for (auto key : {TBytes{'I'}, TBytes{'B'}, TBytes{'V'}, TBytes{'H'}}) {
+        snapDisconnected.erase(key);
+    }
+    auto snapStartIndexless = snapStart;
+    for (auto key : {TBytes{'I'}, TBytes{'B'}, TBytes{'V'}, TBytes{'H'}}) {
+        snapStartIndexless.erase(key);
+    }
+    BOOST_CHECK(snapStartIndexless == snapDisconnected);
+}
+
 BOOST_AUTO_TEST_CASE(recipients)
 {
     auto testChain = interfaces::MakeChain();
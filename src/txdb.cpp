@@ -53,7 +53,7 @@ struct CoinEntry {
 
 }
 
-CCoinsViewDB::CCoinsViewDB(fs::path ldb_path, size_t nCacheSize, bool fMemory, bool fWipe) : db(ldb_path, nCacheSize, fMemory, fWipe, true)
+CCoinsViewDB::CCoinsViewDB(fs::path ldb_path, size_t nCacheSize, bool fMemory, bool fWipe) : db(ldb_path, nCacheSize, fMemory, fWipe, true), m_hosted_batch(db)
 {
 }
 
@@ -132,6 +132,13 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
     }
 
     // In the last batch, mark the database as consistent with hashBlock again.
+    // The hosted state goes there too, so it is never ahead of (or behind) the best block marker. A crash between
+    // the partial batches leaves the head blocks marker as usual, and as ReplayBlocks is turned off such a chainstate
+    // (with the hosted state) has to be rebuilt with -reindex-chainstate.
+    if (m_hosted_batch.SizeEstimate() > 0) {
+        batch.Append(m_hosted_batch);
+        m_hosted_batch.Clear();
+    }
     batch.Erase(DB_HEAD_BLOCKS);
     batch.Write(DB_BEST_BLOCK, hashBlock);
 
@@ -41,6 +41,16 @@ static const int64_t nMaxTxIndexCache = 1024;
 static const int64_t max_filter_index_cache = 1024;
 //! Max memory allocated to coin DB specific cache (MiB)
 static const int64_t nMaxCoinsDBCache = 8;
+//! Default shares (percent of the -dbcache left after the block tree and indexes) and max. caches (MiB) of the
+//! masternodes related databases
+static const int64_t DEFAULT_CUSTOMCS_DB_CACHE_SHARE = 10;
+static const int64_t nMaxCustomCSDBCache = 256;
+static const int64_t DEFAULT_CRIMINALS_DB_CACHE_SHARE = 2;
+static const int64_t nMaxCriminalsDBCache = 32;
+static const int64_t DEFAULT_ANCHORS_DB_CACHE_SHARE = 1;
+static const int64_t nMaxAnchorsDBCache = 16;
+static const int64_t DEFAULT_SPV_DB_CACHE_SHARE = 1;
+static const int64_t nMaxSpvDBCache = 16;
 
 /** CCoinsView backed by the coin database (chainstate/) */
 class CCoinsViewDB final : public CCoinsView
@@ -63,6 +73,15 @@ public:
     //! Attempt to update from an older database format. Returns whether an error occurred.
     bool Upgrade();
     size_t EstimateSize() const override;
+
+    //! Key prefix of the custom state (masternodes, tokens, accounts), if it is hosted here (-customcsinchainstate)
+    static const unsigned char DB_CUSTOM_STATE = 'E';
+    CDBWrapper& GetDB() { return db; }
+    //! Writes of the hosted state, committed by the next BatchWrite in its last batch (with the best block)
+    CDBBatch& GetHostedBatch() { return m_hosted_batch; }
+
+private:
+    CDBBatch m_hosted_batch;
 };
 
 /** Specialization of CCoinsViewCursor to iterate over a CCoinsViewDB */
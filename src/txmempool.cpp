@@ -5,6 +5,7 @@
 
 #include <txmempool.h>
 
+#include <chainparams.h>
 #include <consensus/consensus.h>
 #include <consensus/tx_verify.h>
 #include <consensus/validation.h>
@@ -334,6 +335,8 @@ CTxMemPool::CTxMemPool(CBlockPolicyEstimator* estimator)
     nCheckFrequency = 0;
 }
 
+CTxMemPool::~CTxMemPool() = default;
+
 bool CTxMemPool::isSpent(const COutPoint& outpoint) const
 {
     LOCK(cs);
@@ -405,6 +408,8 @@ void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
 {
     NotifyEntryRemoved(it->GetSharedTx(), reason);
     const uint256 hash = it->GetTx().GetHash();
+    if (!customTxs.empty() && GetCustomTx(it->GetTx()).type != CustomTxType::None)
+        customViewDirty = true;
     for (const CTxIn& txin : it->GetTx().vin)
         mapNextTx.erase(txin.prevout);
 
@@ -530,6 +535,78 @@ void CTxMemPool::removeForReorg(const CCoinsViewCache *pcoins, unsigned int nMem
         CalculateDescendants(it, setAllRemoves);
     }
     RemoveStaged(setAllRemoves, false, MemPoolRemovalReason::REORG);
+
+    // the disconnected custom txs (if any) are in front, the rest is applied after them
+    RebuildPendingCustomView(*pcoins, nMemPoolHeight);
+}
+
+Res CTxMemPool::CheckPendingCustomTx(const CCoinsViewCache& coins, const CTransaction& tx, uint32_t height)
+{
+    AssertLockHeld(cs);
+    assert(customView);
+    return ApplyCustomTx(*customView, coins, tx, Params().GetConsensus(), height, true);
+}
+
+void CTxMemPool::AddPendingCustomTx(const CCoinsViewCache& coins, const CTransaction& tx, uint32_t height)
+{
+    AssertLockHeld(cs);
+    customTxs.insert(customTxsInsert, tx.GetHash());
+    // stale view is rebuilt with this tx anyway
+    if (customViewDirty)
+        return;
+    if (!ApplyCustomTx(*customView, coins, tx, Params().GetConsensus(), height, false).ok)
+        customViewDirty = true;
+}
+
+void CTxMemPool::RebuildPendingCustomView(const CCoinsViewCache& coins, uint32_t height)
+{
+    AssertLockHeld(cs);
+    customTxsInsert = customTxs.end();
+    // empty layer is valid on top of any confirmed state, but pcustomcsview itself may have been recreated
+    if (customTxs.empty() && !customViewDirty) {
+        customView = MakeUnique<CCustomCSView>(*pcustomcsview);
+        return;
+    }
+    do {
+        customViewDirty = false;
+        customView = MakeUnique<CCustomCSView>(*pcustomcsview);
+
+        CCoinsViewMemPool viewMemPool(const_cast<CCoinsViewCache*>(&coins), *this);
+        CCoinsViewCache view(&viewMemPool);
+        std::vector<CTransactionRef> failed;
+        for (auto it = customTxs.begin(); it != customTxs.end(); ) {
+            auto txit = mapTx.find(*it);
+            if (txit == mapTx.end()) {
+                it = customTxs.erase(it);
+                continue;
+            }
+            auto res = ApplyCustomTx(*customView, view, txit->GetTx(), Params().GetConsensus(), height, false);
+            if (!res.ok) {
+                LogPrint(BCLog::MEMPOOL, "custom tx %s does not apply anymore: %s\n", txit->GetTx().GetHash().ToString(), res.msg);
+                failed.push_back(txit->GetSharedTx());
+            }
+            ++it;
+        }
+        // descendants of the failed ones are applied already, so the view is rebuilt once more
+        for (auto const & tx : failed) {
+            removeRecursive(*tx, MemPoolRemovalReason::CONFLICT);
+        }
+    } while (customViewDirty);
+}
+
+void CTxMemPool::UpdatePendingCustomView(const CCoinsViewCache& coins, uint32_t height)
+{
+    AssertLockHeld(cs);
+    if (!customView || customViewDirty)
+        RebuildPendingCustomView(coins, height);
+}
+
+void CTxMemPool::ResetPendingCustomView()
+{
+    AssertLockHeld(cs);
+    customView = MakeUnique<CCustomCSView>(*pcustomcsview);
+    customViewDirty = false;
+    customTxsInsert = customTxs.begin();
 }
 
 void CTxMemPool::removeConflicts(const CTransaction &tx)
@@ -586,6 +663,10 @@ void CTxMemPool::_clear()
     mapLinks.clear();
     mapTx.clear();
     mapNextTx.clear();
+    customView.reset();
+    customTxs.clear();
+    customTxsInsert = customTxs.end();
+    customViewDirty = false;
     totalTxSize = 0;
     cachedInnerUsage = 0;
     lastRollingFeeUpdate = GetTime();
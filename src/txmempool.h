@@ -7,6 +7,7 @@
 #define DEFI_TXMEMPOOL_H
 
 #include <atomic>
+#include <list>
 #include <map>
 #include <memory>
 #include <set>
@@ -31,6 +32,7 @@
 
 class CBlockIndex;
 class CCustomCSView;
+struct Res;
 extern CCriticalSection cs_main;
 
 /** Fake height value used in Coin to signify they are only in the memory pool (since 0.8) */
@@ -547,6 +549,12 @@ private:
 
     std::vector<indexed_transaction_set::const_iterator> GetSortedDepthAndScore() const EXCLUSIVE_LOCKS_REQUIRED(cs);
 
+    /** Pending custom state: the custom txs of the pool, applied in order of acceptance on top of pcustomcsview */
+    std::unique_ptr<CCustomCSView> customView GUARDED_BY(cs);
+    std::list<uint256> customTxs GUARDED_BY(cs);
+    std::list<uint256>::iterator customTxsInsert GUARDED_BY(cs); //!< where the accepted custom txs go (before the unapplied tail while reorg)
+    bool customViewDirty GUARDED_BY(cs);                         //!< a custom tx was removed, its changes are still in the view
+
 public:
     indirectmap<COutPoint, const CTransaction*> mapNextTx GUARDED_BY(cs);
     std::map<uint256, CAmount> mapDeltas;
@@ -554,6 +562,7 @@ public:
     /** Create a new CTxMemPool.
      */
     explicit CTxMemPool(CBlockPolicyEstimator* estimator = nullptr);
+    ~CTxMemPool();
 
     /**
      * If sanity-checking is turned on, check makes sure the pool is
@@ -579,6 +588,23 @@ public:
     void removeConflicts(const CTransaction& tx) EXCLUSIVE_LOCKS_REQUIRED(cs);
     void removeForBlock(const std::vector<CTransactionRef>& vtx, unsigned int nBlockHeight) EXCLUSIVE_LOCKS_REQUIRED(cs);
 
+    /** Checks the custom tx against the pending custom state (w/o applying it) */
+    Res CheckPendingCustomTx(const CCoinsViewCache& coins, const CTransaction& tx, uint32_t height) EXCLUSIVE_LOCKS_REQUIRED(cs, cs_main);
+    /** Applies the custom tx being added to the pool to the pending custom state */
+    void AddPendingCustomTx(const CCoinsViewCache& coins, const CTransaction& tx, uint32_t height) EXCLUSIVE_LOCKS_REQUIRED(cs, cs_main);
+    /**
+     * Re-applies the pending custom txs on top of the current confirmed state (after block connect/disconnect or
+     * removal of a custom tx), removes the ones which don't apply anymore (with their descendants).
+     */
+    void RebuildPendingCustomView(const CCoinsViewCache& coins, uint32_t height) EXCLUSIVE_LOCKS_REQUIRED(cs, cs_main);
+    /** Rebuilds the pending custom state only if it isn't built yet or a custom tx was removed since */
+    void UpdatePendingCustomView(const CCoinsViewCache& coins, uint32_t height) EXCLUSIVE_LOCKS_REQUIRED(cs, cs_main);
+    /**
+     * Drops the pending custom state before the disconnected txs are added back, so they are checked first and
+     * placed in front of the pending custom txs, which are re-applied by the next rebuild.
+     */
+    void ResetPendingCustomView() EXCLUSIVE_LOCKS_REQUIRED(cs, cs_main);
+
     void clear();
     void _clear() EXCLUSIVE_LOCKS_REQUIRED(cs); //lock free
     bool CompareDepthAndScore(const uint256& hasha, const uint256& hashb);
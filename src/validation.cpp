@@ -128,6 +128,7 @@ bool fCheckBlockIndex = false;
 bool fCheckpointsEnabled = DEFAULT_CHECKPOINTS_ENABLED;
 size_t nCoinCacheUsage = 5000 * 300;
 uint64_t nPruneTarget = 0;
+int nCustomUndoDepth = DEFAULT_CUSTOM_UNDO_DEPTH;
 bool fIsFakeNet = false;
 bool fCriminals = false;
 int64_t nMaxTipAge = DEFAULT_MAX_TIP_AGE;
@@ -376,10 +377,10 @@ static void UpdateMempoolForReorg(DisconnectedBlockTransactions& disconnectpool,
     // back to the mempool starting with the earliest transaction that had
     // been previously seen in a block.
     bool possibleMintTokenAffected{false};
+    mempool.ResetPendingCustomView();
     auto it = disconnectpool.queuedTx.get<insertion_order>().rbegin();
     while (it != disconnectpool.queuedTx.get<insertion_order>().rend()) {
-        TBytes dummy;
-        if (GuessCustomTxType(**it, dummy) == CustomTxType::CreateToken) // regardless of fAddToMempool and prooven CreateTokenTx
+        if (GetCustomTx(**it).type == CustomTxType::CreateToken) // regardless of fAddToMempool and prooven CreateTokenTx
             possibleMintTokenAffected = true;
 
         // ignore validation errors in resurrected transactions
@@ -403,7 +404,7 @@ static void UpdateMempoolForReorg(DisconnectedBlockTransactions& disconnectpool,
         std::vector<uint256> mintTokensToRemove; // not sure about tx refs safety while recursive deletion, so hashes
         for (const CTxMemPoolEntry& e : mempool.mapTx) {
             auto tx = e.GetTx();
-            if (GetMintTokenMetadata(tx)) {
+            if (GetCustomTx(tx).type == CustomTxType::MintToken) {
                 auto values = tx.GetValuesOut();
                 for (auto const & pair : values) {
                     if (pair.first == DCT_ID{0})
@@ -514,6 +515,12 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
     if (!CheckFinalTx(tx, STANDARD_LOCKTIME_VERIFY_FLAGS))
         return state.Invalid(ValidationInvalidReason::TX_PREMATURE_SPEND, false, REJECT_NONSTANDARD, "non-final");
 
+    // custom txs are checked against the pending custom state, which might drop some of the pool txs when rebuilt
+    const bool isCustomTx = GetCustomTx(tx).type != CustomTxType::None;
+    if (isCustomTx) {
+        pool.UpdatePendingCustomView(::ChainstateActive().CoinsTip(), ::ChainActive().Height() + 1);
+    }
+
     // is it already in the memory pool?
     if (pool.exists(hash)) {
         return state.Invalid(ValidationInvalidReason::TX_CONFLICT, false, REJECT_DUPLICATE, "txn-already-in-mempool");
@@ -601,10 +608,19 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
         view.GetBestBlock();
 
         CAmount nFees = 0;
-        if (!Consensus::CheckTxInputs(tx, state, view, pcustomcsview.get(), GetSpendHeight(view), nFees)) {
+        const int nSpendHeight = GetSpendHeight(view);
+        if (!Consensus::CheckTxInputs(tx, state, view, pcustomcsview.get(), nSpendHeight, nFees)) {
             return error("%s: Consensus::CheckTxInputs: %s, %s", __func__, tx.GetHash().ToString(), FormatStateMessage(state));
         }
 
+        // custom tx which fails on top of the pending ones is skipped by ConnectBlock, don't waste the block space and relay on it
+        if (isCustomTx) {
+            auto res = pool.CheckPendingCustomTx(view, tx, nSpendHeight);
+            if (!res.ok) {
+                return state.Invalid(ValidationInvalidReason::TX_MEMPOOL_POLICY, false, REJECT_NONSTANDARD, "bad-txns-customtx-pending", res.msg);
+            }
+        }
+
         // we have all inputs cached now, so switch back to dummy, so we don't need to keep lock on mempool
         view.SetBackend(dummy);
 
@@ -891,6 +907,10 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
         // - the transaction is not dependent on any other transactions in the mempool
         bool validForFeeEstimation = !fReplacementTransaction && !bypass_limits && IsCurrentForFeeEstimation() && pool.HasNoInputsOf(tx);
 
+        if (isCustomTx) {
+            pool.AddPendingCustomTx(view, tx, nSpendHeight);
+        }
+
         // Store transaction in memory
         pool.addUnchecked(entry, setAncestors, validForFeeEstimation);
 
@@ -1602,6 +1622,11 @@ DisconnectResult CChainState::DisconnectBlock(const CBlock& block, const CBlockI
         return DISCONNECT_FAILED;
     }
 
+    if (pindex->nHeight < (int) mnview.GetUndosPrunedHeight()) {
+        error("DisconnectBlock(): custom undo data at height %d was pruned (-customundodepth)", pindex->nHeight);
+        return DISCONNECT_FAILED;
+    }
+
     // special case: possible undo (first) of custom 'complex changes' for the whole block (expired orders and/or prices)
     mnview.OnUndoTx(uint256(), (uint32_t) pindex->nHeight); // undo for "zero hash"
 
@@ -1694,6 +1719,7 @@ DisconnectResult CChainState::DisconnectBlock(const CBlock& block, const CBlockI
         // process transactions revert for masternodes
         mnview.OnUndoTx(tx.GetHash(), (uint32_t) pindex->nHeight);
     }
+    mnview.OnUndoBlock(pindex->nHeight);
     // move best block pointer to prevout block
     view.SetBestBlock(pindex->pprev->GetBlockHash());
 
@@ -1748,6 +1774,30 @@ void ThreadScriptCheck(int worker_num) {
     scriptcheckqueue.Thread();
 }
 
+static CCheckQueue<CAuxCheck> auxcheckqueue(128);
+
+void ThreadAuxCheck(int worker_num) {
+    util::ThreadRename(strprintf("auxcheck.%i", worker_num));
+    auxcheckqueue.Thread();
+}
+
+int GetAuxCheckThreads() {
+    return (nScriptCheckThreads + 1) / 2;
+}
+
+bool RunAuxChecks(std::vector<CAuxCheck>& checks) {
+    if (GetAuxCheckThreads() == 0) {
+        bool fOk = true;
+        for (auto& check : checks) {
+            fOk = check() && fOk;
+        }
+        return fOk;
+    }
+    CCheckQueueControl<CAuxCheck> control(&auxcheckqueue);
+    control.Add(checks);
+    return control.Wait();
+}
+
 VersionBitsCache versionbitscache GUARDED_BY(cs_main);
 
 int32_t ComputeBlockVersion(const CBlockIndex* pindexPrev, const Consensus::Params& params)
@@ -2080,6 +2130,21 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
     int nInputs = 0;
     int64_t nSigOpsCost = 0;
     blockundo.vtxundo.reserve(block.vtx.size() - 1);
+
+    // Decode custom txs of the whole block ahead: it doesn't depend on the views, so it is done in parallel.
+    // Applying them (auth checks and state changes) stays in the block order below.
+    std::vector<CDecodedCustomTx> decodedCustomTxs(block.vtx.size());
+    {
+        std::vector<CAuxCheck> vDecodeChecks;
+        vDecodeChecks.reserve(block.vtx.size());
+        for (unsigned int i = 0; i < block.vtx.size(); i++) {
+            if (!block.vtx[i]->IsCoinBase()) {
+                vDecodeChecks.emplace_back(CCustomTxDecodeCheck(*block.vtx[i], pindex->nHeight, decodedCustomTxs[i]));
+            }
+        }
+        RunAuxChecks(vDecodeChecks);
+    }
+
     std::vector<PrecomputedTransactionData> txdata;
     txdata.reserve(block.vtx.size()); // Required so that pointers to individual PrecomputedTransactionData don't get invalidated
     for (unsigned int i = 0; i < block.vtx.size(); i++)
@@ -2151,7 +2216,7 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
                     tx.GetHash().ToString(), FormatStateMessage(state));
             }
 
-            const auto res = ApplyCustomTx(mnview, view, tx, chainparams.GetConsensus(), pindex->nHeight, fJustCheck);
+            const auto res = ApplyCustomTx(mnview, view, tx, chainparams.GetConsensus(), pindex->nHeight, fJustCheck, &decodedCustomTxs[i]);
             if (!res.ok && (res.code & CustomTxErrCodes::Fatal)) {
                 // we will never fail, but skip, unless transaction mints UTXOs
                 return error("ConnectBlock(): ApplyCustomTx on %s failed with %s",
@@ -2380,7 +2445,9 @@ bool CChainState::FlushStateToDisk(
             nLastFlush = nNow;
         }
         int64_t nMempoolSizeMax = gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
-        int64_t cacheSize = CoinsTip().DynamicMemoryUsage();
+        // pending masternodes/tokens/accounts changes are flushed together with the coins, so they share the budget
+        int64_t const customCacheSize = pcustomcsview ? pcustomcsview->DynamicMemoryUsage() : 0;
+        int64_t cacheSize = CoinsTip().DynamicMemoryUsage() + customCacheSize;
         int64_t nTotalSpace = nCoinCacheUsage + std::max<int64_t>(nMempoolSizeMax - nMempoolUsage, 0);
         // The cache is large and we're within 10% and 10 MiB of the limit, but we have time now (not in the middle of a block processing).
         bool fCacheLarge = mode == FlushStateMode::PERIODIC && cacheSize > std::max((9 * nTotalSpace) / 10, nTotalSpace - MAX_BLOCK_COINSDB_USAGE * 1024 * 1024);
@@ -2400,6 +2467,27 @@ bool CChainState::FlushStateToDisk(
             }
             // First make sure all block and undo data is flushed to disk.
             FlushBlockFile();
+            // Minted headers are only needed to prove double signing of the recent blocks
+            static size_t nMintedHeadersPruned = 0; // since the last compaction
+            if (m_chain.Height() > static_cast<int>(DOUBLE_SIGN_MINIMUM_PROOF_INTERVAL)) {
+                uint32_t const belowHeight = m_chain.Height() - DOUBLE_SIGN_MINIMUM_PROOF_INTERVAL;
+                size_t const pruned = pcriminals->PruneMintedHeaders(belowHeight, MINTED_HEADERS_PRUNE_BATCH);
+                if (pruned > 0) {
+                    nMintedHeadersPruned += pruned;
+                    LogPrint(BCLog::PRUNE, "Prune: removed %d minted headers below height %d\n", pruned, belowHeight);
+                }
+            }
+            // The minted headers (and the criminal proofs) go before the block index: a block index entry persisted w/o
+            // its header would never be checked for double signing again (the criminals db isn't replayed).
+            if (!pcriminals->Flush() || !pcriminalsDB->Flush())
+                return AbortNode(state, "Failed to write to criminals database");
+            if (nMintedHeadersPruned >= MINTED_HEADERS_COMPACT_THRESHOLD) {
+                LogPrint(BCLog::PRUNE, "Prune: compacting minted headers (%d erased)\n", nMintedHeadersPruned);
+                // minted headers and their heights index are adjacent keyspaces
+                pcriminalsDB->Compact(TBytes{CMintedHeadersView::MintedHeaders::prefix},
+                                      TBytes{static_cast<unsigned char>(CMintedHeadersView::MintedHeadersByHeight::prefix + 1)});
+                nMintedHeadersPruned = 0;
+            }
             // Then update all block file information (which may refer to block and undo files).
             {
                 std::vector<std::pair<int, const CBlockFileInfo*> > vFiles;
@@ -2430,15 +2518,26 @@ bool CChainState::FlushStateToDisk(
             // twice (once in the log, and once in the tables). This is already
             // an overestimation, as most will delete an existing entry or
             // overwrite one. Still, use a conservative safety factor of 2.
-            /// @todo check free space for pcustomcsview flushing
-            if (!CheckDiskSpace(GetDataDir(), 48 * 2 * 2 * CoinsTip().GetCacheSize())) {
+            // The same safety factor for the pending custom changes (their keys and values are in the measured buffer).
+            if (!CheckDiskSpace(GetDataDir(), 48 * 2 * 2 * CoinsTip().GetCacheSize() + 2 * customCacheSize)) {
                 return AbortNode(state, "Disk space is too low!", _("Error: Disk space is too low!").translated, CClientUIInterface::MSG_NOPREFIX);
             }
+            // Drop custom undos that are too deep to be used, limited per flush to not stall it
+            if (nCustomUndoDepth > 0 && m_chain.Height() > nCustomUndoDepth) {
+                size_t const pruned = pcustomcsview->PruneUndos(m_chain.Height() - nCustomUndoDepth, CUSTOM_UNDO_PRUNE_BATCH);
+                if (pruned > 0) {
+                    LogPrint(BCLog::PRUNE, "Prune: removed %d custom undos below height %d\n", pruned, m_chain.Height() - nCustomUndoDepth);
+                }
+            }
             // Flush the chainstate (which may refer to block index entries).
-            /// @todo may be integrate pcustomcsview into ChainState?
             /// @attention it is critical to flush 'pcustomcsview', then 'pcustomcsDB'!!!
-            if (!CoinsTip().Flush() || !pcustomcsview->Flush() || !pcustomcsDB->Flush())
+            // With -customcsinchainstate the custom changes are staged by 'pcustomcsview' and committed by the coins
+            // flush in its last batch, atomically with the best block ('pcustomcsDB' has nothing left to write then).
+            int64_t const nFlushStart = GetTimeMicros();
+            if (!pcustomcsview->Flush() || !CoinsTip().Flush() || !pcustomcsDB->Flush())
                 return AbortNode(state, "Failed to write to coin or masternodes database");
+            LogPrint(BCLog::COINDB, "Flushed coins and masternodes state (%s) in %.2fms\n",
+                     pcustomcsDB->IsShared() ? "one db" : "separate dbs", (GetTimeMicros() - nFlushStart) * MILLI);
             nLastFlush = nNow;
             full_flush_completed = true;
         }
@@ -2529,11 +2628,12 @@ void static UpdateTip(const CBlockIndex* pindexNew, const CChainParams& chainPar
         if (nUpgraded > 0)
             AppendWarning(warningMessages, strprintf(_("%d of last 100 blocks have unexpected version").translated, nUpgraded));
     }
-    LogPrintf("%s: new best=%s height=%d version=0x%08x log2_work=%.8g tx=%lu date='%s' progress=%f cache=%.1fMiB(%utxo)", __func__, /* Continued */
+    LogPrintf("%s: new best=%s height=%d version=0x%08x log2_work=%.8g tx=%lu date='%s' progress=%f cache=%.1fMiB(%utxo) customcache=%.1fMiB(%uchanges)", __func__, /* Continued */
       pindexNew->GetBlockHash().ToString(), pindexNew->nHeight, pindexNew->nVersion,
       log(pindexNew->nChainWork.getdouble())/log(2.0), (unsigned long)pindexNew->nChainTx,
       FormatISO8601DateTime(pindexNew->GetBlockTime()),
-      GuessVerificationProgress(chainParams.TxData(), pindexNew), ::ChainstateActive().CoinsTip().DynamicMemoryUsage() * (1.0 / (1<<20)), ::ChainstateActive().CoinsTip().GetCacheSize());
+      GuessVerificationProgress(chainParams.TxData(), pindexNew), ::ChainstateActive().CoinsTip().DynamicMemoryUsage() * (1.0 / (1<<20)), ::ChainstateActive().CoinsTip().GetCacheSize(),
+      pcustomcsview->DynamicMemoryUsage() * (1.0 / (1<<20)), pcustomcsview->GetPendingChanges());
     if (!warningMessages.empty())
         LogPrintf(" warning='%s'", warningMessages); /* Continued */
     LogPrintf("\n");
@@ -2575,11 +2675,13 @@ bool CChainState::DisconnectTip(CValidationState& state, const CChainParams& cha
         if (!disconnectedConfirms.empty()) {
             for (auto const & confirm : disconnectedConfirms) {
                 panchorAwaitingConfirms->Add(confirm);
+                panchors->OnRewardDisconnected(confirm.btcTxHash);
             }
             // we do not clear ALL votes (even they are stale) for the case of rapid tip changing. At least, they'll be deleted after their rewards
             panchorAwaitingConfirms->ReVote();
         }
         for (auto const & cr : disconnectedCriminals) {
+            pcriminals->UnmarkCriminalPunished(cr.first);
             pcriminals->AddCriminalProof(cr.first, cr.second.blockHeader, cr.second.conflictBlockHeader);
         }
     }
@@ -2725,11 +2827,12 @@ bool CChainState::ConnectTip(CValidationState& state, const CChainParams& chainp
             // we do not clear ALL votes (even they are stale) for the case of rapid tip changing. At least, they'll be deleted after their rewards
             for (auto const & btcTxHash : rewardedAnchors) {
                 panchorAwaitingConfirms->EraseAnchor(btcTxHash);
+                panchors->OnRewardConnected(btcTxHash);
             }
             panchorAwaitingConfirms->ReVote();
         }
         for (auto const & nodeId : bannedCriminals) {
-            pcriminals->RemoveCriminalProofs(nodeId);
+            pcriminals->MarkCriminalPunished(nodeId);
         }
     }
     int64_t nTime4 = GetTimeMicros(); nTimeFlush += nTime4 - nTime3;
@@ -2741,6 +2844,7 @@ bool CChainState::ConnectTip(CValidationState& state, const CChainParams& chainp
     LogPrint(BCLog::BENCH, "  - Writing chainstate: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime5 - nTime4) * MILLI, nTimeChainState * MICRO, nTimeChainState * MILLI / nBlocksTotal);
     // Remove conflicting transactions from the mempool.;
     mempool.removeForBlock(blockConnecting.vtx, pindexNew->nHeight);
+    mempool.RebuildPendingCustomView(CoinsTip(), pindexNew->nHeight + 1);
     disconnectpool.removeForBlock(blockConnecting.vtx);
     // Update m_chain & related variables.
     m_chain.SetTip(pindexNew);
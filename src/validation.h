@@ -25,6 +25,7 @@
 #include <algorithm>
 #include <atomic>
 #include <exception>
+#include <functional>
 #include <map>
 #include <memory>
 #include <set>
@@ -178,6 +179,8 @@ extern bool fHavePruned;
 extern bool fPruneMode;
 /** Number of MiB of block files that we're trying to stay below. */
 extern uint64_t nPruneTarget;
+/** Undos of custom (masternodes/tokens/accounts) changes deeper than this below the tip are pruned, 0 = keep all */
+extern int nCustomUndoDepth;
 /** Flag to skip PoS-related checks (regtest only) */
 extern bool fIsFakeNet;
 extern bool fCriminals;
@@ -189,6 +192,14 @@ namespace spv {
 
 /** Block files containing a block-height within MIN_BLOCKS_TO_KEEP of ::ChainActive().Tip() will not be pruned. */
 static const unsigned int MIN_BLOCKS_TO_KEEP = 288;
+/** Default for -customundodepth, keep all custom undos */
+static const int DEFAULT_CUSTOM_UNDO_DEPTH = 0;
+/** Max number of custom undos erased per full state flush */
+static const size_t CUSTOM_UNDO_PRUNE_BATCH = 10000;
+/** Max number of minted headers erased per full state flush */
+static const size_t MINTED_HEADERS_PRUNE_BATCH = 10000;
+/** Compact the minted headers ranges of the criminals db after this many headers were erased */
+static const size_t MINTED_HEADERS_COMPACT_THRESHOLD = 10000;
 /** Minimum blocks required to signal NODE_NETWORK_LIMITED */
 static const unsigned int NODE_NETWORK_LIMITED_MIN_BLOCKS = 288;
 
@@ -258,6 +269,10 @@ bool LoadChainTip(const CChainParams& chainparams) EXCLUSIVE_LOCKS_REQUIRED(cs_m
 void UnloadBlockIndex();
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck(int worker_num);
+/** Run an instance of the auxiliary checking thread */
+void ThreadAuxCheck(int worker_num);
+/** Number of the auxiliary checking threads (the caller included), the jobs are light next to the scripts so the pool is smaller */
+int GetAuxCheckThreads();
 /** Retrieve a transaction (from memory pool, or from disk, if possible) */
 bool GetTransaction(const uint256& hash, CTransactionRef& tx, const Consensus::Params& params, uint256& hashBlock, const CBlockIndex* const blockIndex = nullptr);
 /**
@@ -372,6 +387,30 @@ public:
     ScriptError GetScriptError() const { return error; }
 };
 
+/**
+ * Closure representing a job of the auxiliary check queue (the custom txs decoding and similar light jobs,
+ * which can't be queued with the scripts). Run them with RunAuxChecks.
+ */
+class CAuxCheck
+{
+private:
+    std::function<bool()> func;
+
+public:
+    CAuxCheck() {}
+    template <typename TCheck>
+    explicit CAuxCheck(TCheck check) : func(std::move(check)) {}
+
+    bool operator()() { return func(); }
+
+    void swap(CAuxCheck &check) {
+        func.swap(check.func);
+    }
+};
+
+/** Runs the checks on the auxiliary checking threads (in place if there are none), returns whether all of them passed */
+bool RunAuxChecks(std::vector<CAuxCheck>& checks);
+
 /** Initializes the script-execution cache */
 void InitScriptExecutionCache();
 
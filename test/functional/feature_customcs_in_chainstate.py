@@ -0,0 +1,154 @@
+#!/usr/bin/env python3
+# Copyright (c) DeFi Blockchain Developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test -customcsinchainstate (the enhanced chainstate hosted by the chainstate db).
+
+- node0 hosts the masternodes/tokens/accounts in the chainstate db, node1 keeps them in enhancedcs
+- both follow the same chain with custom txs, the states are compared after the forced flushes
+- node0 is switched back and forth (the state is moved between the dbs on start)
+- the flush latency of both nodes is reported (from the coindb log)
+- node0 syncs with -dbcrashratio: after every simulated crash it refuses to start (ReplayBlocks is turned off)
+  and is recovered with -reindex-chainstate, the recovered state has to match node1's
+"""
+
+import http.client
+import os
+import re
+
+from test_framework.test_framework import DefiTestFramework
+from test_framework.test_node import ErrorMatch, FailedToStartError
+from test_framework.util import assert_equal, connect_nodes_bi, wait_until
+
+FLUSH_LOG = re.compile(r"Flushed coins and masternodes state \((one db|separate dbs)\) in ([0-9.]+)ms")
+
+class CustomCSInChainstateTest(DefiTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 2
+        self.setup_clean_chain = True
+        self.extra_args = [['-txnotokens=0', '-debug=coindb', '-customcsinchainstate'],
+                           ['-txnotokens=0', '-debug=coindb']]
+
+    def flush_latencies(self, node):
+        latencies = {}
+        with open(os.path.join(node.datadir, self.chain, 'debug.log'), encoding='utf-8') as log:
+            for line in log:
+                match = FLUSH_LOG.search(line)
+                if match:
+                    latencies.setdefault(match.group(1), []).append(float(match.group(2)))
+        return latencies
+
+    def check_same_state(self):
+        self.sync_all()
+        for node in self.nodes:
+            node.gettxoutsetinfo() # forces the full flush
+        assert_equal(self.nodes[0].listtokens(), self.nodes[1].listtokens())
+        assert_equal(self.nodes[0].listaccounts({}, False), self.nodes[1].listaccounts({}, False))
+
+    def transfer_round(self, owner, to):
+        self.nodes[0].utxostoaccount([], {owner: "1@DFI"})
+        self.nodes[0].accounttoaccount([], owner, {to: "1@GOLD"})
+        self.nodes[0].generate(1)
+
+    def count_crashes(self):
+        with open(os.path.join(self.nodes[0].datadir, self.chain, 'debug.log'), encoding='utf-8') as log:
+            return sum(1 for line in log if 'Simulating a crash' in line)
+
+    def reindex_after_crash(self):
+        """ReplayBlocks is turned off in this tree: a crash between the partial batches of a flush leaves the head
+        blocks marker, and the node refuses to start until the chainstate (with the hosted state) is reindexed.
+        Returns False if node0 did not crash since the last call."""
+        crashes = self.count_crashes()
+        if crashes == self.crashes:
+            return False
+        self.crashes = crashes
+        self.nodes[0].assert_start_raises_init_error(self.extra_args[0], "Unable to replay blocks", match=ErrorMatch.PARTIAL_REGEX)
+        self.start_node(0, self.extra_args[0] + ['-reindex-chainstate'])
+        wait_until(lambda: self.nodes[0].getblockcount() == self.nodes[0].getblockchaininfo()['headers'])
+        self.stop_node(0)
+        return True
+
+    def sync_crashing_node(self, args):
+        """Submit node1's blocks to node0, forcing the flush after every block. Reindex node0 after every
+        simulated crash and submit from its recovered tip again."""
+        tip = self.nodes[1].getblockcount()
+        while True:
+            try:
+                self.start_node(0, args)
+                for height in range(self.nodes[0].getblockcount() + 1, tip + 1):
+                    self.nodes[0].submitblock(self.nodes[1].getblock(self.nodes[1].getblockhash(height), 0))
+                    self.nodes[0].gettxoutsetinfo()
+                assert_equal(self.nodes[0].getbestblockhash(), self.nodes[1].getbestblockhash())
+                # the shutdown flush may crash as well
+                self.stop_node(0)
+            except (FailedToStartError, http.client.HTTPException, OSError):
+                self.wait_for_node_exit(0, timeout=30)
+                assert self.count_crashes() > self.crashes
+            if not self.reindex_after_crash():
+                return
+
+    def run_test(self):
+        self.setup_tokens()
+        self.check_same_state()
+        assert not os.path.exists(os.path.join(self.nodes[0].datadir, self.chain, 'enhancedcs'))
+
+        owner = self.nodes[0].get_genesis_keys().ownerAuthAddress
+        to = self.nodes[1].getnewaddress("", "legacy")
+        for _ in range(10):
+            self.transfer_round(owner, to)
+            self.check_same_state()
+        assert_equal(self.nodes[1].getaccount(to, {}, True)['128'], 10)
+
+        self.log.info("Move the enhanced chainstate out of the chainstate db and back")
+        with self.nodes[0].assert_debug_log(["enhanced chainstate records out of the chainstate database"]):
+            self.restart_node(0, ['-txnotokens=0', '-debug=coindb'])
+        connect_nodes_bi(self.nodes, 0, 1)
+        self.check_same_state()
+        self.transfer_round(owner, to)
+        self.check_same_state()
+
+        with self.nodes[0].assert_debug_log(["enhanced chainstate records into the chainstate database"]):
+            self.restart_node(0, self.extra_args[0])
+        connect_nodes_bi(self.nodes, 0, 1)
+        assert not os.path.exists(os.path.join(self.nodes[0].datadir, self.chain, 'enhancedcs'))
+        self.check_same_state()
+        self.transfer_round(owner, to)
+        self.check_same_state()
+        assert_equal(self.nodes[1].getaccount(to, {}, True)['128'], 12)
+
+        # the enhanced chainstate shares the chainstate db (and its cache)
+        names = [db['name'] for db in self.nodes[0].getdbcacheinfo()]
+        assert 'chainstate' in names and 'enhancedcs' not in names
+        assert 'enhancedcs' in [db['name'] for db in self.nodes[1].getdbcacheinfo()]
+
+        for node in self.nodes:
+            for mode, latencies in sorted(self.flush_latencies(node).items()):
+                self.log.info("node%d, %s: %d flushes, avg %.2fms, max %.2fms" %
+                              (node.index, mode, len(latencies), sum(latencies) / len(latencies), max(latencies)))
+        assert 'one db' in self.flush_latencies(self.nodes[0])
+        assert_equal(list(self.flush_latencies(self.nodes[1]).keys()), ['separate dbs'])
+
+        self.log.info("Crash node0 in the middle of the shared db flushes and check the recovered state")
+        self.stop_node(0)
+        owner1 = self.nodes[1].get_genesis_keys().ownerAuthAddress
+        to1 = self.nodes[1].getnewaddress("", "legacy")
+        for _ in range(20):
+            self.nodes[1].utxostoaccount([], {owner1: "1@DFI"})
+            self.nodes[1].accounttoaccount([], owner1, {to1: "1@SILVER"})
+            self.nodes[1].generate(1)
+
+        # every coin goes into its own partial batch, the hosted state is written with the last one
+        crash_args = self.extra_args[0] + ['-dbcrashratio=8', '-dbbatchsize=1']
+        self.crashes = 0
+        self.sync_crashing_node(crash_args)
+        self.log.info("node0 crashed (and was reindexed) %d times" % self.crashes)
+        assert self.crashes > 0
+
+        self.start_node(0, self.extra_args[0])
+        connect_nodes_bi(self.nodes, 0, 1)
+        self.check_same_state()
+        silver = list(self.nodes[1].gettoken("SILVER").keys())[0]
+        assert_equal(self.nodes[0].getaccount(to1, {}, True)[silver], 20)
+
+if __name__ == '__main__':
+    CustomCSInChainstateTest().main()
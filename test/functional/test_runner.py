@@ -134,6 +134,7 @@ BASE_SCRIPTS = [
     'feature_tokens_minting.py',
     'feature_tokens_dat.py',
     'feature_accounts_n_utxos.py',
+    'feature_customcs_in_chainstate.py',
     'interface_rest.py',
     'mempool_spend_coinbase.py',
     'wallet_avoidreuse.py',